@@ -0,0 +1,66 @@
+#include "bloom_filter.h"
+
+#include <math.h>
+#include <assert.h>
+
+#include "../utils/Utils.h"
+
+using namespace std;
+
+bloom_filter::bloom_filter(size_t expected, double fpRate): m_expected(expected ? expected : 1), m_count(0)
+{
+    assert(fpRate > 0 && fpRate < 1);
+    double ln2 = log(2.0);
+    double bits = ceil(-static_cast<double>(m_expected) * log(fpRate) / (ln2 * ln2));
+    m_words = (static_cast<size_t>(bits) + 63) / 64;
+    m_bits = m_words * 64;
+    m_hashes = static_cast<int>(round(static_cast<double>(m_bits) / m_expected * ln2));
+    m_hashes = m_hashes < 1 ? 1 : m_hashes;
+    m_bitmap.reset(new atomic<uint64_t>[m_words]);
+    for(size_t i = 0; i < m_words; i++)
+    {
+        m_bitmap[i].store(0, memory_order_relaxed);
+    }
+}
+
+/* 所有位都已置上时视为已存在，不计数 */
+bool bloom_filter::add(const string &key)
+{
+    uint64_t h = Utils::hash64(key);
+    uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+    bool added = false;
+    for(int i = 0; i < m_hashes; i++)
+    {
+        size_t bit = (h1 + i * h2) % m_bits;
+        uint64_t mask = 1ULL << (bit % 64);
+        if(!(m_bitmap[bit / 64].fetch_or(mask, memory_order_relaxed) & mask))
+        {
+            added = true;
+        }
+    }
+    if(added)
+    {
+        m_count.fetch_add(1, memory_order_relaxed);
+    }
+    return added;
+}
+
+bool bloom_filter::mayContain(const string &key) const
+{
+    uint64_t h = Utils::hash64(key);
+    uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+    for(int i = 0; i < m_hashes; i++)
+    {
+        size_t bit = (h1 + i * h2) % m_bits;
+        if(!(m_bitmap[bit / 64].load(memory_order_relaxed) & (1ULL << (bit % 64))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+double bloom_filter::currentFpRate() const
+{
+    return pow(1 - exp(-static_cast<double>(m_hashes) * m_count / m_bits), m_hashes);
+}
@@ -0,0 +1,44 @@
+/* 布隆过滤器：快速判断字符串“一定不在”集合里
+
+    按预期元素数 n 和误判率 p 取位数 m = -n·ln(p) / (ln2)^2、哈希个数 k = m/n·ln2，
+    k 个位置由一次 64 位哈希拆出两个值做双重哈希（h1 + i·h2）得到。
+    位数组按 64 位原子字存放，add 和 mayContain 可以在多个线程并发调用；不支持删除。
+*/
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+
+class bloom_filter
+{
+public:
+    bloom_filter(size_t expected, double fpRate);
+
+    bool add(const std::string &key);                  // 没有置上新位（已存在或误判）时返回 false
+    bool mayContain(const std::string &key) const;     // false 表示一定不在
+
+    size_t count() const { return m_count; }            // 置上了新位的加入次数，重复加入不计数
+    size_t expected() const { return m_expected; }
+    size_t bits() const { return m_bits; }
+    int hashes() const { return m_hashes; }
+    size_t memory() const { return m_words * sizeof(uint64_t); }
+
+    /* 按当前元素数估算的误判率 (1 - e^(-kn/m))^k，超过预期元素数后会明显上升 */
+    double currentFpRate() const;
+
+private:
+    size_t m_expected;
+    size_t m_bits;
+    size_t m_words;
+    int m_hashes;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_bitmap;
+    std::atomic<size_t> m_count;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "circuit_breaker.h"
+
+#include "log.h"
+
+using namespace std;
+
+const int circuit_breaker::BUCKET_MS;
+const int circuit_breaker::MAX_BUCKETS;
+
+circuit_breaker::circuit_breaker(const string &name, const breaker_config &config):
+    m_name(name), m_config(config), m_state(CLOSED), m_openUntil(0), m_halfOpens(0), m_probing(0), m_probeOk(0),
+    m_trips(0), m_recoveries(0), m_rejected(0)
+{
+    m_buckets = m_config.windowMs / BUCKET_MS;
+    m_buckets = m_buckets < 1 ? 1 : (m_buckets > MAX_BUCKETS ? MAX_BUCKETS : m_buckets);
+    m_config.probes = m_config.probes < 1 ? 1 : m_config.probes;
+    resetWindow();
+}
+
+long long circuit_breaker::nowMs() const
+{
+    return chrono::duration_cast<chrono::milliseconds>(clock::now().time_since_epoch()).count();
+}
+
+const char *circuit_breaker::stateName(STATE state)
+{
+    switch(state)
+    {
+        case CLOSED: return "closed";
+        case OPEN: return "open";
+        default: return "half-open";
+    }
+}
+
+void circuit_breaker::resetWindow()
+{
+    for(int i = 0; i < MAX_BUCKETS; i++)
+    {
+        m_window[i].second = -1;
+        m_window[i].calls = 0;
+        m_window[i].bad = 0;
+    }
+}
+
+void circuit_breaker::count(unsigned int &calls, unsigned int &bad, long long now)
+{
+    long long second = now / BUCKET_MS;
+    calls = 0;
+    bad = 0;
+    for(int i = 0; i < m_buckets; i++)
+    {
+        if(m_window[i].second > second - m_buckets)
+        {
+            calls += m_window[i].calls;
+            bad += m_window[i].bad;
+        }
+    }
+}
+
+void circuit_breaker::trip(long long now)
+{
+    LOG_WARN("Circuit breaker %s open for %dms (was %s)", m_name.c_str(), m_config.openMs, stateName(m_state));
+    m_state = OPEN;
+    m_openUntil = now + m_config.openMs;
+    ++m_trips;
+}
+
+/* 打开到期后由第一个调用切到半开 */
+bool circuit_breaker::allow(unsigned long long &probe)
+{
+    probe = 0;
+    lock_guard<mutex> locker(m_mutex);
+    if(m_state == CLOSED)
+    {
+        return true;
+    }
+    if(m_state == OPEN)
+    {
+        if(nowMs() < m_openUntil)
+        {
+            ++m_rejected;
+            return false;
+        }
+        LOG_INFO("Circuit breaker %s half-open, probing", m_name.c_str());
+        m_state = HALF_OPEN;
+        m_halfOpens++;
+        m_probing = 0;
+        m_probeOk = 0;
+    }
+    if(m_probing >= m_config.probes)
+    {
+        ++m_rejected;
+        return false;
+    }
+    m_probing++;
+    probe = m_halfOpens;
+    return true;
+}
+
+void circuit_breaker::record(bool ok, long long latencyMs, unsigned long long probe)
+{
+    bool bad = !ok || latencyMs >= m_config.slowMs;
+    long long now = nowMs();
+    lock_guard<mutex> locker(m_mutex);
+    if(probe)
+    {
+        if(m_state != HALF_OPEN || probe != m_halfOpens)     // 之前的半开周期放行的试探
+        {
+            return;
+        }
+        m_probing--;
+        if(bad)
+        {
+            trip(now);
+        }
+        else if(++m_probeOk >= m_config.probes)
+        {
+            LOG_INFO("Circuit breaker %s closed after %d good probes", m_name.c_str(), m_probeOk);
+            m_state = CLOSED;
+            resetWindow();
+            ++m_recoveries;
+        }
+        return;
+    }
+    if(m_state != CLOSED)
+    {
+        return;
+    }
+    long long second = now / BUCKET_MS;
+    bucket &b = m_window[second % m_buckets];
+    if(b.second != second)
+    {
+        b.second = second;
+        b.calls = 0;
+        b.bad = 0;
+    }
+    b.calls++;
+    if(!bad || m_config.failureRate <= 0)
+    {
+        b.bad += bad;
+        return;
+    }
+    b.bad++;
+    unsigned int calls, badCalls;
+    count(calls, badCalls, now);
+    if(calls >= static_cast<unsigned int>(m_config.minCalls) && badCalls >= m_config.failureRate * calls)
+    {
+        trip(now);
+    }
+}
+
+void circuit_breaker::release(unsigned long long probe)
+{
+    lock_guard<mutex> locker(m_mutex);
+    if(probe && m_state == HALF_OPEN && probe == m_halfOpens)
+    {
+        m_probing--;
+    }
+}
+
+circuit_breaker::STATE circuit_breaker::state()
+{
+    lock_guard<mutex> locker(m_mutex);
+    return m_state;
+}
+
+breaker_stats circuit_breaker::getStats()
+{
+    breaker_stats stats;
+    {
+        lock_guard<mutex> locker(m_mutex);
+        stats.state = stateName(m_state);
+        unsigned int bad;
+        count(stats.calls, bad, nowMs());
+        stats.badRate = stats.calls ? double(bad) / stats.calls : 0;
+    }
+    stats.trips = m_trips;
+    stats.recoveries = m_recoveries;
+    stats.rejected = m_rejected;
+    return stats;
+}
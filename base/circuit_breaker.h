@@ -0,0 +1,93 @@
+/* 熔断器：依赖（数据库）出故障时快速失败，不让每个请求都等到超时
+
+    关闭（CLOSED）时放行所有调用，按秒分桶统计最近 windowMs 内的调用：失败或耗时超过 slowMs 的算坏调用，
+    调用数不少于 minCalls 且坏调用比例达到 failureRate 时打开（OPEN）。
+    打开期间 allow 直接返回 false，openMs 之后进入半开（HALF_OPEN）：最多同时放行 probes 个试探调用，
+    都成功就关闭并清空窗口，有一个失败就重新打开。
+    - 每次 allow 返回 true 之后必须调用一次 record，probe 原样传回；调用被取消、没有结果时改调 release，
+      只归还试探名额；关闭期间放行、半开之后才完成的调用不计入
+    - probe 是试探所属半开周期的编号（不是试探时为 0）：上一个半开周期放行、重新打开后才完成的试探，
+      既不占用也不计入新周期的名额
+    - failureRate <= 0 时不熔断，只统计
+*/
+
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+
+struct breaker_config
+{
+    double failureRate = 0.5;
+    int slowMs = 500;
+    int openMs = 5000;
+    int windowMs = 10000;
+    int minCalls = 20;
+    int probes = 3;
+};
+
+struct breaker_stats
+{
+    const char *state;
+    unsigned int calls;             // 窗口内的调用数
+    double badRate;                 // 窗口内的坏调用比例
+    unsigned long long trips;       // 打开的次数
+    unsigned long long recoveries;  // 从半开恢复为关闭的次数
+    unsigned long long rejected;    // 快速失败的调用数
+};
+
+class circuit_breaker
+{
+public:
+    enum STATE { CLOSED, OPEN, HALF_OPEN };
+
+    explicit circuit_breaker(const std::string &name, const breaker_config &config = breaker_config());
+
+    bool allow(unsigned long long &probe);
+    void record(bool ok, long long latencyMs, unsigned long long probe);
+    void release(unsigned long long probe);
+
+    STATE state();
+    breaker_stats getStats();
+    static const char *stateName(STATE state);
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    static const int BUCKET_MS = 1000;
+    static const int MAX_BUCKETS = 60;
+    struct bucket
+    {
+        long long second;           // 桶对应的 steady_clock 秒数，过期的桶按空桶算
+        unsigned int calls;
+        unsigned int bad;
+    };
+
+    long long nowMs() const;
+    void trip(long long now);
+    void resetWindow();
+    void count(unsigned int &calls, unsigned int &bad, long long now);
+
+private:
+    std::string m_name;
+    breaker_config m_config;
+    int m_buckets;
+
+    std::mutex m_mutex;             // 保护以下成员
+    STATE m_state;
+    long long m_openUntil;
+    unsigned long long m_halfOpens; // 进入半开的次数，当前半开周期的编号
+    int m_probing;                  // 本半开周期已放行、还没完成的试探调用数
+    int m_probeOk;
+    bucket m_window[MAX_BUCKETS];
+
+    std::atomic<unsigned long long> m_trips;
+    std::atomic<unsigned long long> m_recoveries;
+    std::atomic<unsigned long long> m_rejected;
+};
+
+#endif
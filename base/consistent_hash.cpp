@@ -0,0 +1,55 @@
+#include "consistent_hash.h"
+
+#include <algorithm>
+
+#include "../utils/Utils.h"
+
+using namespace std;
+
+consistent_hash::consistent_hash(int points): m_points(points > 0 ? points : 1)
+{
+}
+
+void consistent_hash::add(const string &node, int weight)
+{
+    int index = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(node);
+    int points = m_points * (weight > 0 ? weight : 1);
+    for(int i = 0; i < points; i++)
+    {
+        m_ring.emplace_back(Utils::hash64(node + "#" + to_string(i)), index);
+    }
+    sort(m_ring.begin(), m_ring.end());
+}
+
+int consistent_hash::locate(const string &key) const
+{
+    if(m_ring.empty())
+    {
+        return -1;
+    }
+    uint64_t h = Utils::hash64(key);
+    vector<pair<uint64_t, int>>::const_iterator it = lower_bound(m_ring.begin(), m_ring.end(), make_pair(h, -1));
+    return it == m_ring.end() ? m_ring.front().second : it->second;
+}
+
+/* 每个虚拟节点管它和前一个虚拟节点之间的弧，第一个的弧跨过 0 点 */
+double consistent_hash::share(int i) const
+{
+    if(m_ring.empty())
+    {
+        return 0;
+    }
+    double total = 0;
+    for(size_t j = 0; j < m_ring.size(); j++)
+    {
+        if(m_ring[j].second != i)
+        {
+            continue;
+        }
+        uint64_t prev = j == 0 ? m_ring.back().first : m_ring[j - 1].first;
+        uint64_t arc = m_ring[j].first - prev;      // 无符号减法自然回绕
+        total += m_ring.size() == 1 ? 18446744073709551616.0 : static_cast<double>(arc);
+    }
+    return total / 18446744073709551616.0;
+}
@@ -0,0 +1,40 @@
+/* 一致性哈希环：把字符串 key 映射到若干节点之一
+
+    每个节点按权重在环上放 points × weight 个虚拟节点（节点名加序号的哈希），key 顺时针找到的第一个虚拟节点
+    所属的节点就是它的归属。虚拟节点的位置只由节点名决定，与加入顺序、其他节点无关：
+    增加一个节点只把约 1/N 的 key 从各节点移到新节点，删掉一个节点只影响原来属于它的 key。
+    建好之后只读，可以在多个线程并发 locate；要改节点就建一个新的替换。
+*/
+
+#ifndef CONSISTENT_HASH_H
+#define CONSISTENT_HASH_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+
+class consistent_hash
+{
+public:
+    explicit consistent_hash(int points = 160);
+
+    void add(const std::string &node, int weight = 1);      // 不检查重名
+
+    /* key 所属节点的下标（add 的顺序），环为空时返回 -1 */
+    int locate(const std::string &key) const;
+
+    size_t size() const { return m_nodes.size(); }
+    const std::string &node(int i) const { return m_nodes[i]; }
+
+    /* 节点 i 分到的哈希空间比例，key 足够多时约等于分到的 key 的比例 */
+    double share(int i) const;
+
+private:
+    int m_points;
+    std::vector<std::string> m_nodes;
+    std::vector<std::pair<uint64_t, int>> m_ring;      // (位置, 节点下标)，按位置排序
+};
+
+#endif
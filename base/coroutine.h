@@ -0,0 +1,488 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+/* C++20 协程：让处理函数在等待数据库、文件、定时器时挂起，而不是占住线程池的线程
+
+    - Task<T>：惰性启动的协程，可以在另一个协程里 co_await，结束时对称转移回等待者
+    - spawn()：从普通函数里启动一个顶层 Task，同步跑完返回 true，否则挂起后由 done 通知
+    - 等待体：sleep() 定时器、readable()/writable() 描述符就绪、blocking() 把阻塞调用放到阻塞任务线程、readFile()、
+      switchTo() 把协程挪到某个执行通道的线程上接着跑
+    - cancelToken：spawn 时传入，沿 co_await 链传给每个子 Task；取消后正在等待的 co_await 抛出 co::cancelled
+    挂起的协程都由事件循环线程恢复（Executor::post），恢复之后的代码也在事件循环线程上运行。
+*/
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <mutex>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+namespace co
+{
+
+/* 协程的调度者，由事件循环实现；所有接口都可以在任意线程调用 */
+class Executor
+{
+public:
+    virtual ~Executor() {}
+
+    virtual void post(std::function<void()> cb) = 0;                           // 在事件循环线程执行
+    virtual void runAfter(int ms, std::function<void()> cb) = 0;               // ms 毫秒后在事件循环线程执行
+    virtual void watch(int fd, uint32_t events, std::function<void()> cb) = 0; // fd 就绪后在事件循环线程执行一次
+    virtual void unwatch(int fd) = 0;                                           // 撤销还没触发的 watch
+    /* 在名为 lane 的执行通道上执行，lane 为空时用默认的阻塞任务通道；通道排满时不执行，返回 false */
+    virtual bool offload(std::function<void()> fn, const char* lane = nullptr) = 0;
+
+    static Executor* instance() { return s_instance; }
+    static void setInstance(Executor* executor) { s_instance = executor; }
+
+private:
+    static inline Executor* s_instance = nullptr;
+};
+
+
+/* 取消后 co_await 抛出的异常，一般不需要捕获，由 spawn 吞掉 */
+struct cancelled: std::exception
+{
+    const char* what() const noexcept override { return "co::cancelled"; }
+};
+
+/* 执行通道排满、blocking() 没能提交时 co_await 抛出的异常 */
+struct rejected: std::exception
+{
+    const char* what() const noexcept override { return "co::rejected"; }
+};
+
+/* 取消标记：一个连接上的所有协程共用一个，连接关闭时 cancel()；任意线程可调用 */
+class cancelToken
+{
+public:
+    cancelToken(): m_cancelled(false), m_nextId(1) {}
+
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    /* 登记取消时执行的回调，返回的 id 交给 remove；已经取消时不登记，返回 0 */
+    uint64_t add(std::function<void()> cb) {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        if(m_cancelled) {
+            return 0;
+        }
+        m_hooks[m_nextId] = std::move(cb);
+        return m_nextId++;
+    }
+
+    void remove(uint64_t id) {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_hooks.erase(id);
+    }
+
+    void cancel() {
+        std::map<uint64_t, std::function<void()>> hooks;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            if(m_cancelled.exchange(true)) {
+                return;
+            }
+            hooks.swap(m_hooks);
+        }
+        for(auto& hook: hooks) {
+            hook.second();
+        }
+    }
+
+private:
+    std::atomic<bool> m_cancelled;
+    std::mutex m_mutex;
+    uint64_t m_nextId;
+    std::map<uint64_t, std::function<void()>> m_hooks;
+};
+
+/* 一次挂起只恢复一次：完成、超时、取消可能在不同线程同时发生，先到的负责把协程交回事件循环 */
+struct wakeup
+{
+    explicit wakeup(std::coroutine_handle<> h): handle(h), fired(false) {}
+
+    bool fire() {
+        if(fired.exchange(true)) {
+            return false;
+        }
+        std::coroutine_handle<> h = handle;
+        Executor::instance()->post([h] { h.resume(); });
+        return true;
+    }
+
+    std::coroutine_handle<> handle;
+    std::atomic<bool> fired;
+};
+
+/* 等待体的公共部分：挂起时登记取消回调，恢复时注销，已取消则抛出 cancelled
+    bind 返回 false 表示已经取消，await_suspend 应返回 false 不挂起；bind 之后登记的回调随时可能恢复协程，不能再访问等待体 */
+struct cancellable
+{
+    std::shared_ptr<cancelToken> token;
+    uint64_t hook = 0;
+
+    template<typename P>
+    bool bind(std::coroutine_handle<P> h, std::function<void()> onCancel) {
+        token = h.promise().token;
+        if(!token) {
+            return true;
+        }
+        if(onCancel) {
+            hook = token->add(std::move(onCancel));
+            return hook != 0;
+        }
+        return !token->isCancelled();
+    }
+
+    void check() {
+        if(token) {
+            if(hook) {
+                token->remove(hook);
+            }
+            if(token->isCancelled()) {
+                throw cancelled();
+            }
+        }
+    }
+};
+
+
+template<typename T = void>
+class Task;
+
+template<typename T>
+struct promiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+    std::shared_ptr<cancelToken> token;
+
+    struct finalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    finalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<typename T>
+struct taskPromise: promiseBase<T>
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T result() {
+        if(this->error) {
+            std::rethrow_exception(this->error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct taskPromise<void>: promiseBase<void>
+{
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if(this->error) {
+            std::rethrow_exception(this->error);
+        }
+    }
+};
+
+template<typename T>
+class Task
+{
+public:
+    typedef taskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle;
+
+    explicit Task(handle h): m_handle(h) {}
+    Task(Task&& rhs) noexcept: m_handle(std::exchange(rhs.m_handle, nullptr)) {}
+    Task& operator=(Task&& rhs) noexcept {
+        if(this != &rhs) {
+            if(m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(rhs.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if(m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    template<typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept {
+        promise_type& promise = m_handle.promise();
+        promise.continuation = caller;
+        if(!promise.token) {
+            promise.token = caller.promise().token;     // 子协程继承调用者的取消标记
+        }
+        return m_handle;        // 对称转移：直接开始执行被等待的协程
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+    void setToken(std::shared_ptr<cancelToken> token) { m_handle.promise().token = std::move(token); }
+
+private:
+    handle m_handle;
+};
+
+template<typename T>
+inline Task<T> taskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<taskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> taskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<taskPromise<void>>::from_promise(*this));
+}
+
+
+/* 顶层协程：创建即运行，结束后自行销毁 */
+struct detached
+{
+    struct promise_type
+    {
+        std::shared_ptr<cancelToken> token;     // 总是为空，取消标记直接设在被等待的 Task 上
+
+        detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+    };
+};
+
+/* phase: 0 启动中，1 spawn 已返回，2 协程已结束；两边用 exchange 决定由谁收尾 */
+inline detached runDetached(Task<void> task, std::shared_ptr<std::atomic<int>> phase, std::function<void()> done)
+{
+    try {
+        co_await task;
+    }
+    catch(...) {
+    }
+    if(phase->exchange(2) == 1) {
+        done();
+    }
+}
+
+/* 同步跑完（或在 spawn 返回前已经结束）返回 true，此时不会调用 done；否则结束时调用 done（被取消也一样） */
+inline bool spawn(Task<void> task, std::function<void()> done, std::shared_ptr<cancelToken> token = nullptr)
+{
+    task.setToken(std::move(token));
+    std::shared_ptr<std::atomic<int>> phase = std::make_shared<std::atomic<int>>(0);
+    runDetached(std::move(task), phase, std::move(done));
+    return phase->exchange(1) == 2;
+}
+
+
+struct sleepAwaiter: cancellable
+{
+    int ms;
+
+    explicit sleepAwaiter(int timeout): ms(timeout) {}
+
+    bool await_ready() const noexcept { return ms <= 0 || !Executor::instance(); }
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        std::shared_ptr<wakeup> w = std::make_shared<wakeup>(h);
+        int timeout = ms;
+        if(!bind(h, [w] { w->fire(); })) {
+            return false;
+        }
+        Executor::instance()->runAfter(timeout, [w] { w->fire(); });
+        return true;
+    }
+    void await_resume() { check(); }
+};
+
+inline sleepAwaiter sleep(int ms) { return sleepAwaiter(ms); }
+
+
+/* 等待任意描述符可读 / 可写（出错或对端关闭时也会恢复，由调用者读写时处理） */
+struct fdAwaiter: cancellable
+{
+    int fd;
+    uint32_t events;
+
+    fdAwaiter(int f, uint32_t e): fd(f), events(e) {}
+
+    bool await_ready() const noexcept { return !Executor::instance(); }
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        std::shared_ptr<wakeup> w = std::make_shared<wakeup>(h);
+        int f = fd;
+        uint32_t e = events;
+        bool ok = bind(h, [w, f] {
+            if(!w->fired) {
+                Executor::instance()->unwatch(f);       // 先撤销再恢复，fd 关闭后不会误触发
+            }
+            w->fire();
+        });
+        if(!ok) {
+            return false;
+        }
+        Executor::instance()->watch(f, e, [w] { w->fire(); });
+        return true;
+    }
+    void await_resume() { check(); }
+};
+
+inline fdAwaiter readable(int fd) { return fdAwaiter(fd, EPOLLIN); }
+inline fdAwaiter writable(int fd) { return fdAwaiter(fd, EPOLLOUT); }
+
+
+/* 在阻塞任务线程上执行 fn（数据库查询、磁盘读写等），结果交回事件循环线程；没有 Executor 时就地执行
+    lane 指定执行通道（默认的是磁盘操作那个），通道排满时不挂起，co_await 抛出 co::rejected。
+    fn 按引用捕获协程里的局部变量即可，等待期间协程帧一直有效。
+    注意：co_await 操作数里按值捕获 std::string 等对象的 lambda 在 GCC 12 上会被错误编译，不要这样写。
+*/
+template<typename F>
+struct blockingAwaiter: cancellable
+{
+    typedef std::invoke_result_t<F&> R;
+    typedef std::conditional_t<std::is_void_v<R>, bool, R> Value;
+
+    F fn;
+    const char* lane;
+    std::optional<Value> value;
+    std::exception_ptr error;
+
+    blockingAwaiter(F f, const char* l): fn(std::move(f)), lane(l) {}
+
+    bool await_ready() const noexcept { return !Executor::instance(); }
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        if(!bind(h, nullptr)) {     // fn 可能引用协程帧，执行中途不能提前恢复，结束后再检查取消
+            return false;
+        }
+        Executor* executor = Executor::instance();
+        bool accepted = executor->offload([this, h, executor] {
+            if(!token || !token->isCancelled()) {
+                run();
+            }
+            executor->post([h] { h.resume(); });
+        }, lane);
+        if(!accepted) {
+            error = std::make_exception_ptr(rejected());
+        }
+        return accepted;
+    }
+    R await_resume() {
+        check();
+        if(!value && !error) {
+            run();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        if constexpr(!std::is_void_v<R>) {
+            return std::move(*value);
+        }
+    }
+
+private:
+    void run() {
+        try {
+            if constexpr(std::is_void_v<R>) {
+                fn();
+                value.emplace(true);
+            }
+            else {
+                value.emplace(fn());
+            }
+        }
+        catch(...) {
+            error = std::current_exception();
+        }
+    }
+};
+
+template<typename F>
+blockingAwaiter<std::decay_t<F>> blocking(F&& fn, const char* lane = nullptr) {
+    return blockingAwaiter<std::decay_t<F>>(std::forward<F>(fn), lane);
+}
+
+
+/* 在通道 lane 的线程上恢复协程，之后的代码都在那里跑，直到下一次挂起；lane 为空时回到事件循环线程。
+    通道排满时不挂起，co_await 返回 false；没有 Executor 时就地继续，返回 true */
+struct switchAwaiter: cancellable
+{
+    const char* lane;
+    bool accepted = true;
+
+    explicit switchAwaiter(const char* l): lane(l) {}
+
+    bool await_ready() const noexcept { return !Executor::instance(); }
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        if(!bind(h, nullptr)) {
+            return false;
+        }
+        Executor* executor = Executor::instance();
+        if(!lane) {
+            executor->post([h] { h.resume(); });
+            return true;
+        }
+        if(!executor->offload([h] { h.resume(); }, lane)) {
+            accepted = false;       // 提交成功后协程可能已经在别的线程跑了，不能再写等待体
+            return false;
+        }
+        return true;
+    }
+    bool await_resume() {
+        check();
+        return accepted;
+    }
+};
+
+inline switchAwaiter switchTo(const char* lane) { return switchAwaiter(lane); }
+
+/* 读整个文件，失败时返回 false；path、out 需在 co_await 结束前有效 */
+inline auto readFile(const std::string& path, std::string& out)
+{
+    return blocking([&path, &out] {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+        out.clear();
+        char buf[65536];
+        ssize_t n;
+        while((n = read(fd, buf, sizeof(buf))) > 0) {
+            out.append(buf, n);
+        }
+        close(fd);
+        return n == 0;
+    });
+}
+
+}
+
+#endif
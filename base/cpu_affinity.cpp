@@ -0,0 +1,230 @@
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sched.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+
+#include "log.h"
+
+using namespace std;
+
+bool cpu_affinity::parseList(const string &spec, vector<int> &cpus)
+{
+    cpus.clear();
+    size_t pos = 0;
+    while(pos < spec.size())
+    {
+        size_t comma = spec.find(',', pos);
+        string item = spec.substr(pos, comma == string::npos ? string::npos : comma - pos);
+        pos = comma == string::npos ? spec.size() : comma + 1;
+
+        char *end;
+        const char *p = item.c_str();
+        if(!isdigit(static_cast<unsigned char>(*p)))
+        {
+            return false;
+        }
+        long first = strtol(p, &end, 10), last = first;
+        if(*end == '-')
+        {
+            p = end + 1;
+            if(!isdigit(static_cast<unsigned char>(*p)))
+            {
+                return false;
+            }
+            last = strtol(p, &end, 10);
+        }
+        if(*end != '\0' || first > last || last >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        for(long cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !spec.empty() && spec.back() != ',';
+}
+
+bool cpu_affinity::parse(const string &spec, vector<int> &cpus)
+{
+    cpus.clear();
+    if(spec.empty())
+    {
+        return true;
+    }
+    const topology &t = topo();
+    if(spec.compare(0, 5, "node:") == 0)
+    {
+        char *end;
+        long node = strtol(spec.c_str() + 5, &end, 10);
+        if(spec.size() == 5 || *end != '\0' || node < 0 || node >= t.nodes)
+        {
+            LOG_ERROR("CPU affinity %s: no such node (%d nodes)", spec.c_str(), t.nodes);
+            return false;
+        }
+        for(int cpu: t.allowed)
+        {
+            if(nodeOf(cpu) == node)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if(cpus.empty())
+        {
+            LOG_ERROR("CPU affinity %s: no usable cpu on the node", spec.c_str());
+            return false;
+        }
+        return true;
+    }
+    if(!parseList(spec, cpus))
+    {
+        LOG_ERROR("CPU affinity %s: invalid cpu list", spec.c_str());
+        return false;
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    for(int cpu: cpus)
+    {
+        if(!binary_search(t.allowed.begin(), t.allowed.end(), cpu))
+        {
+            LOG_ERROR("CPU affinity %s: cpu %d is not available (allowed %s)", spec.c_str(), cpu,
+                formatList(t.allowed).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cpu_affinity::pin(const vector<int> &cpus)
+{
+    if(cpus.empty())
+    {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu: cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err != 0)
+    {
+        LOG_ERROR("Pin thread to %s: %s", formatList(cpus).c_str(), strerror(err));
+        return false;
+    }
+    return true;
+}
+
+vector<int> cpu_affinity::current()
+{
+    vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if(CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+int cpu_affinity::nodeOf(int cpu)
+{
+    const topology &t = topo();
+    return cpu >= 0 && cpu < static_cast<int>(t.nodeOfCpu.size()) ? t.nodeOfCpu[cpu] : 0;
+}
+
+int cpu_affinity::nodeCount()
+{
+    return topo().nodes;
+}
+
+string cpu_affinity::formatList(const vector<int> &cpus)
+{
+    string out;
+    for(size_t i = 0; i < cpus.size(); )
+    {
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+        {
+            j++;
+        }
+        out += (out.empty() ? "" : ",") + to_string(cpus[i]);
+        if(j > i)
+        {
+            out += "-" + to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return out;
+}
+
+string cpu_affinity::describe(const vector<int> &cpus)
+{
+    if(cpus.empty())
+    {
+        return "unpinned";
+    }
+    vector<int> nodes;
+    for(int cpu: cpus)
+    {
+        nodes.push_back(nodeOf(cpu));
+    }
+    sort(nodes.begin(), nodes.end());
+    nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+    return (cpus.size() == 1 ? "cpu " : "cpus ") + formatList(cpus) + (nodes.size() == 1 ? " (node " : " (nodes ")
+        + formatList(nodes) + ")";
+}
+
+/* 第一次用到时读一次；允许的 CPU 取的是那时调用线程的，init 里绑线程之前就会读到 */
+const cpu_affinity::topology &cpu_affinity::topo()
+{
+    static const topology t = [] {
+        topology t;
+        t.nodes = 0;
+        if(DIR *dir = opendir("/sys/devices/system/node"))
+        {
+            while(dirent *entry = readdir(dir))
+            {
+                char *end;
+                if(strncmp(entry->d_name, "node", 4) != 0 || !isdigit(static_cast<unsigned char>(entry->d_name[4])))
+                {
+                    continue;
+                }
+                long node = strtol(entry->d_name + 4, &end, 10);
+                ifstream in(string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+                string line;
+                vector<int> cpus;
+                if(*end != '\0' || !getline(in, line) || !parseList(line, cpus))
+                {
+                    continue;
+                }
+                for(int cpu: cpus)
+                {
+                    if(cpu >= static_cast<int>(t.nodeOfCpu.size()))
+                    {
+                        t.nodeOfCpu.resize(cpu + 1, 0);
+                    }
+                    t.nodeOfCpu[cpu] = static_cast<int>(node);
+                }
+                t.nodes = max(t.nodes, static_cast<int>(node) + 1);
+            }
+            closedir(dir);
+        }
+        t.nodes = max(t.nodes, 1);
+        t.allowed = current();
+        return t;
+    }();
+    return t;
+}
@@ -0,0 +1,45 @@
+/* CPU 亲和性：把事件循环、工作线程绑到指定的 CPU 上，按 NUMA 节点说明绑定的结果
+
+    CPU 列表的写法同 taskset -c："0-3,8,10-11"；"node:1" 表示节点 1 上的所有 CPU；空串表示不绑定。
+    NUMA 拓扑读 /sys/devices/system/node/node<N>/cpulist，没有这些文件时当作只有节点 0。
+    - 只能绑到进程当前允许的 CPU 上（启动时 sched_getaffinity 的结果，比如被 taskset、cgroup 限制过）
+    - Linux 默认的内存策略是首次访问的线程在哪个节点就在哪个节点分配，所以线程要先绑好再分配、初始化自己的内存
+*/
+
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+
+class cpu_affinity
+{
+public:
+    /* 只检查语法，"node:N" 不展开 */
+    static bool parseList(const std::string &spec, std::vector<int> &cpus);
+    /* 解析并检查每个 CPU 都允许使用，结果排好序、去重；出错写日志返回 false */
+    static bool parse(const std::string &spec, std::vector<int> &cpus);
+
+    /* 把调用线程绑到 cpus 上，cpus 为空时什么都不做 */
+    static bool pin(const std::vector<int> &cpus);
+    /* 调用线程当前可以跑的 CPU */
+    static std::vector<int> current();
+
+    static int nodeOf(int cpu);         // 不知道时返回 0
+    static int nodeCount();
+    /* "cpus 0-3 (node 0)"，空的是 "unpinned" */
+    static std::string describe(const std::vector<int> &cpus);
+    static std::string formatList(const std::vector<int> &cpus);
+
+private:
+    struct topology
+    {
+        std::vector<int> nodeOfCpu;     // 下标是 CPU 编号
+        int nodes;
+        std::vector<int> allowed;       // 进程启动时允许的 CPU
+    };
+    static const topology &topo();
+};
+
+#endif
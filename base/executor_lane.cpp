@@ -0,0 +1,139 @@
+#include "executor_lane.h"
+
+#include <chrono>
+#include <thread>
+
+#include "log.h"
+
+using namespace std;
+
+executor_lane::executor_lane(const string &name, size_t minThreads, size_t maxThreads, size_t maxQueue,
+    function<void(size_t)> onStart):
+    m_name(name), m_maxQueue(maxQueue), m_queued(0), m_started(0), m_waitUs(0), m_busyUs(0), m_maxWaitUs(0),
+    m_rejected(0), m_idleRounds(0), m_resizes(0), m_utilization(0), m_blocked(0),
+    m_pool(minThreads, maxThreads, std::move(onStart))
+{
+    m_cpus = thread::hardware_concurrency();
+    m_cpus = m_cpus > 0 ? m_cpus : 1;
+    m_lastStats = m_lastAdapt = snapshot();
+}
+
+int64_t executor_lane::nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool executor_lane::submit(function<void()> fn)
+{
+    unsigned long long queued = m_queued.fetch_add(1, memory_order_relaxed);
+    if(m_maxQueue > 0 && queued - m_started.load(memory_order_relaxed) >= m_maxQueue)
+    {
+        m_queued.fetch_sub(1, memory_order_relaxed);
+        m_rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    m_pool.AddTask([this, at = nowUs(), fn = std::move(fn)] {
+        int64_t start = started(at);
+        fn();
+        finished(start);
+    });
+    return true;
+}
+
+int64_t executor_lane::started(int64_t queuedUs)
+{
+    int64_t now = nowUs();
+    long long wait = now - queuedUs;
+    m_started.fetch_add(1, memory_order_relaxed);
+    m_waitUs.fetch_add(wait, memory_order_relaxed);
+    long long max = m_maxWaitUs.load(memory_order_relaxed);
+    while(wait > max && !m_maxWaitUs.compare_exchange_weak(max, wait, memory_order_relaxed))
+    {
+    }
+    return now;
+}
+
+size_t executor_lane::depth() const
+{
+    unsigned long long started = m_started.load(memory_order_relaxed);
+    unsigned long long queued = m_queued.load(memory_order_relaxed);
+    return queued > started ? queued - started : 0;
+}
+
+executor_lane::sample executor_lane::snapshot()
+{
+    sample s;
+    s.atUs = nowUs();
+    s.started = m_started.load(memory_order_relaxed);
+    s.waitUs = m_waitUs.load(memory_order_relaxed);
+    s.busyUs = m_busyUs.load(memory_order_relaxed);
+    s.cpuUs = m_pool.cpuTimeUs();
+    return s;
+}
+
+/* 还在排队的任务没算进平均排队时间，一个周期里一个都没开始却有排队的也算超时 */
+bool executor_lane::adapt(int targetWaitMs)
+{
+    sample now = snapshot();
+    const sample &last = m_lastAdapt;
+    size_t threads = m_pool.threadCount();
+    double elapsedUs = static_cast<double>(now.atUs - last.atUs);
+    unsigned long long tasks = now.started - last.started;
+    unsigned long long busyUs = now.busyUs - last.busyUs;
+    double avgWaitMs = tasks ? (now.waitUs - last.waitUs) / 1000.0 / tasks : 0;
+    bool delayed = avgWaitMs > targetWaitMs || (tasks == 0 && depth() > 0);
+    m_utilization = elapsedUs > 0 ? busyUs / (elapsedUs * threads) : 0;
+    m_utilization = m_utilization < 1 ? m_utilization : 1;
+    m_blocked = busyUs > 0 ? 1 - static_cast<double>(now.cpuUs - last.cpuUs) / busyUs : 0;
+    m_blocked = m_blocked > 0 ? m_blocked : 0;
+    m_lastAdapt = now;
+
+    size_t target = threads;
+    if(delayed && m_utilization > GROW_UTIL && (threads < m_cpus || m_blocked > BLOCKED_SHARE))
+    {
+        target = threads + (threads + 1) / 2;
+        m_idleRounds = 0;
+    }
+    else if(!delayed && m_utilization < SHRINK_UTIL)
+    {
+        if(++m_idleRounds >= SHRINK_ROUNDS)
+        {
+            target = threads - 1;
+            m_idleRounds = 0;
+        }
+    }
+    else
+    {
+        m_idleRounds = 0;
+    }
+    if(target == threads || m_pool.resize(target) == threads)
+    {
+        return false;
+    }
+    m_resizes++;
+    LOG_INFO("Lane %s: %zu -> %zu threads (wait %.2fms, utilization %.0f%%, blocked %.0f%%)", m_name.c_str(),
+        threads, m_pool.threadCount(), avgWaitMs, m_utilization * 100, m_blocked * 100);
+    return true;
+}
+
+lane_stats executor_lane::takeStats()
+{
+    sample now = snapshot();
+    lane_stats s;
+    s.name = m_name;
+    s.threads = m_pool.threadCount();
+    s.minThreads = m_pool.minThreads();
+    s.maxThreads = m_pool.maxThreads();
+    s.maxQueue = m_maxQueue;
+    s.depth = depth();
+    s.started = now.started;
+    s.rejected = m_rejected.load(memory_order_relaxed);
+    s.resizes = m_resizes;
+    unsigned long long count = now.started - m_lastStats.started;
+    s.avgWaitMs = count ? (now.waitUs - m_lastStats.waitUs) / 1000.0 / count : 0;
+    s.maxWaitMs = m_maxWaitUs.exchange(0, memory_order_relaxed) / 1000.0;
+    s.utilization = m_utilization;
+    s.blocked = m_blocked;
+    m_lastStats = now;
+    return s;
+}
@@ -0,0 +1,114 @@
+/* 执行通道：有名字、自己的线程数和排队上限的线程池，慢的阻塞调用不和别的任务排在同一个队列里
+
+    服务器的通道：
+    - io/static：事件循环派发的读写事件、解析请求、静态文件和普通路由；不限长度（丢掉就绪事件连接就卡住了）
+    - blocking/file：协程 blocking()、readFile() 和会话快照等磁盘操作，没指定通道的 offload 也在这里
+    - blocking/db：过滤器重建、分片表重载等访问数据库的后台任务，以及注册到这个通道的路由
+    每个通道统计排队数（已提交还没开始的）和排队等待时间（提交到开始执行），按间隔写进日志。
+
+    线程数按排队时间自动调整（adapt，定期调用），在 [minThreads, maxThreads] 之间：
+    - 一个周期内平均排队时间超过目标、线程忙的时间占比（利用率）超过 GROW_UTIL，并且线程还没 CPU 多，
+      或者任务执行的时间里一大半没在用 CPU（阻塞在数据库、磁盘上）时扩容一半
+    - 连续 SHRINK_ROUNDS 个周期利用率低于 SHRINK_UTIL、也不排队时减一个线程
+    线程数没超过 CPU 数时，多加线程只是抢 CPU，这时只有阻塞的任务才值得加线程。
+*/
+
+#ifndef EXECUTOR_LANE_H
+#define EXECUTOR_LANE_H
+
+#include <string>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+#include "thread_pool.h"
+
+#define LANE_IO "io/static"
+#define LANE_FILE "blocking/file"
+#define LANE_DB "blocking/db"
+
+
+struct lane_stats
+{
+    std::string name;
+    size_t threads = 0;                     // 在用的线程数
+    size_t minThreads = 0;
+    size_t maxThreads = 0;
+    size_t maxQueue = 0;                    // 0 表示不限
+    size_t depth = 0;                       // 排队中
+    unsigned long long started = 0;         // 开始执行的任务数，累计
+    unsigned long long rejected = 0;        // 队列满被拒绝的，累计
+    unsigned long long resizes = 0;         // 自动调整线程数的次数，累计
+    double avgWaitMs = 0;                   // 上次取统计以来的平均、最大排队时间
+    double maxWaitMs = 0;
+    double utilization = 0;                 // 最近一个调整周期：线程忙的时间占比
+    double blocked = 0;                     // 最近一个调整周期：任务执行时间里没在用 CPU 的比例
+};
+
+class executor_lane
+{
+public:
+    executor_lane(const std::string &name, size_t minThreads, size_t maxThreads, size_t maxQueue,
+        std::function<void(size_t)> onStart = nullptr);
+
+    /* 排队数到 maxQueue 时拒绝，返回 false */
+    bool submit(std::function<void()> fn);
+
+    /* 直接往 pool() 提交的任务（事件循环批量派发的读写）由调用者记账：
+        提交时 queued(n)，任务开始时 start = started(提交时的 nowUs())，结束时 finished(start) */
+    void queued(size_t n) { m_queued.fetch_add(n, std::memory_order_relaxed); }
+    int64_t started(int64_t queuedUs);
+    void finished(int64_t startUs) { m_busyUs.fetch_add(nowUs() - startUs, std::memory_order_relaxed); }
+    static int64_t nowUs();
+
+    /* 按上次调用以来的排队时间、利用率调整线程数，调整了返回 true；与 takeStats 在同一个线程定期调用 */
+    bool adapt(int targetWaitMs);
+
+    ThreadPool &pool() { return m_pool; }
+    const std::string &name() const { return m_name; }
+    size_t depth() const;
+
+    /* 平均、最大排队时间从这次开始重新算；同一时间只能有一个线程调用 */
+    lane_stats takeStats();
+
+private:
+    static constexpr double GROW_UTIL = 0.75;
+    static constexpr double SHRINK_UTIL = 0.25;
+    static constexpr double BLOCKED_SHARE = 0.5;
+    static const int SHRINK_ROUNDS = 3;
+
+    /* 累计计数在某一时刻的值，两次相减得到一段时间里的 */
+    struct sample
+    {
+        int64_t atUs = 0;
+        unsigned long long started = 0;
+        unsigned long long waitUs = 0;
+        unsigned long long busyUs = 0;
+        int64_t cpuUs = 0;
+    };
+    sample snapshot();
+
+    std::string m_name;
+    size_t m_maxQueue;
+    size_t m_cpus;
+
+    /* 工作线程每个任务都要改，和上面只读的字段分开 */
+    alignas(64) std::atomic<unsigned long long> m_queued;
+    std::atomic<unsigned long long> m_started;
+    std::atomic<unsigned long long> m_waitUs;
+    std::atomic<unsigned long long> m_busyUs;
+    std::atomic<long long> m_maxWaitUs;
+    std::atomic<unsigned long long> m_rejected;
+
+    /* 只在调用 adapt、takeStats 的线程上用 */
+    alignas(64) sample m_lastStats;
+    sample m_lastAdapt;
+    int m_idleRounds;
+    unsigned long long m_resizes;
+    double m_utilization;
+    double m_blocked;
+
+    ThreadPool m_pool;      // 最后一个成员，最先析构：做完排着的任务时计数器还在
+};
+
+#endif
@@ -0,0 +1,196 @@
+/* 分片 LRU 缓存：字符串键，带过期时间和容量上限
+
+    按键的哈希分成若干片，每片一把锁、一条 LRU 链表和一个索引，不同键的读写很少争同一把锁。
+    - 容量平均分到各片，片满时淘汰该片最久未用的项
+    - 过期的项在被访问到时删除，算作一次未命中
+    - 命中、未命中、过期、淘汰计数在片内加锁累加，getStats() 时汇总
+*/
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <assert.h>
+
+
+struct lru_stats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;        // 含过期
+    uint64_t expired = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+
+    double hitRatio() const { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+};
+
+
+template <class V>
+class lru_cache
+{
+public:
+    typedef lru_stats stats;
+
+    /* capacity 为 0 时不缓存任何东西 */
+    explicit lru_cache(size_t capacity = 0, int ttlMs = 60000, int shardNum = 16);
+
+    /* 重新设置容量和过期时间并清空，需在使用前调用 */
+    void reset(size_t capacity, int ttlMs);
+
+    bool get(const std::string &key, V &value);
+    void put(const std::string &key, const V &value);
+    void erase(const std::string &key);
+    void clear();
+
+    stats getStats();
+    size_t capacity() const { return m_shardCapacity * m_shardNum; }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct entry
+    {
+        std::string key;
+        V value;
+        clock::time_point expire;
+    };
+
+    /* 索引的键指向链表节点里的 key，节点地址不变，查找时不用构造 string */
+    struct shard
+    {
+        std::mutex mtx;
+        std::list<entry> items;         // 表头最近使用
+        std::unordered_map<std::string_view, typename std::list<entry>::iterator> index;
+        stats counters;
+    };
+
+    shard &shardOf(const std::string &key) { return m_shards[std::hash<std::string>()(key) % m_shardNum]; }
+
+private:
+    int m_shardNum;
+    size_t m_shardCapacity;
+    clock::duration m_ttl;
+    std::unique_ptr<shard[]> m_shards;
+};
+
+
+template <class V>
+lru_cache<V>::lru_cache(size_t capacity, int ttlMs, int shardNum)
+    : m_shardNum(shardNum), m_shards(new shard[shardNum])
+{
+    assert(shardNum > 0);
+    reset(capacity, ttlMs);
+}
+
+template <class V>
+void lru_cache<V>::reset(size_t capacity, int ttlMs)
+{
+    assert(ttlMs > 0);
+    m_shardCapacity = (capacity + m_shardNum - 1) / m_shardNum;
+    m_ttl = std::chrono::milliseconds(ttlMs);
+    clear();
+}
+
+template <class V>
+bool lru_cache<V>::get(const std::string &key, V &value)
+{
+    shard &s = shardOf(key);
+    std::lock_guard<std::mutex> locker(s.mtx);
+    auto it = s.index.find(key);
+    if(it == s.index.end())
+    {
+        s.counters.misses++;
+        return false;
+    }
+    if(it->second->expire <= clock::now())
+    {
+        s.items.erase(it->second);
+        s.index.erase(it);
+        s.counters.expired++;
+        s.counters.misses++;
+        return false;
+    }
+    s.items.splice(s.items.begin(), s.items, it->second);
+    value = it->second->value;
+    s.counters.hits++;
+    return true;
+}
+
+template <class V>
+void lru_cache<V>::put(const std::string &key, const V &value)
+{
+    if(m_shardCapacity == 0)
+    {
+        return;
+    }
+    shard &s = shardOf(key);
+    std::lock_guard<std::mutex> locker(s.mtx);
+    clock::time_point expire = clock::now() + m_ttl;
+    auto it = s.index.find(key);
+    if(it != s.index.end())
+    {
+        it->second->value = value;
+        it->second->expire = expire;
+        s.items.splice(s.items.begin(), s.items, it->second);
+        return;
+    }
+    if(s.items.size() >= m_shardCapacity)
+    {
+        s.index.erase(s.items.back().key);
+        s.items.pop_back();
+        s.counters.evictions++;
+    }
+    s.items.push_front(entry{key, value, expire});
+    s.index.emplace(s.items.front().key, s.items.begin());
+}
+
+template <class V>
+void lru_cache<V>::erase(const std::string &key)
+{
+    shard &s = shardOf(key);
+    std::lock_guard<std::mutex> locker(s.mtx);
+    auto it = s.index.find(key);
+    if(it != s.index.end())
+    {
+        s.items.erase(it->second);
+        s.index.erase(it);
+    }
+}
+
+template <class V>
+void lru_cache<V>::clear()
+{
+    for(int i = 0; i < m_shardNum; i++)
+    {
+        std::lock_guard<std::mutex> locker(m_shards[i].mtx);
+        m_shards[i].index.clear();
+        m_shards[i].items.clear();
+    }
+}
+
+template <class V>
+typename lru_cache<V>::stats lru_cache<V>::getStats()
+{
+    stats total;
+    for(int i = 0; i < m_shardNum; i++)
+    {
+        std::lock_guard<std::mutex> locker(m_shards[i].mtx);
+        const stats &c = m_shards[i].counters;
+        total.hits += c.hits;
+        total.misses += c.misses;
+        total.expired += c.expired;
+        total.evictions += c.evictions;
+        total.size += m_shards[i].items.size();
+    }
+    return total;
+}
+
+#endif
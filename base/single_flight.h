@@ -0,0 +1,167 @@
+/* 合并相同的并发调用（single flight）
+
+    同一个 key 同时只有一个调用在执行：第一个到达的协程执行 fn，之后到达的挂起等它的结果，拿到的是结果的拷贝。
+    执行完就把 key 移除，结果不缓存，下一次调用重新执行。只适合没有副作用的读操作。
+    - 领头的调用抛出异常时，等待者收到同一个异常；领头者被取消时，等待者重新竞争，由其中一个再执行
+    - 等待者自己被取消时立即恢复，抛出 co::cancelled，不影响其他等待者
+*/
+
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <functional>
+#include <atomic>
+#include <stdint.h>
+
+#include "coroutine.h"
+
+
+template <class T>
+class single_flight
+{
+public:
+    single_flight(): m_calls(0), m_shared(0) {}
+
+    co::Task<T> run(std::string key, std::function<co::Task<T>()> fn);
+
+    uint64_t calls() const { return m_calls; }
+    uint64_t shared() const { return m_shared; }      // 没有执行、直接用了别人结果的次数
+
+private:
+    struct call
+    {
+        bool done = false;
+        bool retry = false;         // 领头者被取消，没有结果
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::vector<std::shared_ptr<co::wakeup>> waiters;
+    };
+
+    struct awaiter;
+
+    void finish(const std::string &key, const std::shared_ptr<call> &c);
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<call>> m_inflight;
+    std::atomic<uint64_t> m_calls;
+    std::atomic<uint64_t> m_shared;
+};
+
+
+/* 领头者先完成时不挂起；否则登记到等待列表，由领头者或取消回调恢复，wakeup 保证只恢复一次
+    先 bind 再登记：登记之后协程随时可能被恢复，不能再写等待体 */
+template <class T>
+struct single_flight<T>::awaiter: co::cancellable
+{
+    single_flight *self;
+    std::shared_ptr<call> c;
+
+    awaiter(single_flight *s, std::shared_ptr<call> cl): self(s), c(std::move(cl)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        single_flight *s = self;
+        std::shared_ptr<call> cl = c;
+        std::shared_ptr<co::wakeup> waker = std::make_shared<co::wakeup>(h);
+        if(!bind(h, [waker] { waker->fire(); })) {
+            return false;
+        }
+        std::lock_guard<std::mutex> locker(s->m_mutex);
+        if(cl->done) {
+            return waker->fired.exchange(true);     // 取消回调已经投递了恢复就等它，否则不挂起
+        }
+        cl->waiters.push_back(waker);
+        return true;
+    }
+
+    void await_resume() { check(); }
+};
+
+
+template <class T>
+co::Task<T> single_flight<T>::run(std::string key, std::function<co::Task<T>()> fn)
+{
+    if(!co::Executor::instance())
+    {
+        co_return co_await fn();
+    }
+    while(true)
+    {
+        std::shared_ptr<call> c;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            std::shared_ptr<call> &slot = m_inflight[key];
+            if(!slot)
+            {
+                slot = std::make_shared<call>();
+                leader = true;
+            }
+            c = slot;
+        }
+        m_calls++;
+
+        if(leader)
+        {
+            try
+            {
+                c->value.emplace(co_await fn());
+            }
+            catch(const co::cancelled &)
+            {
+                c->retry = true;
+                c->error = std::current_exception();
+            }
+            catch(...)
+            {
+                c->error = std::current_exception();
+            }
+            finish(key, c);
+            if(c->error)
+            {
+                std::rethrow_exception(c->error);
+            }
+            co_return *c->value;
+        }
+
+        awaiter a(this, c);
+        co_await a;
+        if(c->retry)
+        {
+            continue;
+        }
+        m_shared++;
+        if(c->error)
+        {
+            std::rethrow_exception(c->error);
+        }
+        co_return *c->value;
+    }
+}
+
+template <class T>
+void single_flight<T>::finish(const std::string &key, const std::shared_ptr<call> &c)
+{
+    std::vector<std::shared_ptr<co::wakeup>> waiters;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        c->done = true;
+        m_inflight.erase(key);
+        waiters.swap(c->waiters);
+    }
+    for(auto &waker: waiters)
+    {
+        waker->fire();
+    }
+}
+
+#endif
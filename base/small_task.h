@@ -0,0 +1,181 @@
+/* 线程池的任务：只能移动的 void() 可调用对象，小的直接放在对象里，不分配内存
+
+    std::function 捕获超过两个指针就要到堆上分配，每派发一次读写事件就分配、释放一次。
+    - 不超过 INLINE_SIZE 字节、移动不抛异常的可调用对象放在内部缓冲区，否则放到堆上
+    - 可平凡复制的（比如成员函数调用）移动时直接拷贝缓冲区，析构什么都不做，不经过函数指针
+    - small_task(&C::fn, obj) 和 small_task(&C::fn, obj, arg) 直接存成员函数指针、对象和参数，
+      代替 std::bind(&C::fn, obj, arg)
+*/
+
+#ifndef SMALL_TASK_H
+#define SMALL_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+class small_task
+{
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    small_task() noexcept: m_ops(nullptr) {}
+
+    template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, small_task>
+        && std::is_invocable_v<std::decay_t<F> &>>>
+    small_task(F &&fn)
+    {
+        emplace<std::decay_t<F>>(std::forward<F>(fn));
+    }
+
+    template<class C, class R>
+    small_task(R (C::*fn)(), C *obj)
+    {
+        emplace<memberCall0<C, R>>(memberCall0<C, R> { fn, obj });
+    }
+
+    template<class C, class R, class P, class A>
+    small_task(R (C::*fn)(P), C *obj, A &&arg)
+    {
+        typedef memberCall1<C, R, P, std::decay_t<A>> call;
+        emplace<call>(call { fn, obj, std::forward<A>(arg) });
+    }
+
+    small_task(small_task &&other) noexcept: m_ops(other.m_ops)
+    {
+        relocateFrom(other);
+    }
+
+    small_task &operator=(small_task &&other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            m_ops = other.m_ops;
+            relocateFrom(other);
+        }
+        return *this;
+    }
+
+    small_task(const small_task &) = delete;
+    small_task &operator=(const small_task &) = delete;
+
+    ~small_task()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        m_ops->invoke(m_buf);
+    }
+
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    void reset() noexcept
+    {
+        if(m_ops && m_ops->destroy)
+        {
+            m_ops->destroy(m_buf);
+        }
+        m_ops = nullptr;
+    }
+
+    /* 可调用对象 F 是否放在内部缓冲区 */
+    template<class F>
+    static constexpr bool isInline()
+    {
+        return sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<F>;
+    }
+
+private:
+    /* relocate、destroy 为空表示可以直接拷贝缓冲区、不用析构 */
+    struct ops
+    {
+        void (*invoke)(void *);
+        void (*relocate)(void *dst, void *src);
+        void (*destroy)(void *);
+    };
+
+    template<class C, class R>
+    struct memberCall0
+    {
+        R (C::*fn)();
+        C *obj;
+        void operator()() { (obj->*fn)(); }
+    };
+
+    template<class C, class R, class P, class A>
+    struct memberCall1
+    {
+        R (C::*fn)(P);
+        C *obj;
+        A arg;
+        void operator()() { (obj->*fn)(arg); }
+    };
+
+    template<class F>
+    static void invokeInline(void *buf) { (*static_cast<F *>(buf))(); }
+    template<class F>
+    static void relocateInline(void *dst, void *src)
+    {
+        new (dst) F(std::move(*static_cast<F *>(src)));
+        static_cast<F *>(src)->~F();
+    }
+    template<class F>
+    static void destroyInline(void *buf) { static_cast<F *>(buf)->~F(); }
+
+    template<class F>
+    static void invokeHeap(void *buf) { (**static_cast<F **>(buf))(); }
+    template<class F>
+    static void destroyHeap(void *buf) { delete *static_cast<F **>(buf); }
+
+    template<class F>
+    static constexpr bool isTrivial()
+    {
+        return std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>;
+    }
+
+    template<class F>
+    static inline constexpr ops s_inlineOps = { &invokeInline<F>,
+        isTrivial<F>() ? nullptr : &relocateInline<F>, isTrivial<F>() ? nullptr : &destroyInline<F> };
+    template<class F>
+    static inline constexpr ops s_heapOps = { &invokeHeap<F>, nullptr, &destroyHeap<F> };   // 缓冲区里只有指针
+
+    template<class F, class T>
+    void emplace(T &&fn)
+    {
+        if constexpr(isInline<F>())
+        {
+            new (m_buf) F(std::forward<T>(fn));
+            m_ops = &s_inlineOps<F>;
+        }
+        else
+        {
+            *reinterpret_cast<F **>(m_buf) = new F(std::forward<T>(fn));
+            m_ops = &s_heapOps<F>;
+        }
+    }
+
+    void relocateFrom(small_task &other) noexcept
+    {
+        if(m_ops && m_ops->relocate)
+        {
+            m_ops->relocate(m_buf, other.m_buf);
+        }
+        else if(m_ops)
+        {
+            memcpy(m_buf, other.m_buf, INLINE_SIZE);
+        }
+        other.m_ops = nullptr;
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_buf[INLINE_SIZE];
+    const ops *m_ops;
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include "sql_async.h"
+
+#include <assert.h>
+
+#include "log.h"
+#include "executor_lane.h"
+
+using namespace std;
+
+struct sql_async::job
+{
+    enum STATE {
+        QUEUED,
+        RUNNING,
+        DONE,
+        ABANDONED,      // 超时或被取消，结果不再需要
+    };
+
+    string sql;
+    int stmt = -1;                          // >= 0 时执行 conn_pool 的预处理语句，sql 不用
+    bool readOnly = false;                  // 可以发到只读副本
+    conn_pool *pool = nullptr;              // 执行它的库，取连接前选定
+    vector<string> params;
+    result res;
+    atomic<int> state { QUEUED };
+    atomic<unsigned long> threadId { 0 };   // 执行它的连接，KILL QUERY 用
+    bool executing = false;                 // 受 m_killMutex 保护，连接执行完后就不能再 KILL，否则会误杀下一条查询
+    bool timedOut = false;                  // 由把状态改成 ABANDONED 的一方在恢复协程前写入
+    shared_ptr<co::wakeup> waker;
+};
+
+/* 挂起后的恢复有三个来源：数据库线程完成、超时定时器、取消回调，job->state 保证只有一个生效 */
+struct sql_async::awaiter: co::cancellable
+{
+    sql_async *self;
+    shared_ptr<job> j;
+    int timeoutMs;
+
+    awaiter(sql_async *s, shared_ptr<job> jb, int timeout): self(s), j(std::move(jb)), timeoutMs(timeout) {}
+
+    bool await_ready() const noexcept { return !co::Executor::instance(); }
+
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        sql_async *s = self;
+        shared_ptr<job> jb = j;
+        int timeout = timeoutMs;
+        jb->waker = make_shared<co::wakeup>(h);
+        if(!bind(h, [s, jb] { s->abandon(jb, false); })) {
+            return false;
+        }
+        co::Executor::instance()->runAfter(timeout, [s, jb] { s->abandon(jb, true); });
+        {
+            lock_guard<mutex> locker(s->m_mutex);
+            s->m_jobs.push_back(jb);
+        }
+        s->m_cond.notify_one();
+        return true;
+    }
+
+    result await_resume() {
+        check();
+        if(j->state == job::QUEUED)         // 没有事件循环，就地执行
+        {
+            j->pool = self->m_router->pick(j->readOnly);
+            MYSQL *conn = j->pool->GetConnection();
+            if(!conn)
+            {
+                self->m_router->report(j->pool, false);
+                j->res.error = "no connection";
+                return std::move(j->res);
+            }
+            self->perform(*j, conn);
+            j->pool->ReleaseConnection(conn);
+            return std::move(j->res);
+        }
+        if(j->state == job::DONE)
+        {
+            return std::move(j->res);
+        }
+        result res;
+        res.timedOut = j->timedOut;
+        res.error = j->timedOut ? "query timeout" : "query cancelled";
+        return res;
+    }
+};
+
+
+sql_async::sql_async(): m_router(nullptr), m_timeoutMs(3000), m_stop(false)
+{
+}
+
+sql_async::~sql_async()
+{
+    stop();
+}
+
+sql_async *sql_async::GetInstance()
+{
+    static sql_async instance;
+    return &instance;
+}
+
+void sql_async::init(sql_router *router, int threadNum, int timeoutMs)
+{
+    assert(router && threadNum > 0 && m_threads.empty());
+    m_router = router;
+    m_timeoutMs = timeoutMs > 0 ? timeoutMs : m_timeoutMs;
+    m_stop = false;
+    for(int i = 0; i < threadNum; i++)
+    {
+        m_threads.emplace_back(&sql_async::run, this);
+    }
+}
+
+void sql_async::stop()
+{
+    {
+        lock_guard<mutex> locker(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for(auto &t: m_threads)
+    {
+        t.join();
+    }
+    m_threads.clear();
+    lock_guard<mutex> locker(m_killMutex);
+    for(auto &item: m_killConns)
+    {
+        if(item.second)
+        {
+            mysql_close(item.second);
+        }
+    }
+    m_killConns.clear();
+}
+
+co::Task<sql_async::result> sql_async::query(string sql, int timeoutMs)
+{
+    shared_ptr<job> j = make_shared<job>();
+    j->sql = std::move(sql);
+    co_return co_await submit(std::move(j), timeoutMs);
+}
+
+co::Task<sql_async::result> sql_async::execute(conn_pool::STMT id, vector<string> params, int timeoutMs)
+{
+    shared_ptr<job> j = make_shared<job>();
+    j->stmt = id;
+    j->params = std::move(params);
+    co_return co_await submit(std::move(j), timeoutMs);
+}
+
+/* key 由语句 ID 和带长度前缀的各个参数组成，参数里有什么字符都不会混淆 */
+co::Task<sql_async::result> sql_async::lookup(conn_pool::STMT id, vector<string> params, int timeoutMs)
+{
+    string key = to_string(id);
+    for(auto &p: params)
+    {
+        key += ':' + to_string(p.size()) + ':' + p;
+    }
+    co_return co_await m_flights.run(std::move(key), [&] {
+        shared_ptr<job> j = make_shared<job>();
+        j->stmt = id;
+        j->params = params;
+        j->readOnly = true;
+        return submit(std::move(j), timeoutMs);
+    });
+}
+
+co::Task<sql_async::result> sql_async::submit(shared_ptr<job> j, int timeoutMs)
+{
+    awaiter a(this, j, timeoutMs > 0 ? timeoutMs : m_timeoutMs);
+    co_return co_await a;
+}
+
+string sql_async::escape(const string &value)
+{
+    string out;
+    out.reserve(value.size());
+    for(char c: value)
+    {
+        switch(c)
+        {
+        case '\0': out += "\\0"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\'': out += "\\'"; break;
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\032': out += "\\Z"; break;
+        default: out += c;
+        }
+    }
+    return out;
+}
+
+/* 数据库线程：排队中已被放弃的查询直接丢掉，不占用连接 */
+void sql_async::run()
+{
+    while(true)
+    {
+        shared_ptr<job> j;
+        {
+            unique_lock<mutex> locker(m_mutex);
+            m_cond.wait(locker, [this] { return m_stop || !m_jobs.empty(); });
+            if(m_jobs.empty())
+            {
+                return;
+            }
+            j = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        if(j->state != job::QUEUED)
+        {
+            continue;
+        }
+
+        j->pool = m_router->pick(j->readOnly);
+        MYSQL *conn = j->pool->GetConnection();
+        if(!conn && j->pool != m_router->primary())     // 副本取不到连接，改走主库
+        {
+            m_router->report(j->pool, false);
+            j->pool = m_router->primary();
+            conn = j->pool->GetConnection();
+        }
+        if(!conn)
+        {
+            j->res.error = "no connection";
+        }
+        else
+        {
+            j->threadId = mysql_thread_id(conn);
+        }
+        int expected = job::QUEUED;
+        if(!j->state.compare_exchange_strong(expected, job::RUNNING))
+        {
+            j->pool->ReleaseConnection(conn);
+            continue;
+        }
+        while(conn)
+        {
+            {
+                lock_guard<mutex> locker(m_killMutex);
+                j->executing = true;
+            }
+            perform(*j, conn);
+            {
+                lock_guard<mutex> locker(m_killMutex);
+                j->executing = false;
+            }
+            j->pool->ReleaseConnection(conn);
+            conn = nullptr;
+
+            /* 副本在执行中连不上或断线，只读查询在主库上再执行一次；pool 只在 executing 为 false 时改 */
+            if(j->readOnly && j->pool != m_router->primary() && sql_router::endpointError(j->res.errcode)
+                && j->state == job::RUNNING)
+            {
+                j->pool = m_router->primary();
+                if((conn = j->pool->GetConnection()))
+                {
+                    j->threadId = mysql_thread_id(conn);
+                    j->res = result();
+                }
+            }
+        }
+
+        expected = job::RUNNING;
+        if(j->state.compare_exchange_strong(expected, job::DONE))
+        {
+            j->waker->fire();
+        }
+    }
+}
+
+void sql_async::perform(job &j, MYSQL *conn)
+{
+    result &res = j.res;
+    if(j.stmt >= 0)
+    {
+        j.pool->ExecuteStmt(conn, static_cast<conn_pool::STMT>(j.stmt), j.params, res);
+        m_router->report(j.pool, !sql_router::endpointError(res.errcode));
+        return;
+    }
+    if(mysql_real_query(conn, j.sql.data(), j.sql.size()) != 0)
+    {
+        res.errcode = mysql_errno(conn);
+        res.error = mysql_error(conn);
+        LOG_ERROR("SQL error %u: %s", res.errcode, res.error.c_str());
+        m_router->report(j.pool, !sql_router::endpointError(res.errcode));
+        return;
+    }
+    m_router->report(j.pool, true);
+    res.ok = true;
+    MYSQL_RES *rows = mysql_store_result(conn);
+    if(!rows)
+    {
+        res.affected = mysql_affected_rows(conn);
+        return;
+    }
+    unsigned int fields = mysql_num_fields(rows);
+    while(MYSQL_ROW row = mysql_fetch_row(rows))
+    {
+        unsigned long *lengths = mysql_fetch_lengths(rows);
+        res.rows.emplace_back();
+        vector<string> &out = res.rows.back();
+        out.reserve(fields);
+        for(unsigned int i = 0; i < fields; i++)
+        {
+            out.emplace_back(row[i] ? string(row[i], lengths[i]) : string());
+        }
+    }
+    mysql_free_result(rows);
+}
+
+/* 超时或取消：抢到状态的一方恢复协程；查询已在执行时让服务端中止它，尽快把连接还回池里 */
+void sql_async::abandon(const shared_ptr<job> &j, bool timedOut)
+{
+    int state = j->state;
+    while(state == job::QUEUED || state == job::RUNNING)
+    {
+        if(j->state.compare_exchange_weak(state, job::ABANDONED))
+        {
+            j->timedOut = timedOut;
+            j->waker->fire();
+            if(state == job::RUNNING)
+            {
+                LOG_WARN("Kill query %lu: %s", j->threadId.load(), timedOut ? "timeout" : "cancelled");
+                shared_ptr<job> jb = j;
+                if(!co::Executor::instance()->offload([this, jb] { kill(*jb); }, LANE_DB))
+                {
+                    LOG_WARN("Kill query %lu: %s lane full, left running", j->threadId.load(), LANE_DB);
+                }
+            }
+            return;
+        }
+    }
+}
+
+void sql_async::kill(job &j)
+{
+    lock_guard<mutex> locker(m_killMutex);
+    if(!j.executing)
+    {
+        return;
+    }
+    MYSQL *&killConn = m_killConns[j.pool];     // KILL 要发到执行它的那个库
+    if(!killConn && !(killConn = j.pool->Connect()))
+    {
+        LOG_ERROR("Kill connection error");
+        return;
+    }
+    string order = "KILL QUERY " + to_string(j.threadId.load());
+    if(mysql_query(killConn, order.c_str()) != 0)
+    {
+        LOG_ERROR("%s: %s", order.c_str(), mysql_error(killConn));
+        mysql_close(killConn);          // 下次重连
+        killConn = nullptr;
+    }
+}
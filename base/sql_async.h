@@ -0,0 +1,78 @@
+#ifndef SQL_ASYNC_H
+#define SQL_ASYNC_H
+
+/* 异步查询：协程 co_await query()，不占用工作线程
+
+    MySQL 客户端库没有非阻塞接口，所以由几个专用的数据库线程从连接池取连接执行 SQL（lookup 经 sql_router 走只读副本，其余走主库），
+    完成后经 co::Executor::post（eventfd 唤醒事件循环）在事件循环线程恢复等待的协程。
+    - 超时：到时先把协程恢复（返回 timedOut），还在排队的查询不再执行，正在执行的用控制连接 KILL QUERY
+    - 取消：连接断开时协程的 cancelToken 被取消，处理同超时，co_await 抛出 co::cancelled
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <mysql/mysql.h>
+
+#include "coroutine.h"
+#include "single_flight.h"
+#include "sql_conn_pool.h"
+#include "sql_router.h"
+
+class sql_async
+{
+public:
+    typedef sql_result result;
+
+    static sql_async *GetInstance();
+
+    void init(sql_router *router, int threadNum, int timeoutMs);
+    void stop();
+
+    /* timeoutMs <= 0 时使用 init 的默认超时 */
+    co::Task<result> query(std::string sql, int timeoutMs = 0);
+    /* 执行连接池里缓存的预处理语句，参数二进制绑定，不用拼接和转义 */
+    co::Task<result> execute(conn_pool::STMT id, std::vector<std::string> params, int timeoutMs = 0);
+    /* 同 execute，但相同语句和参数的并发调用合并成一次执行，只用于只读语句，可能读到副本上稍旧的数据 */
+    co::Task<result> lookup(conn_pool::STMT id, std::vector<std::string> params, int timeoutMs = 0);
+
+    const single_flight<result> &flights() const { return m_flights; }
+
+    /* 转义后可以放进单引号里拼 SQL */
+    static std::string escape(const std::string &value);
+
+    sql_async();
+    ~sql_async();
+
+private:
+    struct job;
+    struct awaiter;
+
+    void run();
+    co::Task<result> submit(std::shared_ptr<job> j, int timeoutMs);
+    void perform(job &j, MYSQL *conn);
+    void abandon(const std::shared_ptr<job> &j, bool timedOut);
+    void kill(job &j);
+
+private:
+    sql_router *m_router;
+    int m_timeoutMs;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<job>> m_jobs;
+    bool m_stop;
+
+    std::mutex m_killMutex;
+    std::map<conn_pool *, MYSQL *> m_killConns;     // 每个库一个控制连接，只用来 KILL QUERY 超时或被取消的查询
+
+    single_flight<result> m_flights;
+};
+
+#endif
@@ -1,17 +1,71 @@
 #include<mysql/mysql.h>
+#include <mysql/errmsg.h>
 
 #include <iostream>
+#include <memory>
+#include <type_traits>
+#include <assert.h>
 
 
 
 #include "sql_conn_pool.h"
+#include "log.h"
 
 
 
-conn_pool::conn_pool()
+const char *conn_pool::STMT_SQL[STMT_NUM] = {
+    "SELECT username, passwd FROM user WHERE username = ? LIMIT 1",
+    "INSERT INTO user(username, passwd) VALUES(?, ?)",
+};
+
+/* MYSQL_BIND 里的布尔指针：MySQL 8 是 bool*，更早的版本和 MariaDB 是 my_bool* */
+typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type bindBool;
+
+static const unsigned long STMT_COLUMN_BUFFER = 256;      // 超过的列用 mysql_stmt_fetch_column 补取
+
+const int pool_stats::BUCKETS;
+const int pool_stats::BUCKET_MS[pool_stats::BUCKETS] = { 1, 5, 10, 50, 100, 500, 1000, 0 };
+
+static const int RETRY_MS = 1000;       // 建连失败后这段时间内不再当场建连，只等已有的连接
+
+const unsigned int conn_pool::MAX_LOCAL;
+thread_local conn_pool::threadLocal conn_pool::t_local;
+atomic<unsigned long> conn_pool::NextId(1);
+
+conn_pool::localSlot::localSlot(): touched(false), dead(false)
 {
+    for(unsigned int i = 0; i < MAX_LOCAL; i++)
+    {
+        conns[i] = nullptr;
+        caches[i] = nullptr;
+    }
+}
+
+/* 线程退出时槽里的连接留给维护线程收回 */
+conn_pool::threadLocal::~threadLocal()
+{
+    for(auto &item: slots)
+    {
+        item.second->dead = true;
+    }
+}
+
+conn_pool::conn_pool(): Id(NextId++)
+{
+    this->MaxConn = 0;
+    this->MinConn = 0;
+    this->TotalConn = 0;
     this->CurConn = 0;
     this->FreeConn = 0;
+    this->LocalConn = 0;
+    this->WaitMs = 1000;
+    this->IdleMs = 30 * 1000;
+    this->Port = 0;
+    this->stopping = false;
+    this->parked = 0;
+    this->waiting = 0;
+    this->localHits = 0;
+    this->outstanding = 0;
 }
 
 conn_pool::~conn_pool()
@@ -26,7 +80,9 @@ conn_pool *conn_pool::GetInstance()
 }
 
 
-void conn_pool::init(string ip,  string User, string PassWord, string DBName, int Port, unsigned int MaxConn)
+/* MinConn 为 0 时与 MaxConn 相同，即启动时建满 */
+void conn_pool::init(string ip,  string User, string PassWord, string DBName, int Port, unsigned int MaxConn,
+    unsigned int MinConn, int WaitMs, int IdleMs, unsigned int LocalConn)
 {
     // 初始化数据库信息
     this->Ip = ip;
@@ -34,61 +90,198 @@ void conn_pool::init(string ip,  string User, string PassWord, string DBName, in
     this->User = User;
     this->PassWord = PassWord;
     this->DataBaseName = DBName;
-
-    for(unsigned int i=0;i < MaxConn; i++)
+    this->MaxConn = MaxConn > 0 ? MaxConn : 1;
+    this->MinConn = (MinConn == 0 || MinConn > this->MaxConn) ? this->MaxConn : MinConn;
+    this->WaitMs = WaitMs;
+    this->IdleMs = IdleMs > 0 ? IdleMs : 30 * 1000;
+    this->LocalConn = LocalConn < MAX_LOCAL ? LocalConn : MAX_LOCAL;
+    this->stopping = false;
+
+    /* 并行预热：建连主要是等网络往返，一个个建要 MinConn 倍的时间 */
+    vector<MYSQL *> conns(this->MinConn, nullptr);
+    vector<thread> workers;
+    for(unsigned int i = 0; i < this->MinConn; i++)
     {
-        MYSQL *conn = nullptr;
-        conn = mysql_init(conn);
-
-        if(conn == nullptr)
-        {
-            cout << "Error:" << mysql_error(conn);  //
-            exit(1);
-        }
-
-        conn = mysql_real_connect(conn, ip.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, nullptr, 0 );
+        workers.emplace_back([this, &conns, i] { conns[i] = Connect(); });
+    }
+    for(auto &t: workers)
+    {
+        t.join();
+    }
 
-        if(conn == nullptr)
+    unsigned int opened = 0;
+    {
+        lock_guard<mutex> locker(lock);
+        for(MYSQL *conn: conns)
         {
-            cout << "Error:" << mysql_error(conn);  //
-            exit(1);
+            if(conn)
+            {
+                ++TotalConn;
+                AddConnection(conn);
+                ++opened;
+            }
         }
-
-        // 更新连接池和空闲连接数量
-        connList.push_back(conn);
-        ++FreeConn;
+    }
+    if(opened < this->MinConn)
+    {
+        LOG_ERROR("SqlConnPool: only %u of %u connections opened, the rest will be retried", opened, this->MinConn);
     }
 
-    // 信号量初值设置为最大连接次数
-    reserve = sem(FreeConn);
-    this->MaxConn = FreeConn;
+    maintainer = thread(&conn_pool::Maintain, this);
 }
 
 
-/* 有请求时，从数据库连接池中返回一个可用的连接，更新使用和空闲连接数 */
-MYSQL *conn_pool::GetConnection()
+/* 不持有 lock 调用 */
+MYSQL *conn_pool::Connect()
 {
-    MYSQL *conn = nullptr;
+    MYSQL *conn = mysql_init(nullptr);
+    if(conn == nullptr)
+    {
+        LOG_ERROR("MySQL init error");
+        return nullptr;
+    }
 
-    if(0 == connList.size())
+    bool reconnect = true;     // 断线后 mysql_ping 原地重连，连接池里的指针不变
+    mysql_options(conn, MYSQL_OPT_RECONNECT, &reconnect);
+    unsigned int timeout = WaitMs > 1000 ? WaitMs / 1000 : 1;     // 数据库不可达时不要卡住取连接的线程
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+
+    if(mysql_real_connect(conn, Ip.c_str(), User.c_str(), PassWord.c_str(), DataBaseName.c_str(), Port, nullptr, 0) == nullptr)
     {
+        LOG_ERROR("MySQL connect error: %s", mysql_error(conn));
+        mysql_close(conn);
         return nullptr;
     }
+    return conn;
+}
 
-    // 取出连接， 信号量原子减1， 到0时就等待
-    reserve.wait();
+void conn_pool::AddConnection(MYSQL *conn)
+{
+    stmtList[conn] = stmtCache { mysql_thread_id(conn), { nullptr }, clock::now() };
+    connList.push_back(conn);
+    ++FreeConn;
+}
 
-    lock.lock();
+/* 关闭连接并丢掉它的语句句柄，调用方负责把它移出空闲列表 */
+void conn_pool::CloseConnection(MYSQL *conn)
+{
+    map<MYSQL *, stmtCache>::iterator it = stmtList.find(conn);
+    if(it != stmtList.end())
+    {
+        for(MYSQL_STMT *stmt: it->second.stmts)
+        {
+            if(stmt)
+            {
+                mysql_stmt_close(stmt);
+            }
+        }
+        stmtList.erase(it);
+    }
+    mysql_close(conn);
+    --TotalConn;
+}
 
-    conn = connList.front();
-    connList.pop_front();
 
-    --FreeConn;
-    ++CurConn;
+/* 有请求时，从数据库连接池中返回一个可用的连接，更新使用和空闲连接数 */
+MYSQL *conn_pool::GetConnection(int timeoutMs)
+{
+    int waitMs = timeoutMs < 0 ? WaitMs : timeoutMs;
+    clock::time_point start = clock::now();
+    clock::time_point deadline = start + chrono::milliseconds(waitMs);
+    MYSQL *conn = nullptr;
 
+    /* 先看本线程的槽，不加锁 */
+    localSlot *slot = LocalConn > 0 ? LocalSlot() : nullptr;
+    if(slot)
+    {
+        for(unsigned int i = 0; i < LocalConn; i++)
+        {
+            if((conn = slot->conns[i].exchange(nullptr)))
+            {
+                slot->touched = true;
+                --parked;
+                ++localHits;
+                t_local.held = conn;
+                t_local.heldCache = slot->caches[i];
+                ++outstanding;
+                return conn;
+            }
+        }
+    }
 
-    lock.unlock();
+    unique_lock<mutex> locker(lock);
+    if(LocalConn > 0 && !slot)
+    {
+        t_local.slots.emplace_back(Id, make_shared<localSlot>());
+        slots.push_back(t_local.slots.back().second);
+    }
+    while(!stopping)
+    {
+        if(!connList.empty())
+        {
+            conn = connList.back();     // 后进先出，不常用的连接留在表头，空闲久了被回收
+            connList.pop_back();
+            --FreeConn;
+            ++CurConn;
+            break;
+        }
+        if(TotalConn < MaxConn && clock::now() >= RetryAfter)
+        {
+            ++TotalConn;                // 先占住名额，建连时不持有锁
+            locker.unlock();
+            conn = Connect();
+            locker.lock();
+            if(conn)
+            {
+                stmtList[conn] = stmtCache { mysql_thread_id(conn), { nullptr }, clock::now() };
+                ++CurConn;
+                RetryAfter = clock::time_point();
+            }
+            else
+            {
+                --TotalConn;
+                ++stats.failures;
+                RetryAfter = clock::now() + chrono::milliseconds(RETRY_MS);
+            }
+            break;
+        }
+        /* 先登记在等，再看别的线程的槽：放回连接的线程要么被这里偷到，要么看到有人在等而放进共享池 */
+        ++waiting;
+        if((conn = Steal()))
+        {
+            --waiting;
+            ++stats.steals;
+            break;
+        }
+        if(TotalConn == 0)              // 数据库刚连不上，也没有连接可等，直接失败
+        {
+            --waiting;
+            break;
+        }
+        cv_status status = released.wait_until(locker, deadline);
+        --waiting;
+        if(status == cv_status::timeout && connList.empty())
+        {
+            ++stats.timeouts;
+            LOG_WARN("SqlConnPool: no connection within %dms (busy %u)", waitMs, CurConn);
+            break;
+        }
+    }
 
+    long long waited = chrono::duration_cast<chrono::milliseconds>(clock::now() - start).count();
+    int bucket = 0;
+    while(bucket < pool_stats::BUCKETS - 1 && waited >= pool_stats::BUCKET_MS[bucket])
+    {
+        bucket++;
+    }
+    ++stats.waits[bucket];
+
+    if(conn)
+    {
+        t_local.held = conn;
+        t_local.heldCache = &stmtList[conn];
+        ++outstanding;
+    }
     return conn;
 }
 
@@ -101,49 +294,419 @@ bool conn_pool::ReleaseConnection(MYSQL *conn)
         return false;
     }
 
-    lock.lock();
+    --outstanding;
+    stmtCache *cache = nullptr;
+    if(t_local.held == conn)
+    {
+        cache = t_local.heldCache;
+        t_local.held = nullptr;
+        t_local.heldCache = nullptr;
+    }
 
-    connList.push_back(conn);
-    ++FreeConn;
-    --CurConn;
+    /* 留在本线程的槽里；放进去之后再看有没有人在等，有就取回来放进共享池 */
+    localSlot *slot = (cache && LocalConn > 0 && !stopping) ? LocalSlot() : nullptr;
+    if(slot)
+    {
+        for(unsigned int i = 0; i < LocalConn; i++)
+        {
+            if(slot->conns[i].load())
+            {
+                continue;
+            }
+            slot->caches[i] = cache;
+            slot->touched = true;
+            ++parked;
+            slot->conns[i].store(conn);
+            if(waiting == 0)
+            {
+                return true;
+            }
+            if(slot->conns[i].exchange(nullptr) != conn)
+            {
+                return true;        // 已经被等着的线程偷走
+            }
+            --parked;
+            break;
+        }
+    }
 
-    lock.unlock();
-    reserve.post();     // 释放连接原子+1
+    {
+        lock_guard<mutex> locker(lock);
+        (cache ? *cache : stmtList[conn]).lastUsed = clock::now();
+        connList.push_back(conn);
+        ++FreeConn;
+        --CurConn;
+    }
+    released.notify_one();
 
     return true;
 }
 
 
-/* 销毁连接池 */
+/* 后台维护：每隔 IdleMs 的一半检查一次空闲连接 */
+void conn_pool::Maintain()
+{
+    unique_lock<mutex> locker(lock);
+    while(!stopping)
+    {
+        stopCond.wait_for(locker, chrono::milliseconds(IdleMs / 2));
+        if(stopping)
+        {
+            break;
+        }
+        locker.unlock();
+        CheckIdle();
+        locker.lock();
+    }
+}
+
+void conn_pool::CheckIdle()
+{
+    vector<MYSQL *> stale;
+    {
+        lock_guard<mutex> locker(lock);
+        Reclaim(false);
+        clock::time_point expire = clock::now() - chrono::milliseconds(IdleMs);
+        for(list<MYSQL *>::iterator it = connList.begin(); it != connList.end(); )
+        {
+            if(stmtList[*it].lastUsed > expire)
+            {
+                ++it;
+                continue;
+            }
+            if(TotalConn > MinConn)         // 多出来的直接关掉
+            {
+                MYSQL *conn = *it;
+                it = connList.erase(it);
+                --FreeConn;
+                CloseConnection(conn);
+                continue;
+            }
+            stale.push_back(*it);           // 其余的拿出来 ping，期间算作使用中
+            it = connList.erase(it);
+            --FreeConn;
+            ++CurConn;
+            ++outstanding;
+        }
+    }
+
+    vector<MYSQL *> alive;
+    for(MYSQL *conn: stale)
+    {
+        if(mysql_ping(conn) == 0)
+        {
+            alive.push_back(conn);
+            continue;
+        }
+        LOG_WARN("SqlConnPool: ping failed: %s", mysql_error(conn));
+        lock_guard<mutex> locker(lock);
+        --CurConn;
+        --outstanding;
+        CloseConnection(conn);
+    }
+    for(MYSQL *conn: alive)
+    {
+        ReleaseConnection(conn);
+    }
+
+    /* 补足最小连接数，数据库恢复后连接池随之恢复 */
+    while(true)
+    {
+        {
+            lock_guard<mutex> locker(lock);
+            if(stopping || TotalConn >= MinConn)
+            {
+                break;
+            }
+            ++TotalConn;
+        }
+        MYSQL *conn = Connect();
+        lock_guard<mutex> locker(lock);
+        if(!conn)
+        {
+            --TotalConn;
+            ++stats.failures;
+            RetryAfter = clock::now() + chrono::milliseconds(RETRY_MS);
+            break;
+        }
+        RetryAfter = clock::time_point();
+        AddConnection(conn);
+        released.notify_one();
+    }
+}
+
+
+conn_pool::localSlot *conn_pool::LocalSlot()
+{
+    for(auto &item: t_local.slots)
+    {
+        if(item.first == Id)
+        {
+            return item.second.get();
+        }
+    }
+    return nullptr;
+}
+
+/* 从别的线程的槽里取一个连接，仍算使用中 */
+MYSQL *conn_pool::Steal()
+{
+    for(auto &slot: slots)
+    {
+        for(unsigned int i = 0; i < LocalConn; i++)
+        {
+            MYSQL *conn = slot->conns[i].exchange(nullptr);
+            if(conn)
+            {
+                --parked;
+                return conn;
+            }
+        }
+    }
+    return nullptr;
+}
+
+/* 把一个周期内没被碰过的槽（all 时是所有槽）里的连接收回共享池，丢掉线程已退出的槽 */
+void conn_pool::Reclaim(bool all)
+{
+    for(vector<shared_ptr<localSlot>>::iterator it = slots.begin(); it != slots.end(); )
+    {
+        localSlot &slot = **it;
+        bool dead = slot.dead;
+        if(all || dead || !slot.touched.exchange(false))
+        {
+            for(unsigned int i = 0; i < MAX_LOCAL; i++)
+            {
+                MYSQL *conn = slot.conns[i].exchange(nullptr);
+                if(conn)
+                {
+                    --parked;
+                    --CurConn;
+                    stmtList[conn].lastUsed = clock::now();
+                    connList.push_front(conn);
+                    ++FreeConn;
+                }
+            }
+        }
+        it = dead ? slots.erase(it) : it + 1;
+    }
+}
+
+
+pool_stats conn_pool::GetStats()
+{
+    lock_guard<mutex> locker(lock);
+    pool_stats current = stats;
+    current.total = TotalConn;
+    current.local = parked;
+    current.busy = CurConn - current.local;
+    current.idle = FreeConn;
+    current.localHits = localHits;
+    return current;
+}
+
+
+/* 销毁连接池：停掉维护线程，关闭空闲连接，唤醒还在等连接的线程 */
 void conn_pool::DestroyPool()
 {
-    lock.lock();
+    {
+        lock_guard<mutex> locker(lock);
+        stopping = true;
+    }
+    stopCond.notify_all();
+    released.notify_all();
+    if(maintainer.joinable())
+    {
+        maintainer.join();
+    }
 
-    if(connList.size() > 0)
+    lock_guard<mutex> locker(lock);
+    Reclaim(true);
+    slots.clear();
+    for(MYSQL *conn: connList)
+    {
+        CloseConnection(conn);
+    }
+    if(CurConn > 0)
     {
-        // 迭代器遍历列表，关闭数据库
-        list<MYSQL *>::iterator it;
-        for(it=connList.begin();it!=connList.end();++it)
+        LOG_WARN("SqlConnPool: %u connections still in use at destroy", CurConn);
+    }
+    connList.clear();
+    FreeConn = 0;
+}
+
+
+/* 取 conn 上 id 对应的语句，还没 prepare 或连接重连过时重新 prepare */
+MYSQL_STMT *conn_pool::GetStmt(MYSQL *conn, STMT id)
+{
+    stmtCache *found = t_local.held == conn ? t_local.heldCache : nullptr;
+    if(!found)
+    {
+        lock_guard<mutex> locker(lock);     // 连接池伸缩时 stmtList 会增删，找到的节点本身不会失效
+        map<MYSQL *, stmtCache>::iterator it = stmtList.find(conn);
+        if(it == stmtList.end())
         {
-            MYSQL *conn = *it;
-            mysql_close(conn);
+            return nullptr;
         }
+        found = &it->second;
+    }
+    stmtCache &cache = *found;
+    unsigned long threadId = mysql_thread_id(conn);
+    if(cache.threadId != threadId)
+    {
+        for(MYSQL_STMT *&stmt: cache.stmts)
+        {
+            if(stmt)
+            {
+                mysql_stmt_close(stmt);
+                stmt = nullptr;
+            }
+        }
+        cache.threadId = threadId;
+    }
 
-        CurConn = 0;
-        FreeConn = 0;
+    if(!cache.stmts[id])
+    {
+        MYSQL_STMT *stmt = mysql_stmt_init(conn);
+        if(!stmt)
+        {
+            return nullptr;
+        }
+        if(mysql_stmt_prepare(stmt, STMT_SQL[id], strlen(STMT_SQL[id])) != 0)
+        {
+            LOG_ERROR("Prepare %s: %s", STMT_SQL[id], mysql_stmt_error(stmt));
+            mysql_stmt_close(stmt);
+            return nullptr;
+        }
+        cache.stmts[id] = stmt;
+    }
+    return cache.stmts[id];
+}
 
-        connList.clear();
+bool conn_pool::ExecuteStmt(MYSQL *conn, STMT id, const vector<string> &params, sql_result &result)
+{
+    for(int retry = 0; retry < 2; retry++)
+    {
+        result = sql_result();
+        MYSQL_STMT *stmt = GetStmt(conn, id);
+        if(stmt && RunStmt(stmt, params, result))
+        {
+            return true;
+        }
+        if(!stmt)
+        {
+            result.errcode = mysql_errno(conn);
+            result.error = mysql_error(conn);
+        }
+        /* 连接断开：ping 触发重连，线程 ID 变化后 GetStmt 会重新 prepare */
+        if(result.errcode != CR_SERVER_GONE_ERROR && result.errcode != CR_SERVER_LOST)
+        {
+            break;
+        }
+        LOG_WARN("Connection lost (%s), reconnecting", result.error.c_str());
+        if(mysql_ping(conn) != 0)
+        {
+            break;
+        }
+    }
+    LOG_ERROR("Execute %s: %s", STMT_SQL[id], result.error.c_str());
+    return false;
+}
+
+bool conn_pool::RunStmt(MYSQL_STMT *stmt, const vector<string> &params, sql_result &result)
+{
+    unsigned long count = mysql_stmt_param_count(stmt);
+    assert(count == params.size());
+    vector<MYSQL_BIND> in(count);
+    vector<unsigned long> inLen(count);
+    memset(in.data(), 0, sizeof(MYSQL_BIND) * count);
+    for(unsigned long i = 0; i < count; i++)
+    {
+        inLen[i] = params[i].size();
+        in[i].buffer_type = MYSQL_TYPE_STRING;
+        in[i].buffer = const_cast<char *>(params[i].data());
+        in[i].buffer_length = inLen[i];
+        in[i].length = &inLen[i];
+    }
+    if((count > 0 && mysql_stmt_bind_param(stmt, in.data())) || mysql_stmt_execute(stmt) != 0)
+    {
+        result.errcode = mysql_stmt_errno(stmt);
+        result.error = mysql_stmt_error(stmt);
+        return false;
+    }
 
-        lock.unlock();
+    MYSQL_RES *meta = mysql_stmt_result_metadata(stmt);
+    if(!meta)           // INSERT / UPDATE 没有结果集
+    {
+        result.ok = true;
+        result.affected = mysql_stmt_affected_rows(stmt);
+        return true;
+    }
+    unsigned int fields = mysql_num_fields(meta);
+    mysql_free_result(meta);
+
+    vector<MYSQL_BIND> out(fields);
+    vector<char> buffer(fields * STMT_COLUMN_BUFFER);
+    vector<unsigned long> outLen(fields);
+    unique_ptr<bindBool[]> isNull(new bindBool[fields]);
+    memset(out.data(), 0, sizeof(MYSQL_BIND) * fields);
+    for(unsigned int i = 0; i < fields; i++)
+    {
+        out[i].buffer_type = MYSQL_TYPE_STRING;
+        out[i].buffer = &buffer[i * STMT_COLUMN_BUFFER];
+        out[i].buffer_length = STMT_COLUMN_BUFFER;
+        out[i].length = &outLen[i];
+        out[i].is_null = &isNull[i];
+    }
+    if(mysql_stmt_bind_result(stmt, out.data()) || mysql_stmt_store_result(stmt) != 0)
+    {
+        result.errcode = mysql_stmt_errno(stmt);
+        result.error = mysql_stmt_error(stmt);
+        mysql_stmt_free_result(stmt);
+        return false;
     }
 
-    lock.unlock();
+    int ret;
+    while((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED)
+    {
+        result.rows.emplace_back(fields);
+        vector<string> &row = result.rows.back();
+        for(unsigned int i = 0; i < fields; i++)
+        {
+            if(isNull[i])
+            {
+                continue;
+            }
+            if(outLen[i] <= STMT_COLUMN_BUFFER)
+            {
+                row[i].assign(&buffer[i * STMT_COLUMN_BUFFER], outLen[i]);
+                continue;
+            }
+            row[i].resize(outLen[i]);
+            MYSQL_BIND column;
+            memset(&column, 0, sizeof(column));
+            column.buffer_type = MYSQL_TYPE_STRING;
+            column.buffer = &row[i][0];
+            column.buffer_length = outLen[i];
+            mysql_stmt_fetch_column(stmt, &column, i, 0);
+        }
+    }
+    mysql_stmt_free_result(stmt);
+    if(ret != MYSQL_NO_DATA)
+    {
+        result.errcode = mysql_stmt_errno(stmt);
+        result.error = mysql_stmt_error(stmt);
+        return false;
+    }
+    result.ok = true;
+    return true;
 }
 
 
 /* 获取当前空闲连接数 */
 int conn_pool::GetFreeConn()
 {
+    lock_guard<mutex> locker(lock);
     return this->FreeConn;
 }
 
@@ -3,47 +3,178 @@
 
 #include <stdio.h>
 #include <list>
+#include <map>
+#include <vector>
 #include <mysql/mysql.h>
 #include <string.h>
 #include <string>
-#include "locker.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
 
 
 using namespace std;
 
 
-/* 连接池的主要功能有：初始化、获取连接、释放连接，销毁连接池 */
+/* 一次查询的结果，同步接口和 sql_async 共用 */
+struct sql_result
+{
+    bool ok = false;
+    bool timedOut = false;
+    unsigned int errcode = 0;
+    string error;
+    vector<vector<string>> rows;        // NULL 列为空串
+    unsigned long long affected = 0;
+};
+
+
+/* 连接池的主要功能有：初始化、获取连接、释放连接，销毁连接池
+
+    连接数在 [MinConn, MaxConn] 之间伸缩：
+    - init 时并行建立 MinConn 个连接，失败的只记日志，之后按需补建
+    - 没有空闲连接且未到上限时当场新建，到上限时最多等 WaitMs，超时返回 nullptr，调用方据此快速失败
+    - 后台线程定期检查空闲超过 IdleMs 的连接：多于 MinConn 的关掉，其余 mysql_ping 保活（断线时原地重连），
+      ping 失败的关掉，再补足 MinConn
+    - 取连接的等待时间按区间计数，连同使用中、空闲的连接数由 GetStats 导出
+
+    LocalConn > 0 时连接与线程亲和：线程放回的连接先留在本线程的槽里（最多 LocalConn 个），
+    下次取连接时直接拿，不碰 lock。本线程的槽空了才去共享池；共享池也没有时从别的线程的槽里偷。
+    有线程在等连接时放回的连接直接进共享池；一个维护周期内没被碰过的槽由后台线程收回。
+*/
+struct pool_stats
+{
+    static const int BUCKETS = 8;
+    static const int BUCKET_MS[BUCKETS];    // 各区间的上界（ms），最后一个区间不设上界
+
+    unsigned int total = 0;
+    unsigned int busy = 0;
+    unsigned int idle = 0;
+    unsigned long long waits[BUCKETS] = { 0 };
+    unsigned long long timeouts = 0;        // 等到超时仍没有连接
+    unsigned long long failures = 0;        // 新建连接失败
+    unsigned int local = 0;                 // 留在线程槽里的连接
+    unsigned long long localHits = 0;       // 从本线程槽里直接取到，不计入 waits
+    unsigned long long steals = 0;          // 从别的线程的槽里偷到
+};
+
 class conn_pool
 {
 
 public:
-    MYSQL *GetConnection();
+    /* 预处理语句，每个连接第一次用到时 prepare，之后按 ID 复用 */
+    enum STMT {
+        USER_SELECT,        // SELECT username, passwd FROM user WHERE username = ?
+        USER_INSERT,        // INSERT INTO user(username, passwd) VALUES(?, ?)
+        STMT_NUM,
+    };
+
+public:
+    /* timeoutMs < 0 时使用 init 的 WaitMs；超时或建不了新连接时返回 nullptr */
+    MYSQL *GetConnection(int timeoutMs = -1);
     bool ReleaseConnection(MYSQL *conn);
+    /* 借出未还的连接数（不含留在线程槽里的），读写分离按它选最空闲的库 */
+    int Outstanding() const { return outstanding; }
+    /* 建立一个不归连接池管理的连接，失败时返回 nullptr，调用方负责 mysql_close */
+    MYSQL *Connect();
     int GetFreeConn();
     void DestroyPool();         // 销毁所有连接
+    pool_stats GetStats();
+
+    /* 执行预处理语句：参数按字符串二进制绑定，结果各列取成字符串；连接断开时重连、重新 prepare 后重试一次 */
+    bool ExecuteStmt(MYSQL *conn, STMT id, const vector<string> &params, sql_result &result);
     
 
     // 局部静态变量单例模式
     static conn_pool *GetInstance();
 
-    void init(string Ip, string User, string PassWord, string DBName, int Port, unsigned int MaxConn);
+    void init(string Ip, string User, string PassWord, string DBName, int Port, unsigned int MaxConn,
+        unsigned int MinConn = 0, int WaitMs = 1000, int IdleMs = 30 * 1000, unsigned int LocalConn = 0);
 
     conn_pool();
     ~conn_pool();
 
 private:
     unsigned int MaxConn;
+    unsigned int MinConn;
+    unsigned int TotalConn;     // 已建立和正在建立的连接数
     unsigned int CurConn;   // 当前已使用的连接数
     unsigned int FreeConn;  // 当前空闲的连接数
+    unsigned int LocalConn; // 每个线程槽里最多留几个连接，0 表示不做线程亲和
+    int WaitMs;
+    int IdleMs;
+    std::chrono::steady_clock::time_point RetryAfter;   // 建连失败后的退避，数据库不可达时不让每个请求都去等建连超时
+
+private:
+    void AddConnection(MYSQL *conn);        // 需持有 lock
+    void CloseConnection(MYSQL *conn);      // 需持有 lock
+    void Maintain();
+    void CheckIdle();
+    MYSQL *Steal();                         // 需持有 lock
+    void Reclaim(bool all);                 // 需持有 lock
+
+    MYSQL_STMT *GetStmt(MYSQL *conn, STMT id);
+    static bool RunStmt(MYSQL_STMT *stmt, const vector<string> &params, sql_result &result);
+
+    typedef std::chrono::steady_clock clock;
+
+    /* 语句句柄属于创建它的那次连接，重连后线程 ID 变化，旧句柄全部作废 */
+    struct stmtCache
+    {
+        unsigned long threadId;
+        MYSQL_STMT *stmts[STMT_NUM];
+        clock::time_point lastUsed;     // 最近一次放回池里的时间
+    };
+
+    static const char *STMT_SQL[STMT_NUM];
+
+    /* 线程槽：只有所属线程往里放，谁都可以用 exchange 取走；放之前先写好 caches[i] */
+    static const unsigned int MAX_LOCAL = 4;
+    struct localSlot
+    {
+        std::atomic<MYSQL *> conns[MAX_LOCAL];
+        stmtCache *caches[MAX_LOCAL];
+        std::atomic<bool> touched;          // 维护线程每个周期清一次，所属线程取放时置位
+        std::atomic<bool> dead;             // 所属线程已退出
+        localSlot();
+    };
+
+    /* 本线程在各个连接池上的槽，按连接池编号找：销毁后新建的连接池可能复用同一个地址；
+        本线程持有的连接的语句缓存，省掉 ExecuteStmt 里查 stmtList 的加锁 */
+    struct threadLocal
+    {
+        vector<std::pair<unsigned long, std::shared_ptr<localSlot>>> slots;
+        MYSQL *held = nullptr;
+        stmtCache *heldCache = nullptr;
+        ~threadLocal();
+    };
+    static thread_local threadLocal t_local;
+    localSlot *LocalSlot();
+    static std::atomic<unsigned long> NextId;
+    const unsigned long Id;
 
 private:
-    locker lock;
-    list<MYSQL *> connList;     // 连接池
-    sem reserve;
+    std::mutex lock;
+    std::condition_variable released;
+    list<MYSQL *> connList;     // 空闲连接，表尾是最近放回的
+    map<MYSQL *, stmtCache> stmtList;   // 增删在 lock 内；语句句柄只由持有该连接的线程访问
+
+    std::thread maintainer;
+    std::condition_variable stopCond;
+    std::atomic<bool> stopping;
+
+    pool_stats stats;
+    vector<std::shared_ptr<localSlot>> slots;   // 增删在 lock 内
+    std::atomic<unsigned int> parked;       // 留在线程槽里的连接数，计入 CurConn
+    std::atomic<int> waiting;               // 正在等连接的线程数
+    std::atomic<unsigned long long> localHits;
+    std::atomic<int> outstanding;
 
 private:
     string Ip;              // 主机IP地址
-    string Port;            // 数据库端口号
+    int Port;               // 数据库端口号
     string User;            // 登录用户名
     string PassWord;        // 登录用户数据库密码
     string DataBaseName;    // 使用数据库名
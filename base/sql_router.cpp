@@ -0,0 +1,170 @@
+#include "sql_router.h"
+
+#include <chrono>
+#include <mysql/errmsg.h>
+
+#include "log.h"
+
+using namespace std;
+
+const int sql_router::EJECT_FAILURES;
+const int sql_router::EJECT_MS;
+const int sql_router::EJECT_MAX_MS;
+
+sql_router::sql_router(int ejectMs): m_next(0), m_ejectMs(ejectMs)
+{
+}
+
+sql_router::~sql_router()
+{
+    stop();
+}
+
+sql_router *sql_router::GetInstance()
+{
+    static sql_router router;
+    return &router;
+}
+
+void sql_router::init(const sql_endpoint &primary, const vector<sql_endpoint> &replicas,
+    const string &user, const string &passWord, const string &dbName,
+    unsigned int MaxConn, unsigned int MinConn, int WaitMs, unsigned int LocalConn)
+{
+    m_endpoints.clear();
+    m_endpoints.emplace_back(new endpoint);
+    m_endpoints[0]->config = primary;
+    if(this == GetInstance())
+    {
+        m_endpoints[0]->pool = conn_pool::GetInstance();
+    }
+    else
+    {
+        m_endpoints[0]->owned.reset(new conn_pool);
+        m_endpoints[0]->pool = m_endpoints[0]->owned.get();
+    }
+    for(const sql_endpoint &replica: replicas)
+    {
+        m_endpoints.emplace_back(new endpoint);
+        m_endpoints.back()->config = replica;
+        m_endpoints.back()->owned.reset(new conn_pool);
+        m_endpoints.back()->pool = m_endpoints.back()->owned.get();
+    }
+    for(size_t i = 0; i < m_endpoints.size(); i++)
+    {
+        endpoint &ep = *m_endpoints[i];
+        ep.ejectMs = m_ejectMs;
+        ep.pool->init(ep.config.host, user, passWord, dbName, ep.config.port, MaxConn, MinConn, WaitMs,
+            30 * 1000, LocalConn);
+        LOG_INFO("SQL endpoint %s: %s:%d%s", ep.config.name.c_str(), ep.config.host.c_str(), ep.config.port,
+            i > 0 ? " (replica)" : "");
+    }
+}
+
+/* 只关自己持有的连接池，单例的主库由 conn_pool 单例自己销毁 */
+void sql_router::stop()
+{
+    for(auto &ep: m_endpoints)
+    {
+        if(ep->owned)
+        {
+            ep->owned->DestroyPool();
+        }
+    }
+}
+
+long long sql_router::now()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* 副本里选借出连接最少的，从轮转位置开始找，借出数相同时各副本轮流 */
+conn_pool *sql_router::pick(bool readOnly)
+{
+    if(m_endpoints.empty())
+    {
+        return conn_pool::GetInstance();
+    }
+    endpoint *best = m_endpoints[0].get();
+    size_t replicas = m_endpoints.size() - 1;
+    if(readOnly && replicas > 0)
+    {
+        long long current = now();
+        endpoint *chosen = nullptr;
+        unsigned int start = m_next++;
+        for(size_t i = 0; i < replicas; i++)
+        {
+            endpoint *ep = m_endpoints[1 + (start + i) % replicas].get();
+            if(ep->ejectedUntil > current)
+            {
+                continue;
+            }
+            if(!chosen || ep->pool->Outstanding() < chosen->pool->Outstanding())
+            {
+                chosen = ep;
+            }
+        }
+        if(chosen)
+        {
+            best = chosen;
+        }
+    }
+    ++best->picks;
+    return best->pool;
+}
+
+/* 主库不摘除，它是最后的退路 */
+void sql_router::report(conn_pool *pool, bool ok)
+{
+    for(size_t i = 1; i < m_endpoints.size(); i++)
+    {
+        endpoint &ep = *m_endpoints[i];
+        if(ep.pool != pool)
+        {
+            continue;
+        }
+        if(ok)
+        {
+            if(ep.failures.exchange(0) >= EJECT_FAILURES)
+            {
+                ep.ejectMs = m_ejectMs;
+                LOG_INFO("SQL endpoint %s recovered", ep.config.name.c_str());
+            }
+            return;
+        }
+        int failures = ++ep.failures;
+        if(failures >= EJECT_FAILURES && ep.ejectedUntil <= now())
+        {
+            int ms = ep.ejectMs;
+            ep.ejectedUntil = now() + ms;
+            ep.ejectMs = ms * 2 < EJECT_MAX_MS ? ms * 2 : EJECT_MAX_MS;
+            ++ep.ejections;
+            LOG_WARN("SQL endpoint %s ejected for %dms after %d failures", ep.config.name.c_str(), ms, failures);
+        }
+        return;
+    }
+}
+
+bool sql_router::endpointError(unsigned int errcode)
+{
+    return errcode >= CR_MIN_ERROR && errcode <= CR_MAX_ERROR;
+}
+
+vector<sql_router::endpoint_stats> sql_router::getStats()
+{
+    vector<endpoint_stats> out;
+    long long current = now();
+    for(size_t i = 0; i < m_endpoints.size(); i++)
+    {
+        endpoint *ep = m_endpoints[i].get();
+        endpoint_stats item;
+        item.name = ep->config.name;
+        item.replica = i > 0;
+        item.ejected = ep->ejectedUntil > current;
+        item.outstanding = ep->pool->Outstanding();
+        item.picks = ep->picks;
+        item.ejections = ep->ejections;
+        item.pool = ep->pool->GetStats();
+        out.push_back(item);
+    }
+    return out;
+}
@@ -0,0 +1,89 @@
+#ifndef SQL_ROUTER_H
+#define SQL_ROUTER_H
+
+/* 读写分离：一个主库，若干只读副本，各自一个 conn_pool
+
+    写和需要读到最新数据的查询走主库；只读查询在健康的副本里选借出连接最少的一个，
+    一个副本都没有或全被摘除时退回主库。
+    - 调用方用 report 报告每次取连接、执行的结果：连续失败 EJECT_FAILURES 次的副本被摘除，
+      到期后重新参与选择，再失败则摘除时间加倍（上限 EJECT_MAX_MS），成功一次清零
+    - 只有连不上、断线这类客户端错误（CR_*）算失败，SQL 本身的错误（比如重复键）不算
+    - 副本有复制延迟：刚注册的用户在副本上可能还查不到，注册成功时凭据缓存已经记下，不受影响
+*/
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "sql_conn_pool.h"
+
+struct sql_endpoint
+{
+    std::string name;
+    std::string host;
+    int port;
+};
+
+class sql_router
+{
+public:
+    static sql_router *GetInstance();
+
+    /* 单例的主库用 conn_pool::GetInstance()，其余连接池由 sql_router 持有（分片各自的实例连主库也是）；
+        各库的连接池参数相同 */
+    void init(const sql_endpoint &primary, const std::vector<sql_endpoint> &replicas,
+        const std::string &user, const std::string &passWord, const std::string &dbName,
+        unsigned int MaxConn, unsigned int MinConn, int WaitMs, unsigned int LocalConn);
+    void stop();
+
+    /* 没有 init 时只有主库 conn_pool::GetInstance() */
+    conn_pool *primary() const { return m_endpoints.empty() ? conn_pool::GetInstance() : m_endpoints[0]->pool; }
+    conn_pool *pick(bool readOnly);
+    void report(conn_pool *pool, bool ok);
+
+    /* errcode 是否说明这个库连不上或断线了 */
+    static bool endpointError(unsigned int errcode);
+
+    struct endpoint_stats
+    {
+        std::string name;
+        bool replica;
+        bool ejected;
+        int outstanding;
+        unsigned long long picks;
+        unsigned long long ejections;
+        pool_stats pool;
+    };
+    std::vector<endpoint_stats> getStats();
+
+    /* ejectMs 是第一次摘除的时长，测试时调小 */
+    explicit sql_router(int ejectMs = EJECT_MS);
+    ~sql_router();
+
+private:
+    static const int EJECT_FAILURES = 3;
+    static const int EJECT_MS = 5000;
+    static const int EJECT_MAX_MS = 60 * 1000;
+
+    struct endpoint
+    {
+        sql_endpoint config;
+        conn_pool *pool;
+        std::unique_ptr<conn_pool> owned;           // 单例的主库为空
+        std::atomic<int> failures { 0 };            // 连续失败次数
+        std::atomic<long long> ejectedUntil { 0 };  // steady_clock 毫秒
+        std::atomic<int> ejectMs { EJECT_MS };
+        std::atomic<unsigned long long> picks { 0 };
+        std::atomic<unsigned long long> ejections { 0 };
+    };
+
+    static long long now();
+
+private:
+    std::vector<std::unique_ptr<endpoint>> m_endpoints;     // [0] 是主库，init 之后不再增删
+    std::atomic<unsigned int> m_next;                       // 借出数相同时轮流选
+    const int m_ejectMs;
+};
+
+#endif
@@ -0,0 +1,59 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE BloomFilterTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../../utils/Utils.cpp"
+#include "../bloom_filter.cpp"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE (BloomFiltertest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testSizing)
+{
+  bloom_filter filter(1000, 0.01);
+  BOOST_CHECK_EQUAL(filter.hashes(), 7);          // -ln(0.01) / ln2 ≈ 6.6
+  BOOST_CHECK(filter.bits() >= 9586 && filter.bits() % 64 == 0);
+  BOOST_CHECK_EQUAL(filter.memory(), filter.bits() / 8);
+}
+
+BOOST_AUTO_TEST_CASE(testNoFalseNegative)
+{
+  bloom_filter filter(1000, 0.01);
+  for(int i = 0; i < 1000; i++)
+  {
+    filter.add("user" + to_string(i));
+  }
+  for(int i = 0; i < 1000; i++)
+  {
+    BOOST_CHECK(filter.mayContain("user" + to_string(i)));
+  }
+  BOOST_CHECK(filter.count() > 990 && filter.count() <= 1000);   // 插入时恰好误判的不计数
+}
+
+BOOST_AUTO_TEST_CASE(testRepeatAddNotCounted)
+{
+  bloom_filter filter(1000, 0.01);
+  BOOST_CHECK(filter.add("alice"));
+  BOOST_CHECK(!filter.add("alice"));
+  BOOST_CHECK(!filter.add("alice"));
+  BOOST_CHECK_EQUAL(filter.count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testFalsePositiveRate)
+{
+  bloom_filter filter(10000, 0.01);
+  for(int i = 0; i < 10000; i++)
+  {
+    filter.add("user" + to_string(i));
+  }
+  int positives = 0;
+  for(int i = 0; i < 100000; i++)
+  {
+    positives += filter.mayContain("other" + to_string(i));
+  }
+  BOOST_CHECK_LT(positives, 2000);                // 预期约 1%，留出余量
+  BOOST_CHECK_CLOSE(filter.currentFpRate(), 0.01, 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,126 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE CircuitBreakerTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+
+#include "../../net/Buffer.cpp"
+#include "../log.cpp"
+#include "../circuit_breaker.cpp"
+
+using namespace std;
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/circuit_breaker_unittest", 2000, 800000, 0); }
+};
+
+static breaker_config config()
+{
+  breaker_config c;
+  c.failureRate = 0.5;
+  c.slowMs = 100;
+  c.openMs = 50;
+  c.minCalls = 10;
+  c.probes = 2;
+  return c;
+}
+
+/* 放行一次调用并记下结果 */
+static bool call(circuit_breaker &breaker, bool ok, long long latencyMs = 1)
+{
+  unsigned long long probe;
+  if(!breaker.allow(probe))
+  {
+    return false;
+  }
+  breaker.record(ok, latencyMs, probe);
+  return true;
+}
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+BOOST_AUTO_TEST_SUITE (CircuitBreakertest)  // 定义 test suit 名
+
+/* 调用数不到 minCalls 不打开；坏调用（失败或慢）过半后打开，之后快速失败 */
+BOOST_AUTO_TEST_CASE(testTrip)
+{
+  circuit_breaker breaker("test", config());
+  for(int i = 0; i < 9; i++)
+  {
+    BOOST_CHECK(call(breaker, false));
+  }
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::CLOSED);
+  BOOST_CHECK(call(breaker, true, 200));
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::OPEN);
+  BOOST_CHECK(!call(breaker, true));
+
+  breaker_stats stats = breaker.getStats();
+  BOOST_CHECK_EQUAL(stats.trips, 1);
+  BOOST_CHECK_EQUAL(stats.rejected, 1);
+
+  circuit_breaker healthy("healthy", config());
+  for(int i = 0; i < 100; i++)
+  {
+    call(healthy, i % 3 != 0);
+  }
+  BOOST_CHECK_EQUAL(healthy.state(), circuit_breaker::CLOSED);
+}
+
+/* 半开时只放行 probes 个试探；都成功就关闭，有一个失败就重新打开 */
+BOOST_AUTO_TEST_CASE(testHalfOpen)
+{
+  circuit_breaker breaker("test", config());
+  for(int i = 0; i < 10; i++)
+  {
+    call(breaker, false);
+  }
+  this_thread::sleep_for(chrono::milliseconds(60));
+  unsigned long long probe1, probe2, probe3;
+  BOOST_CHECK(breaker.allow(probe1) && probe1);
+  BOOST_CHECK(breaker.allow(probe2) && probe2);
+  BOOST_CHECK(!breaker.allow(probe3));
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::HALF_OPEN);
+  breaker.record(true, 1, probe1);
+  breaker.record(false, 1, probe2);
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::OPEN);
+  BOOST_CHECK_EQUAL(breaker.getStats().trips, 2);
+
+  this_thread::sleep_for(chrono::milliseconds(60));
+  BOOST_CHECK(call(breaker, true));
+  BOOST_CHECK(call(breaker, true));
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::CLOSED);
+  BOOST_CHECK_EQUAL(breaker.getStats().recoveries, 1);
+  BOOST_CHECK_EQUAL(breaker.getStats().calls, 0);     // 恢复后窗口清空，打开前的坏调用不再计入
+}
+
+/* 重新打开前放行的试探晚到：不能把新半开周期的名额算成负数，也不能帮新周期关闭 */
+BOOST_AUTO_TEST_CASE(testStaleProbe)
+{
+  circuit_breaker breaker("test", config());
+  for(int i = 0; i < 10; i++)
+  {
+    call(breaker, false);
+  }
+  this_thread::sleep_for(chrono::milliseconds(60));
+  unsigned long long slow, failed;
+  BOOST_CHECK(breaker.allow(slow) && slow);
+  BOOST_CHECK(breaker.allow(failed) && failed);
+  breaker.record(false, 1, failed);
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::OPEN);
+
+  this_thread::sleep_for(chrono::milliseconds(60));
+  unsigned long long probe1, probe2, probe3;
+  BOOST_CHECK(breaker.allow(probe1) && probe1 != slow);
+  breaker.record(true, 1, slow);          // 上一周期的试探，忽略
+  breaker.release(slow);
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::HALF_OPEN);
+  BOOST_CHECK(breaker.allow(probe2));
+  BOOST_CHECK(!breaker.allow(probe3));    // 名额仍是 probes 个
+  breaker.record(true, 1, probe1);
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::HALF_OPEN);
+  breaker.record(true, 1, probe2);
+  BOOST_CHECK_EQUAL(breaker.state(), circuit_breaker::CLOSED);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
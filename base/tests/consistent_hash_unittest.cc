@@ -0,0 +1,75 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE ConsistentHashTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../../utils/Utils.cpp"
+#include "../consistent_hash.cpp"
+
+using namespace std;
+
+static consistent_hash ring(const vector<string> &nodes)
+{
+  consistent_hash h;
+  for(const string &node: nodes)
+  {
+    h.add(node);
+  }
+  return h;
+}
+
+BOOST_AUTO_TEST_SUITE (ConsistentHashtest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testEmpty)
+{
+  consistent_hash h;
+  BOOST_CHECK_EQUAL(h.locate("alice"), -1);
+  h.add("s1");
+  BOOST_CHECK_EQUAL(h.locate("alice"), 0);
+  BOOST_CHECK_CLOSE(h.share(0), 1.0, 0.001);
+}
+
+/* 160 个虚拟节点时各节点分到的 key 偏离平均值不超过 20% */
+BOOST_AUTO_TEST_CASE(testBalance)
+{
+  consistent_hash h = ring({ "s1", "s2", "s3", "s4" });
+  vector<int> counts(4, 0);
+  for(int i = 0; i < 100000; i++)
+  {
+    counts[h.locate("user" + to_string(i))]++;
+  }
+  double shares = 0;
+  for(int i = 0; i < 4; i++)
+  {
+    BOOST_CHECK(counts[i] > 20000 && counts[i] < 30000);
+    BOOST_CHECK(h.share(i) > 0.2 && h.share(i) < 0.3);
+    shares += h.share(i);
+  }
+  BOOST_CHECK_CLOSE(shares, 1.0, 0.001);
+
+  consistent_hash weighted;
+  weighted.add("s1");
+  weighted.add("s2", 3);
+  BOOST_CHECK(weighted.share(1) > 0.7 && weighted.share(1) < 0.8);
+}
+
+/* 加一个节点：只有约 1/5 的 key 移动，而且都移到新节点；节点的加入顺序不影响归属 */
+BOOST_AUTO_TEST_CASE(testMinimalMovement)
+{
+  consistent_hash before = ring({ "s1", "s2", "s3", "s4" });
+  consistent_hash after = ring({ "s5", "s3", "s1", "s4", "s2" });
+  int moved = 0;
+  for(int i = 0; i < 100000; i++)
+  {
+    string key = "user" + to_string(i);
+    const string &from = before.node(before.locate(key));
+    const string &to = after.node(after.locate(key));
+    if(from != to)
+    {
+      moved++;
+      BOOST_CHECK_EQUAL(to, "s5");
+    }
+  }
+  BOOST_CHECK(moved > 15000 && moved < 25000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,71 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE CpuAffinityTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+
+#include "../../net/Buffer.cpp"
+#include "../log.cpp"
+#include "../cpu_affinity.cpp"
+
+using namespace std;
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/cpu_affinity_unittest", 2000, 800000, 0); }
+};
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+BOOST_AUTO_TEST_SUITE (CpuAffinitytest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testParseList)
+{
+  vector<int> cpus;
+  BOOST_CHECK(cpu_affinity::parseList("0-3,8,10-11", cpus));
+  BOOST_CHECK(cpus == vector<int>({ 0, 1, 2, 3, 8, 10, 11 }));
+  BOOST_CHECK_EQUAL(cpu_affinity::formatList(cpus), "0-3,8,10-11");
+  BOOST_CHECK(cpu_affinity::parseList("5", cpus));
+  BOOST_CHECK(cpus == vector<int>({ 5 }));
+
+  for(const char *bad: { "", ",", "1,", "a", "-1", "3-1", "1-", "1-2-3", "1,,2", "99999" })
+  {
+    BOOST_CHECK_MESSAGE(!cpu_affinity::parseList(bad, cpus), bad);
+  }
+}
+
+/* 空串不绑；不允许的 CPU、不存在的节点都报错 */
+BOOST_AUTO_TEST_CASE(testParse)
+{
+  vector<int> cpus = { 1 };
+  BOOST_CHECK(cpu_affinity::parse("", cpus));
+  BOOST_CHECK(cpus.empty());
+  BOOST_CHECK_EQUAL(cpu_affinity::describe(cpus), "unpinned");
+
+  vector<int> allowed = cpu_affinity::current();
+  BOOST_REQUIRE(!allowed.empty());
+  string first = to_string(allowed.front());
+  BOOST_CHECK(cpu_affinity::parse(first + "," + first, cpus));
+  BOOST_CHECK(cpus == vector<int>(1, allowed.front()));
+
+  BOOST_CHECK(!cpu_affinity::parse(to_string(CPU_SETSIZE - 1), cpus));
+  BOOST_CHECK(!cpu_affinity::parse("node:" + to_string(cpu_affinity::nodeCount()), cpus));
+  BOOST_CHECK(!cpu_affinity::parse("node:x", cpus));
+
+  BOOST_CHECK(cpu_affinity::parse("node:" + to_string(cpu_affinity::nodeOf(allowed.front())), cpus));
+  BOOST_CHECK(find(cpus.begin(), cpus.end(), allowed.front()) != cpus.end());
+}
+
+/* 绑定只影响调用线程 */
+BOOST_AUTO_TEST_CASE(testPin)
+{
+  vector<int> allowed = cpu_affinity::current();
+  vector<int> one(1, allowed.back());
+  thread([&one] {
+    BOOST_CHECK(cpu_affinity::pin(one));
+    BOOST_CHECK(cpu_affinity::current() == one);
+  }).join();
+  BOOST_CHECK(cpu_affinity::current() == allowed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE ExecutorLaneTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+
+#include "../../net/Buffer.cpp"
+#include "../log.cpp"
+#include "../executor_lane.cpp"
+
+using namespace std;
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/executor_lane_unittest", 2000, 800000, 0); }
+};
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+BOOST_AUTO_TEST_SUITE (ExecutorLanetest)  // 定义 test suit 名
+
+/* 线程被占住时排到上限就拒绝，放开后排着的都会执行，统计里有排队时间 */
+BOOST_AUTO_TEST_CASE(testBound)
+{
+  executor_lane lane("blocking/db", 1, 1, 2);
+  atomic<bool> gate(false);
+  atomic<int> done(0);
+  BOOST_CHECK(lane.submit([&] {
+    while(!gate)
+    {
+      this_thread::yield();
+    }
+    done++;
+  }));
+  while(lane.depth() > 0)         // 等占住线程的任务开始
+  {
+    this_thread::yield();
+  }
+  BOOST_CHECK(lane.submit([&] { done++; }));
+  BOOST_CHECK(lane.submit([&] { done++; }));
+  BOOST_CHECK(!lane.submit([&] { done++; }));
+  BOOST_CHECK_EQUAL(lane.depth(), 2);
+
+  this_thread::sleep_for(chrono::milliseconds(20));
+  gate = true;
+  while(done < 3)
+  {
+    this_thread::yield();
+  }
+  lane_stats s = lane.takeStats();
+  BOOST_CHECK_EQUAL(s.name, "blocking/db");
+  BOOST_CHECK_EQUAL(s.threads, 1);
+  BOOST_CHECK_EQUAL(s.depth, 0);
+  BOOST_CHECK_EQUAL(s.started, 3);
+  BOOST_CHECK_EQUAL(s.rejected, 1);
+  BOOST_CHECK_GE(s.maxWaitMs, 20);
+  BOOST_CHECK_GT(s.avgWaitMs, 0);
+
+  s = lane.takeStats();           // 等待时间重新算，累计的不变
+  BOOST_CHECK_EQUAL(s.maxWaitMs, 0);
+  BOOST_CHECK_EQUAL(s.started, 3);
+}
+
+/* 不限长度的通道，直接往线程池提交的任务自己记账 */
+BOOST_AUTO_TEST_CASE(testUnbounded)
+{
+  executor_lane lane("io/static", 2, 2, 0);
+  atomic<int> done(0);
+  ThreadPool::Batch batch;
+  int64_t at = executor_lane::nowUs();
+  for(int i = 0; i < 1000; i++)
+  {
+    batch.add([&lane, &done, at] {
+      lane.finished(lane.started(at));
+      done++;
+    });
+  }
+  lane.queued(batch.size());
+  lane.pool().AddBatch(batch);
+  for(int i = 0; i < 1000; i++)
+  {
+    BOOST_CHECK(lane.submit([&done] { done++; }));
+  }
+  while(done < 2000)
+  {
+    this_thread::yield();
+  }
+  lane_stats s = lane.takeStats();
+  BOOST_CHECK_EQUAL(s.started, 2000);
+  BOOST_CHECK_EQUAL(s.depth, 0);
+  BOOST_CHECK_EQUAL(s.rejected, 0);
+}
+
+/* 任务阻塞（睡眠不占 CPU）又排队时扩容，空闲几个周期后缩回下限 */
+BOOST_AUTO_TEST_CASE(testAdapt)
+{
+  executor_lane lane("blocking/db", 1, 4, 0);
+  atomic<int> done(0);
+  for(int i = 0; i < 40; i++)
+  {
+    lane.submit([&done] {
+      this_thread::sleep_for(chrono::milliseconds(5));
+      done++;
+    });
+  }
+  this_thread::sleep_for(chrono::milliseconds(50));
+  BOOST_CHECK(lane.adapt(5));
+  lane_stats s = lane.takeStats();
+  BOOST_CHECK_EQUAL(s.threads, 2);
+  BOOST_CHECK_EQUAL(s.minThreads, 1);
+  BOOST_CHECK_EQUAL(s.maxThreads, 4);
+  BOOST_CHECK_EQUAL(s.resizes, 1);
+  BOOST_CHECK_GT(s.utilization, 0.75);
+  BOOST_CHECK_GT(s.blocked, 0.5);
+
+  while(done < 40)
+  {
+    this_thread::yield();
+  }
+  lane.adapt(5);                  // 排空的这个周期可能还在扩容
+  size_t threads = lane.pool().threadCount();
+  BOOST_REQUIRE_GT(threads, 1);
+  for(int round = 1; threads > 1; round++)
+  {
+    this_thread::sleep_for(chrono::milliseconds(10));
+    bool resized = lane.adapt(5);
+    BOOST_CHECK_EQUAL(resized, round % 3 == 0);     // 每空闲三个周期减一个
+    threads -= resized;
+    BOOST_CHECK_EQUAL(lane.pool().threadCount(), threads);
+  }
+  for(int i = 0; i < 3; i++)
+  {
+    BOOST_CHECK(!lane.adapt(5));
+  }
+  BOOST_CHECK_EQUAL(lane.pool().threadCount(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE LruCacheTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+
+#include "../lru_cache.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE (LruCachetest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testGetPut)
+{
+  lru_cache<int> cache(16, 60000, 4);
+  int v = 0;
+  BOOST_CHECK(!cache.get("a", v));
+  cache.put("a", 1);
+  cache.put("a", 2);                      // 覆盖
+  BOOST_CHECK(cache.get("a", v));
+  BOOST_CHECK_EQUAL(v, 2);
+  cache.erase("a");
+  BOOST_CHECK(!cache.get("a", v));
+
+  lru_stats s = cache.getStats();
+  BOOST_CHECK_EQUAL(s.hits, 1);
+  BOOST_CHECK_EQUAL(s.misses, 2);
+  BOOST_CHECK_EQUAL(s.size, 0);
+}
+
+BOOST_AUTO_TEST_CASE(testEvict)
+{
+  lru_cache<int> cache(3, 60000, 1);      // 只有一片，淘汰顺序确定
+  int v = 0;
+  cache.put("a", 1);
+  cache.put("b", 2);
+  cache.put("c", 3);
+  BOOST_CHECK(cache.get("a", v));         // a 变为最近使用
+  cache.put("d", 4);                      // 淘汰 b
+  BOOST_CHECK(!cache.get("b", v));
+  BOOST_CHECK(cache.get("a", v) && cache.get("c", v) && cache.get("d", v));
+  BOOST_CHECK_EQUAL(cache.getStats().evictions, 1);
+  BOOST_CHECK_EQUAL(cache.getStats().size, 3);
+}
+
+BOOST_AUTO_TEST_CASE(testExpire)
+{
+  lru_cache<int> cache(16, 20);
+  int v = 0;
+  cache.put("a", 1);
+  BOOST_CHECK(cache.get("a", v));
+  this_thread::sleep_for(chrono::milliseconds(30));
+  BOOST_CHECK(!cache.get("a", v));
+  BOOST_CHECK_EQUAL(cache.getStats().expired, 1);
+  BOOST_CHECK_EQUAL(cache.getStats().size, 0);
+}
+
+BOOST_AUTO_TEST_CASE(testDisabled)
+{
+  lru_cache<int> cache;                   // 容量为 0
+  int v = 0;
+  cache.put("a", 1);
+  BOOST_CHECK(!cache.get("a", v));
+  cache.reset(8, 60000);
+  cache.put("a", 1);
+  BOOST_CHECK(cache.get("a", v));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,178 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE SingleFlightTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <deque>
+#include <stdexcept>
+
+#include "../single_flight.h"
+
+using namespace std;
+
+/* 单线程的调度者：post 的回调由 run 依次执行，定时器由 fireTimers 手动触发，执行顺序完全确定 */
+class manualExecutor: public co::Executor
+{
+public:
+  void post(function<void()> cb) override { m_posted.push_back(std::move(cb)); }
+  void runAfter(int ms, function<void()> cb) override { m_timers.push_back(std::move(cb)); }
+  void watch(int fd, uint32_t events, function<void()> cb) override {}
+  void unwatch(int fd) override {}
+  bool offload(function<void()> fn, const char* lane) override { fn(); return true; }
+
+  void run()
+  {
+    while(!m_posted.empty())
+    {
+      function<void()> cb = std::move(m_posted.front());
+      m_posted.pop_front();
+      cb();
+    }
+  }
+
+  void fireTimers()
+  {
+    vector<function<void()>> timers;
+    timers.swap(m_timers);
+    for(auto &cb: timers)
+    {
+      cb();
+    }
+    run();
+  }
+
+private:
+  deque<function<void()>> m_posted;
+  vector<function<void()>> m_timers;
+};
+
+struct executorFixture
+{
+  executorFixture() { co::Executor::setInstance(&executor); }
+  ~executorFixture() { co::Executor::setInstance(nullptr); }
+
+  manualExecutor executor;
+};
+
+struct outcome
+{
+  bool done = false;
+  int value = 0;
+  string error;
+};
+
+static co::Task<void> collect(co::Task<int> task, outcome &out)
+{
+  try
+  {
+    out.value = co_await task;
+  }
+  catch(const co::cancelled &)
+  {
+    out.error = "cancelled";
+  }
+  catch(const exception &e)
+  {
+    out.error = e.what();
+  }
+  out.done = true;
+}
+
+BOOST_FIXTURE_TEST_SUITE (SingleFlighttest, executorFixture)  // 定义 test suit 名
+
+/* 同一个 key 的并发调用只执行一次，都拿到结果；结束后不缓存，不同 key 互不影响 */
+BOOST_AUTO_TEST_CASE(testCoalesce)
+{
+  single_flight<int> flight;
+  int executions = 0;
+  auto fn = [&executions]() -> co::Task<int> {
+    executions++;
+    co_await co::sleep(10);
+    co_return 42;
+  };
+  outcome out[5], other;
+  for(auto &o: out)
+  {
+    co::spawn(collect(flight.run("alice", fn), o), [] {});
+  }
+  co::spawn(collect(flight.run("bob", fn), other), [] {});
+  BOOST_CHECK_EQUAL(executions, 2);
+  BOOST_CHECK(!out[0].done);
+
+  executor.fireTimers();
+  for(auto &o: out)
+  {
+    BOOST_CHECK(o.done && o.error.empty());
+    BOOST_CHECK_EQUAL(o.value, 42);
+  }
+  BOOST_CHECK(other.done && other.value == 42);
+  BOOST_CHECK_EQUAL(flight.calls(), 6);
+  BOOST_CHECK_EQUAL(flight.shared(), 4);
+
+  outcome again;
+  co::spawn(collect(flight.run("alice", fn), again), [] {});
+  BOOST_CHECK_EQUAL(executions, 3);
+  executor.fireTimers();
+  BOOST_CHECK(again.done && again.value == 42);
+}
+
+/* 领头的调用抛出异常，所有等待者收到同一个异常 */
+BOOST_AUTO_TEST_CASE(testError)
+{
+  single_flight<int> flight;
+  int executions = 0;
+  auto fn = [&executions]() -> co::Task<int> {
+    executions++;
+    co_await co::sleep(10);
+    throw runtime_error("backend down");
+  };
+  outcome out[3];
+  for(auto &o: out)
+  {
+    co::spawn(collect(flight.run("alice", fn), o), [] {});
+  }
+  executor.fireTimers();
+  BOOST_CHECK_EQUAL(executions, 1);
+  for(auto &o: out)
+  {
+    BOOST_CHECK(o.done);
+    BOOST_CHECK_EQUAL(o.error, "backend down");
+  }
+  BOOST_CHECK_EQUAL(flight.shared(), 2);
+}
+
+/* 领头者被取消时它自己收到 cancelled，等待者重新竞争，由其中一个再执行一次 */
+BOOST_AUTO_TEST_CASE(testLeaderCancelled)
+{
+  single_flight<int> flight;
+  int executions = 0;
+  auto fn = [&executions]() -> co::Task<int> {
+    executions++;
+    co_await co::sleep(10);
+    co_return 42;
+  };
+  shared_ptr<co::cancelToken> token = make_shared<co::cancelToken>();
+  outcome leader, out[2];
+  co::spawn(collect(flight.run("alice", fn), leader), [] {}, token);
+  for(auto &o: out)
+  {
+    co::spawn(collect(flight.run("alice", fn), o), [] {});
+  }
+  BOOST_CHECK_EQUAL(executions, 1);
+
+  token->cancel();
+  executor.run();
+  BOOST_CHECK(leader.done);
+  BOOST_CHECK_EQUAL(leader.error, "cancelled");
+  BOOST_CHECK_EQUAL(executions, 2);
+  BOOST_CHECK(!out[0].done && !out[1].done);
+
+  executor.fireTimers();
+  for(auto &o: out)
+  {
+    BOOST_CHECK(o.done && o.error.empty());
+    BOOST_CHECK_EQUAL(o.value, 42);
+  }
+  BOOST_CHECK_EQUAL(flight.shared(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
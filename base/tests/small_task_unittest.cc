@@ -0,0 +1,159 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE SmallTaskTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+
+#include "../thread_pool.h"
+
+using namespace std;
+
+/* 数一下全局 operator new 被调了多少次；不内联，免得编译器把 new 和 free 配对起来告警 */
+static atomic<long> g_allocs(0);
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  g_allocs.fetch_add(1, memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if(!p)
+  {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+struct fakeServer
+{
+  atomic<int> reads{0};
+  atomic<int> writes{0};
+  void onRead(int *client) { reads += *client; }
+  void onWrite() { writes++; }
+};
+
+BOOST_AUTO_TEST_SUITE (SmallTasktest)  // 定义 test suit 名
+
+/* 小的放在内部，大的放到堆上；移动之后原来的为空，捕获的对象析构恰好一次 */
+BOOST_AUTO_TEST_CASE(testStorage)
+{
+  fakeServer server;
+  int one = 1;
+  small_task read(&fakeServer::onRead, &server, &one);
+  small_task write(&fakeServer::onWrite, &server);
+  read();
+  write();
+  BOOST_CHECK_EQUAL(server.reads.load(), 1);
+  BOOST_CHECK_EQUAL(server.writes.load(), 1);
+
+  shared_ptr<int> owned = make_shared<int>(0);
+  {
+    small_task a([owned] { (*owned)++; });
+    BOOST_CHECK_EQUAL(owned.use_count(), 2);
+    small_task b(std::move(a));
+    BOOST_CHECK(!a && b);
+    BOOST_CHECK_EQUAL(owned.use_count(), 2);
+    b();
+    a = std::move(b);
+    a();
+  }
+  BOOST_CHECK_EQUAL(*owned, 2);
+  BOOST_CHECK_EQUAL(owned.use_count(), 1);
+
+  char big[64] = "large";
+  string out;
+  auto large = [big, &out] { out = big; };
+  BOOST_CHECK(!small_task::isInline<decltype(large)>());
+  long before = g_allocs;
+  small_task c(large);
+  BOOST_CHECK_EQUAL(g_allocs - before, 1);
+  small_task d(std::move(c));
+  d();
+  BOOST_CHECK_EQUAL(out, "large");
+
+  struct { char pad[40]; int *p; } captured = { "", &one };
+  auto medium = [captured] { (*captured.p)++; };
+  BOOST_CHECK(small_task::isInline<decltype(medium)>());
+  before = g_allocs;
+  small_task e(medium);
+  e();
+  BOOST_CHECK_EQUAL(g_allocs - before, 0);
+  BOOST_CHECK_EQUAL(one, 2);
+}
+
+/* 热身之后，派发 I/O 事件那样的成员函数任务和 48 字节以内的 lambda 都不再分配内存 */
+BOOST_AUTO_TEST_CASE(testNoAllocation)
+{
+  fakeServer server;
+  int client = 1;
+  ThreadPool pool(4);
+  atomic<int> done(0);
+  char pad[32] = "";
+  auto wave = [&](int n) {
+    int reads = server.reads + n, writes = server.writes + n, lambdas = done + n;
+    for(int i = 0; i < n; i++)
+    {
+      pool.AddTask(&fakeServer::onRead, &server, &client);
+      pool.AddTask(&fakeServer::onWrite, &server);
+      pool.AddTask([&done, pad] { done += 1 + pad[0]; });
+    }
+    while(server.reads < reads || server.writes < writes || done < lambdas)
+    {
+      this_thread::yield();
+    }
+  };
+  /* 热身：先把 4 个线程都堵住，一次压进两轮的任务，空闲节点和注入队列都攒够之后不会再涨 */
+  atomic<int> blocked(0);
+  atomic<bool> gate(false);
+  for(int i = 0; i < 4; i++)
+  {
+    pool.AddTask([&blocked, &gate] {
+      blocked++;
+      while(!gate)
+      {
+        this_thread::yield();
+      }
+    });
+  }
+  while(blocked < 4)
+  {
+    this_thread::yield();
+  }
+  auto submitReads = [&](int n) {
+    for(int i = 0; i < n; i++)
+    {
+      pool.AddTask(&fakeServer::onRead, &server, &client);
+    }
+  };
+  submitReads(6000);
+  gate = true;
+  while(server.reads < 6000)
+  {
+    this_thread::yield();
+  }
+  for(int i = 0; i < 10; i++)
+  {
+    wave(1000);
+  }
+  long before = g_allocs;
+  for(int i = 0; i < 100; i++)
+  {
+    wave(1000);
+  }
+  long allocs = g_allocs - before;
+  BOOST_CHECK_EQUAL(allocs, 0);
+  BOOST_CHECK_EQUAL(server.reads.load(), 116000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE SqlRouterTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <set>
+
+#include "../../net/Buffer.cpp"
+#include "../log.cpp"
+#include "../sql_router.cpp"
+
+using namespace std;
+
+/* 假的后端：不连数据库，取连接只记借出数，sql_router 只用得到这几个接口 */
+std::atomic<unsigned long> conn_pool::NextId(0);
+
+conn_pool::conn_pool(): Id(NextId++)
+{
+  this->outstanding = 0;
+}
+
+conn_pool::~conn_pool()
+{
+}
+
+conn_pool *conn_pool::GetInstance()
+{
+  static conn_pool connPool;
+  return &connPool;
+}
+
+void conn_pool::init(string ip, string User, string PassWord, string DBName, int Port, unsigned int MaxConn,
+  unsigned int MinConn, int WaitMs, int IdleMs, unsigned int LocalConn)
+{
+  this->Ip = ip;
+  this->Port = Port;
+}
+
+MYSQL *conn_pool::GetConnection(int timeoutMs)
+{
+  ++outstanding;
+  return reinterpret_cast<MYSQL *>(this);
+}
+
+bool conn_pool::ReleaseConnection(MYSQL *conn)
+{
+  --outstanding;
+  return true;
+}
+
+void conn_pool::DestroyPool()
+{
+}
+
+pool_stats conn_pool::GetStats()
+{
+  return pool_stats();
+}
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/sql_router_unittest", 2000, 800000, 0); }
+};
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+static const int EJECT_MS = 100;
+
+/* 一个主库两个副本，返回两个副本的连接池 */
+static pair<conn_pool *, conn_pool *> setup(sql_router &router)
+{
+  router.init({ "primary", "127.0.0.1", 3306 }, { { "replica1", "127.0.0.2", 3306 }, { "replica2", "127.0.0.3", 3306 } },
+    "root", "root", "db", 4, 1, 100, 0);
+  conn_pool *a = router.pick(true);
+  conn_pool *b = router.pick(true);
+  return { a, b };
+}
+
+/* 多次只读选择里出现过的库 */
+static set<conn_pool *> picked(sql_router &router, int times = 8)
+{
+  set<conn_pool *> pools;
+  for(int i = 0; i < times; i++)
+  {
+    pools.insert(router.pick(true));
+  }
+  return pools;
+}
+
+static void fail(sql_router &router, conn_pool *pool, int times)
+{
+  for(int i = 0; i < times; i++)
+  {
+    router.report(pool, false);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE (SqlRoutertest)  // 定义 test suit 名
+
+/* 写走主库；借出数相同时副本轮流，否则选借出最少的 */
+BOOST_AUTO_TEST_CASE(testLeastOutstanding)
+{
+  sql_router router(EJECT_MS);
+  auto replicas = setup(router);
+  conn_pool *primary = router.primary();
+  BOOST_CHECK(replicas.first != replicas.second);
+  BOOST_CHECK(replicas.first != primary && replicas.second != primary);
+  BOOST_CHECK_EQUAL(router.pick(false), primary);
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.first, replicas.second }));
+
+  MYSQL *conn = replicas.first->GetConnection();
+  for(int i = 0; i < 8; i++)
+  {
+    BOOST_CHECK_EQUAL(router.pick(true), replicas.second);
+  }
+  replicas.second->GetConnection();
+  replicas.second->GetConnection();
+  BOOST_CHECK_EQUAL(router.pick(true), replicas.first);
+
+  replicas.first->ReleaseConnection(conn);
+  for(int i = 0; i < 8; i++)
+  {
+    BOOST_CHECK_EQUAL(router.pick(true), replicas.first);
+  }
+}
+
+/* 连续失败 EJECT_FAILURES 次才摘除，中间成功一次就清零；副本全被摘除时读也走主库 */
+BOOST_AUTO_TEST_CASE(testEject)
+{
+  sql_router router(EJECT_MS);
+  auto replicas = setup(router);
+  fail(router, replicas.first, 2);
+  router.report(replicas.first, true);
+  fail(router, replicas.first, 2);
+  BOOST_CHECK_EQUAL(picked(router).size(), 2);
+
+  router.report(replicas.first, false);
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.second }));
+  BOOST_CHECK(router.getStats()[1].ejected);
+  BOOST_CHECK_EQUAL(router.getStats()[1].ejections, 1);
+
+  fail(router, replicas.second, 3);
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ router.primary() }));
+
+  /* 主库不摘除 */
+  fail(router, router.primary(), 10);
+  BOOST_CHECK_EQUAL(router.pick(false), router.primary());
+  BOOST_CHECK(!router.getStats()[0].ejected);
+}
+
+/* 摘除到期后重新参与选择；再失败摘除时间加倍，成功一次后恢复初始时长 */
+BOOST_AUTO_TEST_CASE(testBackoff)
+{
+  sql_router router(EJECT_MS);
+  auto replicas = setup(router);
+  fail(router, replicas.first, 3);
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.second }));
+  this_thread::sleep_for(chrono::milliseconds(EJECT_MS * 3 / 2));
+  BOOST_CHECK_EQUAL(picked(router).size(), 2);
+
+  router.report(replicas.first, false);       // 这次摘除 2 * EJECT_MS
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.second }));
+  this_thread::sleep_for(chrono::milliseconds(EJECT_MS * 3 / 2));
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.second }));
+  this_thread::sleep_for(chrono::milliseconds(EJECT_MS));
+  BOOST_CHECK_EQUAL(picked(router).size(), 2);
+  BOOST_CHECK_EQUAL(router.getStats()[1].ejections, 2);
+
+  router.report(replicas.first, true);
+  fail(router, replicas.first, 3);
+  BOOST_CHECK(picked(router) == set<conn_pool *>({ replicas.second }));
+  this_thread::sleep_for(chrono::milliseconds(EJECT_MS * 3 / 2));
+  BOOST_CHECK_EQUAL(picked(router).size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,202 @@
+/* 线程池压测：工作窃取的 ThreadPool 对比原来一把锁一个队列的线程池
+
+    g++ -std=c++20 -O2 thread_pool_bench.cc -o thread_pool_bench -pthread
+    ./thread_pool_bench [每轮任务数] [每个任务的空转纳秒数]
+
+    一个线程模拟事件循环，持续提交任务，线程数 1 到 64：逐个 AddTask（inject），
+    每 500 个攒成一批 AddBatch（batch，旧线程池没有批量提交，仍然逐个提交），任务里再提交任务（fan-out）。
+    每项输出吞吐、每个任务耗的 CPU 时间和上下文切换次数（getrusage，含所有线程），
+    锁争用和唤醒的开销主要体现在后两项上。
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <functional>
+#include <sys/resource.h>
+
+#include "../thread_pool.h"
+
+using namespace std;
+
+/* 原来的线程池，只补上了 isClosed 的初始化 */
+class mutexPool
+{
+public:
+    explicit mutexPool(size_t threadCount): m_pool(std::make_shared<Pool>())
+    {
+        for(size_t i = 0; i < threadCount; i++)
+        {
+            std::thread([pool = m_pool]
+            {
+                std::unique_lock<std::mutex> locker(pool->mtx);
+                while(true)
+                {
+                    if(!pool->tasks.empty())
+                    {
+                        auto task = std::move(pool->tasks.front());
+                        pool->tasks.pop();
+                        locker.unlock();
+                        task();
+                        locker.lock();
+                    }
+                    else if(pool->isClosed)
+                        break;
+                    else
+                        pool->cond.wait(locker);
+                }
+            }).detach();
+        }
+    }
+
+    ~mutexPool()
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_pool->mtx);
+            m_pool->isClosed = true;
+        }
+        m_pool->cond.notify_all();
+    }
+
+    template<class F>
+    void AddTask(F&& task)
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_pool->mtx);
+            m_pool->tasks.emplace(std::forward<F>(task));
+        }
+        m_pool->cond.notify_one();
+    }
+
+private:
+    struct Pool
+    {
+        std::mutex mtx;
+        std::condition_variable cond;
+        bool isClosed = false;
+        std::queue<std::function<void()>> tasks;
+    };
+    std::shared_ptr<Pool> m_pool;
+};
+
+static int g_spinNs = 200;
+static const int BATCH_EVENTS = 500;       // 相当于一次 epoll_wait 返回的就绪事件数
+
+enum MODE { INJECT, BATCH, FAN_OUT };
+static const char *MODE_NAME[] = { "inject", "batch", "fan-out" };
+
+static void work()
+{
+    chrono::steady_clock::time_point until = chrono::steady_clock::now() + chrono::nanoseconds(g_spinNs);
+    while(chrono::steady_clock::now() < until)
+    {
+    }
+}
+
+struct bench_result
+{
+    double seconds;
+    double cpuUs;
+    long switches;
+};
+
+static double cpuSeconds(const rusage &r)
+{
+    return r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1e6;
+}
+
+/* 旧线程池没有批量提交，原来的事件循环就是逐个提交 */
+static void submitBatches(mutexPool &pool, int tasks, atomic<int> &done)
+{
+    for(int i = 0; i < tasks; i++)
+    {
+        pool.AddTask([&done] { work(); done.fetch_add(1, memory_order_relaxed); });
+    }
+}
+
+static void submitBatches(ThreadPool &pool, int tasks, atomic<int> &done)
+{
+    ThreadPool::Batch batch;
+    for(int i = 0; i < tasks; i++)
+    {
+        batch.add([&done] { work(); done.fetch_add(1, memory_order_relaxed); });
+        if(batch.size() == BATCH_EVENTS)
+        {
+            pool.AddBatch(batch);
+        }
+    }
+    pool.AddBatch(batch);
+}
+
+template<class P>
+static bench_result measure(P &pool, int tasks, MODE mode)
+{
+    atomic<int> done(0);
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if(mode == FAN_OUT)
+    {
+        const int fanOut = 64;
+        for(int i = 0; i < tasks / fanOut; i++)
+        {
+            pool.AddTask([&pool, &done, fanOut] {
+                for(int j = 0; j < fanOut; j++)
+                {
+                    pool.AddTask([&done] { work(); done.fetch_add(1, memory_order_relaxed); });
+                }
+            });
+        }
+        tasks = tasks / fanOut * fanOut;
+    }
+    else if(mode == BATCH)
+    {
+        submitBatches(pool, tasks, done);
+    }
+    else
+    {
+        for(int i = 0; i < tasks; i++)
+        {
+            pool.AddTask([&done] { work(); done.fetch_add(1, memory_order_relaxed); });
+        }
+    }
+    while(done.load(memory_order_relaxed) < tasks)
+    {
+        this_thread::yield();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &after);
+    bench_result s;
+    s.seconds = seconds;
+    s.cpuUs = (cpuSeconds(after) - cpuSeconds(before)) * 1e6 / tasks;
+    s.switches = (after.ru_nvcsw + after.ru_nivcsw) - (before.ru_nvcsw + before.ru_nivcsw);
+    return s;
+}
+
+template<class P>
+static void run(const char *name, size_t threads, int tasks, MODE mode)
+{
+    P pool(threads);
+    measure(pool, tasks / 10, mode);          // 预热，让线程都起来
+    bench_result s = measure(pool, tasks, mode);
+    printf("%-14s %-8s %4zu threads  %8.0f k tasks/s  %6.2f cpu-us/task  %8ld ctx switches\n",
+        name, MODE_NAME[mode], threads, tasks / s.seconds / 1000, s.cpuUs, s.switches);
+}
+
+int main(int argc, char *argv[])
+{
+    int tasks = argc > 1 ? atoi(argv[1]) : 200000;
+    g_spinNs = argc > 2 ? atoi(argv[2]) : 200;
+    printf("%d tasks per round, %dns of work per task, %u cpus\n", tasks, g_spinNs, thread::hardware_concurrency());
+    for(MODE mode: { INJECT, BATCH, FAN_OUT })
+    {
+        for(size_t threads = 1; threads <= 64; threads *= 2)
+        {
+            run<mutexPool>("mutex queue", threads, tasks, mode);
+            run<ThreadPool>("work stealing", threads, tasks, mode);
+        }
+    }
+    return 0;
+}
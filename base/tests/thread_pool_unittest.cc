@@ -0,0 +1,169 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE ThreadPoolTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "../thread_pool.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE (ThreadPooltest)  // 定义 test suit 名
+
+/* 池外线程提交的任务每个恰好执行一次；析构时做完剩下的任务再返回 */
+BOOST_AUTO_TEST_CASE(testRunAll)
+{
+  atomic<int> done(0);
+  {
+    ThreadPool pool(4);
+    for(int i = 0; i < 100000; i++)
+    {
+      pool.AddTask([&done] { done++; });
+    }
+  }
+  BOOST_CHECK_EQUAL(done.load(), 100000);
+
+  atomic<bool> finished(false);
+  {
+    ThreadPool pool(2);
+    pool.AddTask([&finished] {
+      this_thread::sleep_for(chrono::milliseconds(50));
+      finished = true;
+    });
+  }
+  BOOST_CHECK(finished);
+}
+
+/* 任务里再提交任务（进自己的队列，靠窃取分给别的线程），层层展开后总数不差 */
+static void fanOut(ThreadPool &pool, atomic<int> &done, int depth)
+{
+  done++;
+  if(depth == 0)
+  {
+    return;
+  }
+  for(int i = 0; i < 4; i++)
+  {
+    pool.AddTask([&pool, &done, depth] { fanOut(pool, done, depth - 1); });
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testNested)
+{
+  atomic<int> done(0);
+  {
+    ThreadPool pool(8);
+    pool.AddTask([&pool, &done] { fanOut(pool, done, 7); });
+  }
+  BOOST_CHECK_EQUAL(done.load(), 21845);      // 1 + 4 + ... + 4^7
+}
+
+/* 池子空闲一阵、线程都睡下之后再提交，任务不会丢在队列里没人做 */
+BOOST_AUTO_TEST_CASE(testWakeup)
+{
+  ThreadPool pool(4);
+  for(int round = 0; round < 20; round++)
+  {
+    this_thread::sleep_for(chrono::milliseconds(round % 4 == 0 ? 20 : 0));
+    atomic<int> done(0);
+    for(int i = 0; i < round + 1; i++)
+    {
+      pool.AddTask([&done] { done++; });
+    }
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while(done < round + 1 && chrono::steady_clock::now() < deadline)
+    {
+      this_thread::yield();
+    }
+    BOOST_CHECK_EQUAL(done.load(), round + 1);
+  }
+}
+
+/* 一批任务分给几个线程的收件箱，每个恰好执行一次；Batch 交出去之后清空，可以接着用；没交出去的析构时丢掉不执行 */
+BOOST_AUTO_TEST_CASE(testBatch)
+{
+  atomic<int> done(0);
+  {
+    ThreadPool pool(4);
+    ThreadPool::Batch batch;
+    pool.AddBatch(batch);
+    for(int round = 0; round < 1000; round++)
+    {
+      for(int i = 0; i < round % 50; i++)
+      {
+        batch.add([&done] { done++; });
+      }
+      pool.AddBatch(batch);
+      BOOST_CHECK(batch.empty());
+    }
+
+    /* 工作线程里也可以交一批 */
+    pool.AddTask([&pool, &done] {
+      ThreadPool::Batch inner;
+      for(int i = 0; i < 100; i++)
+      {
+        inner.add([&done] { done++; });
+      }
+      pool.AddBatch(inner);
+    });
+  }
+  BOOST_CHECK_EQUAL(done.load(), 20 * 1225 + 100);     // 每 50 轮 0 + 1 + ... + 49
+
+  shared_ptr<int> owned = make_shared<int>(0);
+  {
+    ThreadPool::Batch dropped;
+    dropped.add([owned] { (*owned)++; });
+  }
+  BOOST_CHECK_EQUAL(owned.use_count(), 1);
+  BOOST_CHECK_EQUAL(*owned, 0);
+}
+
+/* 扩容后新线程能同时跑，缩减后停用的线程不再取新任务，提交的任务一个不丢 */
+BOOST_AUTO_TEST_CASE(testResize)
+{
+  atomic<int> done(0);
+  {
+    ThreadPool pool(1, 4, nullptr);
+    BOOST_CHECK_EQUAL(pool.threadCount(), 1);
+    BOOST_CHECK_EQUAL(pool.resize(10), 4);
+    BOOST_CHECK_EQUAL(pool.maxThreads(), 4);
+
+    atomic<int> running(0);
+    atomic<bool> gate(false);
+    for(int i = 0; i < 4; i++)
+    {
+      pool.AddTask([&] {
+        running++;
+        while(!gate)
+        {
+          this_thread::yield();
+        }
+        done++;
+      });
+    }
+    while(running < 4)
+    {
+      this_thread::yield();
+    }
+    gate = true;
+
+    BOOST_CHECK_EQUAL(pool.resize(0), 1);
+    ThreadPool::Batch batch;
+    for(int round = 0; round < 200; round++)
+    {
+      for(int i = 0; i < 50; i++)
+      {
+        batch.add([&done] { done++; });
+        pool.AddTask([&done] { done++; });
+      }
+      pool.AddBatch(batch);
+      pool.resize(round % 4 + 1);
+    }
+    BOOST_CHECK_GT(pool.cpuTimeUs(), 0);
+  }
+  BOOST_CHECK_EQUAL(done.load(), 4 + 200 * 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
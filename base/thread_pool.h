@@ -5,81 +5,745 @@
 （http_conn类）中处理读写，处理过程还需要注册修改 监听事件（这点其实不大好，有点混乱）。
 本版本的想法是把 事件循环监听事件全部放在 Server类中管理。
 
-重写的线程池 */
+重写的线程池：工作窃取
+
+    每个工作线程有一个 Chase-Lev 双端队列，自己从底部压入、弹出，别的线程从顶部窃取；
+    池外线程（事件循环）提交的任务进全局注入队列，工作线程一次从里面取一批，剩下的放进自己的队列供别人窃取，
+    一把全局锁不再每个任务都争一次。
+    - 工作线程里提交的任务直接进自己的队列，满了才进全局队列
+    - 没活干时先自旋（最多一半的线程自旋）再睡在条件变量上；提交任务时只有在有线程睡着、
+      又没有线程在自旋时才去唤醒，空闲时不会每个任务一次 futex
+    - 析构时把已提交的任务做完再 join 所有工作线程
+    - 事件循环一轮的就绪事件先攒进 Batch，再 AddBatch 一次交出去：按每份至少 BATCH_SHARE 个分给几个线程的收件箱，
+      每份拿一次锁，只唤醒需要的线程数（不超过 CPU 数）；收件箱别的线程也能来取，被唤醒的不一定是收件人
+    - 任务是 small_task，放在可复用的节点里：每个线程手上留一小把空节点，不够了从全局一次拿一批、
+      多了还回去一批，稳定之后派发任务不再分配内存；AddTask 的参数直接在节点里构造任务
+    - 构造时可以给一个 onStart(i)，工作线程先调用它（绑 CPU），再自己分配、写一遍第一批任务节点
+    - 线程数可以在 [最少, 最多] 之间调整（resize）：按最多的数目建好各线程的队列，线程用到时才启动；
+      缩减时编号靠后的线程做完自己手上的任务后停用，睡在另一个条件变量上，再扩容时直接唤醒
+*/
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <vector>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <functional>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <assert.h>
 
-class ThreadPool 
+#include "small_task.h"
+
+class ThreadPool
 {
 public:
-    explicit ThreadPool(size_t threadCount = 8): m_pool(std::make_shared<Pool>()) 
+    typedef small_task Task;
+
+    explicit ThreadPool(size_t threadCount = 8): ThreadPool(threadCount, threadCount, nullptr) {}
+
+    ThreadPool(size_t threadCount, std::function<void(size_t)> onStart):
+        ThreadPool(threadCount, threadCount, std::move(onStart)) {}
+
+    /* 先起 minThreads 个线程，resize 最多到 maxThreads 个。
+        onStart(i) 在第 i 个工作线程里、取任务之前调用，用来绑 CPU；之后线程才分配自己的任务节点 */
+    ThreadPool(size_t minThreads, size_t maxThreads, std::function<void(size_t)> onStart):
+        m_pool(std::make_shared<Pool>(maxThreads, std::move(onStart))), m_minThreads(minThreads)
     {
-        assert(threadCount > 0);
-        for(size_t i = 0; i < threadCount; i++) 
-        {
-            std::thread([pool = m_pool] 
-            {
-                std::unique_lock<std::mutex> locker(pool->mtx);
-                while(true) 
-                {
-                    if(!pool->tasks.empty()) 
-                    {
-                        auto task = std::move(pool->tasks.front());
-                        pool->tasks.pop();
-                        locker.unlock();
-                        task();
-                        locker.lock();
-                    } 
-                    else if(pool->isClosed) 
-                        break;
-                    else 
-                        pool->cond.wait(locker);
-                }
-            }).detach();
-        }
+        assert(minThreads > 0 && minThreads <= maxThreads);
+        resize(minThreads);
     }
 
     ThreadPool() = default;
 
     ThreadPool(ThreadPool&&) = default;
-    
-    ~ThreadPool() 
+
+    ~ThreadPool()
     {
-        if(static_cast<bool>(m_pool)) 
+        if(static_cast<bool>(m_pool))
         {
             {
                 std::lock_guard<std::mutex> locker(m_pool->mtx);
                 m_pool->isClosed = true;
             }
             m_pool->cond.notify_all();
+            m_pool->retiredCond.notify_all();
+            for(std::thread &t: m_pool->threads)
+            {
+                t.join();
+            }
         }
     }
 
-    template<class F>
-    void AddTask(F&& task) 
+    /* 参数同 small_task 的构造函数：可调用对象，或者成员函数、对象（和一个参数） */
+    template<class... Args>
+    void AddTask(Args&&... args)
+    {
+        m_pool->push(make(std::forward<Args>(args)...));
+    }
+
+    /* 一批任务，add 的参数同 AddTask；交给 AddBatch 之后清空，可以反复用，不再分配内存 */
+    class Batch
     {
+    public:
+        Batch() = default;
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        ~Batch()
+        {
+            for(Task *task: m_tasks)
+            {
+                finish(task);
+            }
+        }
+
+        template<class... Args>
+        void add(Args&&... args)
+        {
+            m_tasks.push_back(nullptr);
+            try
+            {
+                m_tasks.back() = make(std::forward<Args>(args)...);
+            }
+            catch(...)
+            {
+                m_tasks.pop_back();
+                throw;
+            }
+        }
+
+        size_t size() const { return m_tasks.size(); }
+        bool empty() const { return m_tasks.empty(); }
+
+    private:
+        friend class ThreadPool;
+        std::vector<Task *> m_tasks;
+    };
+
+    void AddBatch(Batch &batch)
+    {
+        m_pool->push(batch.m_tasks);
+        batch.m_tasks.clear();
+    }
+
+    /* 在用的线程数 */
+    size_t threadCount() const { return m_pool ? m_pool->active.load(std::memory_order_relaxed) : 0; }
+    size_t minThreads() const { return m_minThreads; }
+    size_t maxThreads() const { return m_pool ? m_pool->workers.size() : 0; }
+
+    /* 调整在用的线程数，限制在 [minThreads, maxThreads] 内，返回调整后的数目；同一时间只能有一个线程调用 */
+    size_t resize(size_t n)
+    {
+        n = n < m_minThreads ? m_minThreads : n;
+        n = n < m_pool->workers.size() ? n : m_pool->workers.size();
         {
             std::lock_guard<std::mutex> locker(m_pool->mtx);
-            m_pool->tasks.emplace(std::forward<F>(task));
+            m_pool->active.store(n, std::memory_order_seq_cst);
+            for(size_t i = m_pool->threads.size(); i < n; i++)
+            {
+                m_pool->started.store(i + 1, std::memory_order_release);    // 新线程一起来就要能看到自己
+                m_pool->threads.emplace_back([pool = m_pool.get(), i] {
+                    if(pool->onStart)
+                    {
+                        pool->onStart(i);
+                    }
+                    TaskCache::warm();
+                    pool->run(i);
+                });
+            }
         }
-        m_pool->cond.notify_one();
+        m_pool->cond.notify_all();          // 缩减时叫醒要停用的线程，做完手上的再去睡
+        m_pool->retiredCond.notify_all();
+        return n;
     }
 
+    /* 已启动的各线程（含停用的）累计用掉的 CPU 时间，和任务的执行时间对比可以看出任务是不是在阻塞；
+        与 resize 在同一个线程调用 */
+    int64_t cpuTimeUs() const
+    {
+        int64_t total = 0;
+        for(const std::thread &t: m_pool->threads)
+        {
+            clockid_t clock;
+            timespec ts;
+            if(pthread_getcpuclockid(const_cast<std::thread &>(t).native_handle(), &clock) == 0
+                && clock_gettime(clock, &ts) == 0)
+            {
+                total += static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+            }
+        }
+        return total;
+    }
+
+    /* 池外线程（事件循环）绑好 CPU 后调用，让它提交任务用的节点也分配在本地 */
+    static void warmThread() { TaskCache::warm(); }
+
 private:
-    struct Pool 
+    /* Chase-Lev 双端队列（Lê 等人 2013 年的 C11 内存序版本），容量固定，满了 push 返回 false */
+    class WorkDeque
+    {
+    public:
+        static const int64_t CAPACITY = 256;
+
+        WorkDeque(): m_top(0), m_bottom(0)
+        {
+            for(int64_t i = 0; i < CAPACITY; i++)
+            {
+                m_slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        /* 只能由所属线程调用 */
+        bool push(Task *task)
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            if(b - t >= CAPACITY)
+            {
+                return false;
+            }
+            m_slots[b & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* 只能由所属线程调用 */
+        Task *pop()
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            if(t > b)
+            {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task *task = m_slots[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if(t == b)      // 最后一个，和窃取的线程抢
+            {
+                if(!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    task = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        /* 任意线程调用；和别人抢输了也返回 nullptr */
+        Task *steal()
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if(t >= b)
+            {
+                return nullptr;
+            }
+            Task *task = m_slots[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            if(!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return task;
+        }
+
+        bool empty() const
+        {
+            return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> m_top;
+        alignas(64) std::atomic<int64_t> m_bottom;
+        std::atomic<Task *> m_slots[CAPACITY];
+    };
+
+    /* 全局注入队列：环形缓冲区，满了翻倍，之后不再分配内存（std::deque 隔几十个元素就分配、释放一块） */
+    class TaskRing
+    {
+    public:
+        TaskRing(): m_slots(64), m_head(0), m_size(0) {}
+
+        void push_back(Task *task)
+        {
+            if(m_size == m_slots.size())
+            {
+                std::vector<Task *> slots(m_slots.size() * 2);
+                for(size_t i = 0; i < m_size; i++)
+                {
+                    slots[i] = m_slots[(m_head + i) % m_slots.size()];
+                }
+                m_slots.swap(slots);
+                m_head = 0;
+            }
+            m_slots[(m_head + m_size++) % m_slots.size()] = task;
+        }
+
+        Task *pop_front()
+        {
+            Task *task = m_slots[m_head];
+            m_head = (m_head + 1) % m_slots.size();
+            m_size--;
+            return task;
+        }
+
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+
+    private:
+        std::vector<Task *> m_slots;
+        size_t m_head;
+        size_t m_size;
+    };
+
+    /* 任务节点（放 Task 的内存）的缓存，所有线程池共用。
+        每个线程有一个最多 MAGAZINE 个空节点的弹匣，取空了从全局空闲表拿一批，满了还回去一批，
+        全局的锁分摊到一批节点上；全局也没有了才一次分配 CHUNK 个。节点不还给系统 */
+    class TaskCache
+    {
+    public:
+        static void *get()
+        {
+            Magazine &m = t_magazine;
+            if(m.count == 0)
+            {
+                global().refill(m);
+            }
+            return m.nodes[--m.count];
+        }
+
+        static void put(void *node)
+        {
+            Magazine &m = t_magazine;
+            if(m.count == MAGAZINE)
+            {
+                global().flush(m, MAGAZINE / 2);
+            }
+            m.nodes[m.count++] = static_cast<Node *>(node);
+        }
+
+        /* 调用线程新分配一块节点自己先写一遍，页落在线程当前所在的 NUMA 节点上，先装满半个弹匣 */
+        static void warm()
+        {
+            Magazine &m = t_magazine;
+            Node *chunk = new Node[CHUNK];
+            memset(static_cast<void *>(chunk), 0, sizeof(Node) * CHUNK);
+            size_t i = 0;
+            for(; i < CHUNK && m.count < MAGAZINE / 2; i++)
+            {
+                m.nodes[m.count++] = chunk + i;
+            }
+            if(i < CHUNK)
+            {
+                Global &g = global();
+                std::lock_guard<std::mutex> locker(g.mtx);
+                for(; i < CHUNK; i++)
+                {
+                    g.free.push_back(chunk + i);
+                }
+            }
+        }
+
+    private:
+        static const size_t MAGAZINE = 64;
+        static const size_t CHUNK = 64;
+
+        struct Node
+        {
+            alignas(Task) unsigned char bytes[sizeof(Task)];
+        };
+
+        struct Global;
+        struct Magazine
+        {
+            Node *nodes[MAGAZINE];
+            size_t count;
+
+            Magazine(): count(0) {}
+            ~Magazine() { global().flush(*this, count); }   // 线程退出时全还回去
+        };
+
+        struct Global
+        {
+            std::mutex mtx;
+            std::vector<Node *> free;
+
+            void refill(Magazine &m)
+            {
+                std::lock_guard<std::mutex> locker(mtx);
+                if(free.empty())
+                {
+                    Node *chunk = new Node[CHUNK];
+                    for(size_t i = 0; i < CHUNK; i++)
+                    {
+                        free.push_back(chunk + i);
+                    }
+                }
+                while(m.count < MAGAZINE / 2 && !free.empty())
+                {
+                    m.nodes[m.count++] = free.back();
+                    free.pop_back();
+                }
+            }
+
+            void flush(Magazine &m, size_t n)
+            {
+                std::lock_guard<std::mutex> locker(mtx);
+                for(; n > 0; n--)
+                {
+                    free.push_back(m.nodes[--m.count]);
+                }
+            }
+        };
+
+        /* 不析构：退出时别的线程可能还在还节点；节点一直能从这里找到，也不算泄漏 */
+        static Global &global()
+        {
+            static Global *g = new Global();
+            return *g;
+        }
+
+        static inline thread_local Magazine t_magazine;
+    };
+
+    template<class... Args>
+    static Task *make(Args&&... args)
+    {
+        void *node = TaskCache::get();
+        try
+        {
+            return new (node) Task(std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            TaskCache::put(node);
+            throw;
+        }
+    }
+
+    static void finish(Task *task)
+    {
+        task->~Task();
+        TaskCache::put(task);
+    }
+
+    static const int SPIN_ROUNDS = 64;     // 停下睡觉前找活的轮数
+    static const size_t INJECT_BATCH = 32; // 一次从全局队列、别人的收件箱最多取多少个
+    static const size_t BATCH_SHARE = 4;   // AddBatch 每个线程至少分几个
+
+    /* 加锁的任务队列，count 是长度，不拿锁先看一眼 */
+    struct LockedRing
     {
         std::mutex mtx;
+        TaskRing ring;
+        std::atomic<size_t> count{0};
+    };
+
+    struct Worker
+    {
+        WorkDeque deque;            // 只有自己能放进去
+        LockedRing inbox;           // AddBatch 分来的
+    };
+
+    struct Pool
+    {
+        Pool(size_t maxThreads, std::function<void(size_t)> start): workers(maxThreads), onStart(std::move(start)),
+            isClosed(false), sleeping(0), spinning(0), active(0), started(0), cursor(0)
+        {
+            cpus = std::thread::hardware_concurrency();
+            cpus = cpus > 0 ? cpus : 1;
+            for(std::unique_ptr<Worker> &w: workers)
+            {
+                w.reset(new Worker());
+            }
+        }
+
+        ~Pool()
+        {
+            while(!inject.ring.empty())
+            {
+                finish(inject.ring.pop_front());
+            }
+            for(std::unique_ptr<Worker> &w: workers)
+            {
+                while(!w->inbox.ring.empty())
+                {
+                    finish(w->inbox.ring.pop_front());
+                }
+            }
+        }
+
+        void push(Task *task)
+        {
+            if(t_current.pool != this || !workers[t_current.index]->deque.push(task))
+            {
+                std::lock_guard<std::mutex> locker(inject.mtx);
+                inject.ring.push_back(task);
+                inject.count.fetch_add(1, std::memory_order_relaxed);
+            }
+            wake(1);
+        }
+
+        /* 分成几份放进连续几个线程的收件箱，每份拿一次锁 */
+        void push(const std::vector<Task *> &tasks)
+        {
+            size_t n = tasks.size();
+            size_t count = active.load(std::memory_order_relaxed);
+            size_t parts = (n + BATCH_SHARE - 1) / BATCH_SHARE;
+            parts = parts < count ? parts : count;
+            parts = parts < cpus ? parts : cpus;        // 叫醒的线程比 CPU 多也不能同时跑
+            size_t start = cursor.fetch_add(parts, std::memory_order_relaxed);
+            for(size_t p = 0, begin = 0; p < parts; p++)
+            {
+                size_t end = n * (p + 1) / parts;
+                LockedRing &inbox = workers[(start + p) % count]->inbox;
+                std::lock_guard<std::mutex> locker(inbox.mtx);
+                for(size_t i = begin; i < end; i++)
+                {
+                    inbox.ring.push_back(tasks[i]);
+                }
+                inbox.count.fetch_add(end - begin, std::memory_order_relaxed);
+                begin = end;
+            }
+            if(parts > 0)
+            {
+                wake(parts);
+            }
+        }
+
+        /* 唤醒 n 个线程，自旋的线程先算进去。
+            和 park 里的 sleeping++、再检查一遍配对：两边都是 seq_cst，要么这里看到有人睡了，要么对方看到新任务 */
+        void wake(size_t n)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int need = static_cast<int>(n) - spinning.load(std::memory_order_relaxed);
+            int asleep = sleeping.load(std::memory_order_relaxed);
+            need = need < asleep ? need : asleep;
+            if(need > 0)
+            {
+                std::lock_guard<std::mutex> locker(mtx);
+                for(int i = 0; i < need; i++)
+                {
+                    cond.notify_one();
+                }
+            }
+        }
+
+        bool hasWork() const
+        {
+            if(inject.count.load(std::memory_order_relaxed) > 0)
+            {
+                return true;
+            }
+            for(size_t i = 0, n = started.load(std::memory_order_acquire); i < n; i++)
+            {
+                if(!workers[i]->deque.empty() || workers[i]->inbox.count.load(std::memory_order_relaxed) > 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /* 从加锁的队列里取 size / divisor + 1 个（最多 limit 个），第一个返回，其余放进自己的队列 */
+        Task *take(LockedRing &q, size_t self, size_t divisor, size_t limit)
+        {
+            if(q.count.load(std::memory_order_relaxed) == 0)
+            {
+                return nullptr;
+            }
+            std::lock_guard<std::mutex> locker(q.mtx);
+            if(q.ring.empty())
+            {
+                return nullptr;
+            }
+            size_t n = q.ring.size() / divisor + 1;
+            n = n < q.ring.size() ? n : q.ring.size();
+            n = n < limit ? n : limit;
+            Task *task = q.ring.pop_front();
+            size_t taken = 1;
+            for(; taken < n; taken++)
+            {
+                Task *more = q.ring.pop_front();
+                if(!workers[self]->deque.push(more))
+                {
+                    q.ring.push_back(more);     // 自己的队列满了，放回队尾
+                    break;
+                }
+            }
+            q.count.fetch_sub(taken, std::memory_order_relaxed);
+            return task;
+        }
+
+        /* 先窃取别人的双端队列，都空了再去别人的收件箱拿一半；停用的线程剩下的也会被拿走 */
+        Task *stealFrom(size_t self, uint32_t &seed)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            size_t n = started.load(std::memory_order_acquire);
+            for(size_t i = 0, start = seed % n; i < 2 * n; i++)
+            {
+                size_t victim = (start + i) % n;
+                Task *task = nullptr;
+                if(victim != self)
+                {
+                    task = i < n ? workers[victim]->deque.steal() : take(workers[victim]->inbox, self, 2, INJECT_BATCH);
+                }
+                if(task)
+                {
+                    return task;
+                }
+            }
+            return nullptr;
+        }
+
+        Task *next(size_t self, uint32_t &seed)
+        {
+            Task *task = workers[self]->deque.pop();
+            if(!task)
+            {
+                task = take(workers[self]->inbox, self, 1, WorkDeque::CAPACITY);
+            }
+            if(!task && self >= active.load(std::memory_order_relaxed))
+            {
+                return nullptr;         // 停用的线程只做完自己手上的
+            }
+            if(!task)
+            {
+                task = take(inject, self, active.load(std::memory_order_relaxed), INJECT_BATCH);
+            }
+            if(!task)
+            {
+                task = stealFrom(self, seed);
+            }
+            return task;
+        }
+
+        /* 停用的线程睡到重新启用或关闭；关闭时返回 false */
+        bool retire(size_t self)
+        {
+            std::unique_lock<std::mutex> locker(mtx);
+            while(self >= active.load(std::memory_order_relaxed) && !isClosed)
+            {
+                retiredCond.wait(locker);
+            }
+            return !isClosed;
+        }
+
+        /* 睡到有新任务或关闭；关闭且没有任务时返回 false */
+        bool park(size_t self)
+        {
+            std::unique_lock<std::mutex> locker(mtx);
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while(!hasWork() && !isClosed && self < active.load(std::memory_order_relaxed))
+            {
+                cond.wait(locker);
+            }
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            return !isClosed || hasWork();
+        }
+
+        void run(size_t self)
+        {
+            t_current.pool = this;
+            t_current.index = self;
+            uint32_t seed = static_cast<uint32_t>(self) * 2654435761u + 1;
+            int idle = 0;
+            bool spinner = false;
+            while(true)
+            {
+                Task *task = next(self, seed);
+                if(task)
+                {
+                    if(spinner)     // 找到活的自旋线程可能是最后一个，剩下的活要有人接
+                    {
+                        spinner = false;
+                        spinning.fetch_sub(1, std::memory_order_seq_cst);
+                        if(hasWork())
+                        {
+                            wake(1);
+                        }
+                    }
+                    idle = 0;
+                    (*task)();
+                    finish(task);
+                    continue;
+                }
+                if(!spinner && idle == 0 && self < active.load(std::memory_order_relaxed)
+                    && spinning.load(std::memory_order_relaxed) * 2 < static_cast<int>(active.load(std::memory_order_relaxed)))
+                {
+                    spinner = true;
+                    spinning.fetch_add(1, std::memory_order_seq_cst);
+                }
+                if(spinner && ++idle < SPIN_ROUNDS)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if(spinner)
+                {
+                    spinner = false;
+                    spinning.fetch_sub(1, std::memory_order_seq_cst);
+                }
+                idle = 0;
+                if(self >= active.load(std::memory_order_relaxed))
+                {
+                    if(!retire(self))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                if(!park(self))
+                {
+                    break;
+                }
+                if(self < active.load(std::memory_order_relaxed)
+                    && spinning.load(std::memory_order_relaxed) * 2 < static_cast<int>(active.load(std::memory_order_relaxed)))
+                {
+                    spinner = true;     // 被唤醒的线程找到活后接着唤醒下一个，一批任务能铺到所有线程
+                    spinning.fetch_add(1, std::memory_order_seq_cst);
+                }
+            }
+            t_current.pool = nullptr;
+        }
+
+        std::vector<std::unique_ptr<Worker>> workers;   // 按最多的线程数建好
+        std::vector<std::thread> threads;               // 已启动的，只在 resize、析构时改
+        std::function<void(size_t)> onStart;
+
+        std::mutex mtx;                     // 睡眠和关闭
         std::condition_variable cond;
+        std::condition_variable retiredCond;    // 停用的线程睡在这里
         bool isClosed;
-        std::queue<std::function<void()>> tasks;
+        std::atomic<int> sleeping;
+        std::atomic<int> spinning;
+        std::atomic<size_t> active;             // 编号小于它的线程在用
+        std::atomic<size_t> started;            // 已启动的线程数，只增不减
+
+        LockedRing inject;                  // 池外线程 AddTask 的任务
+        std::atomic<size_t> cursor;         // AddBatch 下一份从哪个线程分起
+        size_t cpus;
     };
+
+    struct CurrentWorker
+    {
+        Pool *pool;
+        size_t index;
+    };
+    static inline thread_local CurrentWorker t_current = { nullptr, 0 };
+
     std::shared_ptr<Pool> m_pool;
+    size_t m_minThreads = 0;
 };
 
 
-#endif
\ No newline at end of file
+#endif
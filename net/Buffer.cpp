@@ -117,6 +117,13 @@ void net::Buffer::retrieveAll()
     write_Index = 0;
 }
 
+/* 撤销最后写入的 len 个字节，调整写指针位置 */
+void net::Buffer::unwrite(size_t len)
+{
+    assert(len <= readableBytes());
+    write_Index -= len;
+}
+
 /* 以string格式返回缓冲区的所有可读数据 */
 std::string net::Buffer::retrieveAllAsString()
 {
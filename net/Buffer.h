@@ -64,6 +64,7 @@ public:
     void retrieveUntil(const char* end);
 
     void retrieveAll();
+    void unwrite(size_t len);       // 撤销最后写入的 len 个字节
     std::string retrieveAllAsString();
     std::string retrievetoString(size_t len);
 
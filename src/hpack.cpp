@@ -0,0 +1,483 @@
+#include "hpack.h"
+
+using namespace std;
+
+/* RFC 7541 附录 A 的静态表，下标从 1 开始 */
+static const char* STATIC_TABLE[][2] = {
+    { "", "" },
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+/* RFC 7541 附录 B 的 Huffman 编码表：下标为符号（256 为 EOS），值为 {编码, 位数} */
+static const struct { uint32_t code; uint8_t bits; } HUFFMAN_CODE[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+const size_t hpackTable::STATIC_SIZE;
+
+hpackTable::hpackTable(size_t maxSize): m_size(0), m_maxSize(maxSize)
+{
+}
+
+bool hpackTable::get(size_t index, string& name, string& value) const
+{
+    if(index == 0) {
+        return false;
+    }
+    if(index <= STATIC_SIZE) {
+        name = STATIC_TABLE[index][0];
+        value = STATIC_TABLE[index][1];
+        return true;
+    }
+    index -= STATIC_SIZE + 1;
+    if(index >= m_dynamic.size()) {
+        return false;
+    }
+    name = m_dynamic[index].first;
+    value = m_dynamic[index].second;
+    return true;
+}
+
+/* 条目大小 = 名字长度 + 值长度 + 32 */
+void hpackTable::add(const string& name, const string& value)
+{
+    size_t entry = name.size() + value.size() + 32;
+    if(entry > m_maxSize) {         // 比整个表还大：清空表，条目本身不入表
+        evict(0);
+        return;
+    }
+    evict(m_maxSize - entry);
+    m_dynamic.emplace_front(name, value);
+    m_size += entry;
+}
+
+void hpackTable::setMaxSize(size_t maxSize)
+{
+    m_maxSize = maxSize;
+    evict(maxSize);
+}
+
+void hpackTable::evict(size_t limit)
+{
+    while(m_size > limit && !m_dynamic.empty()) {
+        m_size -= m_dynamic.back().first.size() + m_dynamic.back().second.size() + 32;
+        m_dynamic.pop_back();
+    }
+}
+
+size_t hpackTable::find(const string& name, const string& value, size_t& nameIndex) const
+{
+    nameIndex = 0;
+    for(size_t i = 1; i <= STATIC_SIZE; i++) {
+        if(name == STATIC_TABLE[i][0]) {
+            if(value == STATIC_TABLE[i][1]) {
+                return i;
+            }
+            if(nameIndex == 0) {
+                nameIndex = i;
+            }
+        }
+    }
+    for(size_t i = 0; i < m_dynamic.size(); i++) {
+        if(m_dynamic[i].first == name) {
+            if(m_dynamic[i].second == value) {
+                return i + STATIC_SIZE + 1;
+            }
+            if(nameIndex == 0) {
+                nameIndex = i + STATIC_SIZE + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/* 头部块的解码 */
+bool hpackDecoder::decode(const uint8_t* data, size_t len, HeaderList& headers)
+{
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    bool headerSeen = false;
+    size_t listSize = 0;        // 每个字段按 名字 + 值 + 32 字节计
+    m_listTooLarge = false;
+    while(p < end) {
+        uint8_t b = *p;
+        uint64_t index = 0;
+        string name, value;
+        if(b & 0x80) {                          // 1xxxxxxx 索引
+            if(!hpack::decodeInteger(p, end, 7, index) || !m_table.get(index, name, value)) {
+                return false;
+            }
+            listSize += name.size() + value.size() + 32;
+            if(m_maxListSize > 0 && listSize > m_maxListSize) {   // 索引只占一两个字节，不限制时很小的块也能解出巨大的列表
+                m_listTooLarge = true;
+                return false;
+            }
+            headers.emplace_back(name, value);
+            headerSeen = true;
+            continue;
+        }
+        if((b & 0xe0) == 0x20) {                // 001xxxxx 动态表大小更新，只能出现在头部块开头
+            if(headerSeen || !hpack::decodeInteger(p, end, 5, index) || index > m_limit) {
+                return false;
+            }
+            m_table.setMaxSize(index);
+            continue;
+        }
+        bool indexing = (b & 0xc0) == 0x40;     // 01xxxxxx 增量索引；0000xxxx / 0001xxxx 不索引
+        if(!hpack::decodeInteger(p, end, indexing ? 6 : 4, index)) {
+            return false;
+        }
+        if(index > 0) {
+            string ignored;
+            if(!m_table.get(index, name, ignored)) {
+                return false;
+            }
+        }
+        else if(!readString(p, end, name)) {
+            return false;
+        }
+        if(!readString(p, end, value)) {
+            return false;
+        }
+        if(indexing) {
+            m_table.add(name, value);
+        }
+        listSize += name.size() + value.size() + 32;
+        if(m_maxListSize > 0 && listSize > m_maxListSize) {
+            m_listTooLarge = true;
+            return false;
+        }
+        headers.emplace_back(name, value);
+        headerSeen = true;
+    }
+    return true;
+}
+
+bool hpackDecoder::readString(const uint8_t*& p, const uint8_t* end, string& out)
+{
+    if(p >= end) {
+        return false;
+    }
+    bool huffman = (*p & 0x80) != 0;
+    uint64_t len = 0;
+    if(!hpack::decodeInteger(p, end, 7, len) || len > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    if(huffman) {
+        if(!hpack::huffmanDecode(p, len, out)) {
+            return false;
+        }
+    }
+    else {
+        out.assign(reinterpret_cast<const char*>(p), len);
+    }
+    p += len;
+    return true;
+}
+
+
+void hpackEncoder::setMaxTableSize(size_t maxSize)
+{
+    maxSize = std::min<size_t>(maxSize, 4096);     // 编码端自己不需要更大的表
+    if(maxSize != m_table.maxSize()) {
+        m_table.setMaxSize(maxSize);
+        m_pendingSize = maxSize;
+    }
+}
+
+void hpackEncoder::encode(const HeaderList& headers, Buffer& out)
+{
+    if(m_pendingSize >= 0) {
+        hpack::encodeInteger(m_pendingSize, 5, 0x20, out);
+        m_pendingSize = -1;
+    }
+    for(auto& header: headers) {
+        size_t nameIndex = 0;
+        size_t index = m_table.find(header.first, header.second, nameIndex);
+        if(index > 0) {
+            hpack::encodeInteger(index, 7, 0x80, out);
+            continue;
+        }
+        bool indexing = header.first != "content-length";      // 每次都不同的值入表只会挤掉有用的条目
+        hpack::encodeInteger(nameIndex, indexing ? 6 : 4, indexing ? 0x40 : 0x00, out);
+        if(nameIndex == 0) {
+            writeString(header.first, out);
+        }
+        writeString(header.second, out);
+        if(indexing) {
+            m_table.add(header.first, header.second);
+        }
+    }
+}
+
+/* Huffman 编码更短时才用 */
+void hpackEncoder::writeString(const string& str, Buffer& out)
+{
+    size_t huffLen = hpack::huffmanLength(str);
+    if(huffLen < str.size()) {
+        hpack::encodeInteger(huffLen, 7, 0x80, out);
+        hpack::huffmanEncode(str, out);
+    }
+    else {
+        hpack::encodeInteger(str.size(), 7, 0x00, out);
+        out.append(str);
+    }
+}
+
+
+/* 带 N 位前缀的整数编码（RFC 7541 5.1） */
+void hpack::encodeInteger(uint64_t value, int prefixBits, uint8_t flags, Buffer& out)
+{
+    uint64_t limit = (1u << prefixBits) - 1;
+    if(value < limit) {
+        char c = static_cast<char>(flags | value);
+        out.append(&c, 1);
+        return;
+    }
+    char buf[16];
+    size_t n = 0;
+    buf[n++] = static_cast<char>(flags | limit);
+    value -= limit;
+    while(value >= 128) {
+        buf[n++] = static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = static_cast<char>(value);
+    out.append(buf, n);
+}
+
+bool hpack::decodeInteger(const uint8_t*& p, const uint8_t* end, int prefixBits, uint64_t& value)
+{
+    if(p >= end) {
+        return false;
+    }
+    uint64_t limit = (1u << prefixBits) - 1;
+    value = *p++ & limit;
+    if(value < limit) {
+        return true;
+    }
+    for(int shift = 0; p < end; shift += 7) {
+        if(shift > 56) {            // 超长整数，视为解码错误
+            return false;
+        }
+        uint8_t b = *p++;
+        value += static_cast<uint64_t>(b & 0x7f) << shift;
+        if((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t hpack::huffmanLength(const string& str)
+{
+    size_t bits = 0;
+    for(unsigned char c: str) {
+        bits += HUFFMAN_CODE[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void hpack::huffmanEncode(const string& str, Buffer& out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    for(unsigned char c: str) {
+        acc = (acc << HUFFMAN_CODE[c].bits) | HUFFMAN_CODE[c].code;
+        bits += HUFFMAN_CODE[c].bits;
+        while(bits >= 8) {
+            bits -= 8;
+            char byte = static_cast<char>(acc >> bits);
+            out.append(&byte, 1);
+        }
+    }
+    if(bits > 0) {              // 用 EOS 的高位（全 1）补齐最后一个字节
+        char byte = static_cast<char>((acc << (8 - bits)) | (0xff >> bits));
+        out.append(&byte, 1);
+    }
+}
+
+namespace
+{
+    /* 由编码表构造的解码二叉树，叶子结点的 sym 为符号 */
+    struct HuffmanNode
+    {
+        int child[2];
+        int sym;
+    };
+
+    const vector<HuffmanNode>& huffmanTree()
+    {
+        static const vector<HuffmanNode> tree = [] {
+            vector<HuffmanNode> t(1, HuffmanNode{{0, 0}, -1});
+            for(int sym = 0; sym < 257; sym++) {
+                int node = 0;
+                for(int i = HUFFMAN_CODE[sym].bits - 1; i >= 0; i--) {
+                    int bit = (HUFFMAN_CODE[sym].code >> i) & 1;
+                    if(t[node].child[bit] == 0) {
+                        t[node].child[bit] = static_cast<int>(t.size());
+                        t.push_back(HuffmanNode{{0, 0}, -1});
+                    }
+                    node = t[node].child[bit];
+                }
+                t[node].sym = sym;
+            }
+            return t;
+        }();
+        return tree;
+    }
+}
+
+bool hpack::huffmanDecode(const uint8_t* data, size_t len, string& out)
+{
+    const vector<HuffmanNode>& tree = huffmanTree();
+    int node = 0;
+    int depth = 0;              // 当前未完成符号已读的位数
+    bool allOnes = true;
+    for(size_t i = 0; i < len; i++) {
+        for(int b = 7; b >= 0; b--) {
+            int bit = (data[i] >> b) & 1;
+            node = tree[node].child[bit];
+            if(node == 0) {
+                return false;
+            }
+            depth++;
+            allOnes = allOnes && bit;
+            if(tree[node].sym >= 0) {
+                if(tree[node].sym == 256) {     // 字符串中出现 EOS 是错误
+                    return false;
+                }
+                out.push_back(static_cast<char>(tree[node].sym));
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+    return depth <= 7 && allOnes;   // 填充必须是不超过 7 位的 EOS 前缀
+}
@@ -0,0 +1,100 @@
+/* HPACK 头部压缩（RFC 7541），供 HTTP/2 使用
+
+    - 静态表 + 动态表，动态表按 RFC 的 32 字节开销计算大小
+    - 解码支持全部五种表示形式以及 Huffman 编码的字符串
+    - 编码时能索引的就索引，其余按“增量索引的字面量”写入，让重复的响应头进入动态表
+*/
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../net/Buffer.h"
+
+using namespace net;
+
+typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+/* 静态表 + 动态表的联合索引空间 */
+class hpackTable
+{
+public:
+    explicit hpackTable(size_t maxSize = 4096);
+
+    bool get(size_t index, std::string &name, std::string &value) const;
+    void add(const std::string &name, const std::string &value);
+    void setMaxSize(size_t maxSize);
+    size_t maxSize() const { return m_maxSize; }
+    size_t size() const { return m_size; }
+
+    /* 返回完全匹配的索引，找不到时 nameIndex 为只匹配名字的索引（都没有则为 0） */
+    size_t find(const std::string &name, const std::string &value, size_t &nameIndex) const;
+
+    static const size_t STATIC_SIZE = 61;
+
+private:
+    void evict(size_t limit);
+
+private:
+    std::deque<std::pair<std::string, std::string>> m_dynamic;     // 新条目在前
+    size_t m_size;
+    size_t m_maxSize;
+};
+
+
+class hpackDecoder
+{
+public:
+    /* maxListSize 限制解码后的头部列表大小（按 RFC 7540 的 SETTINGS_MAX_HEADER_LIST_SIZE 计算），0 表示不限 */
+    explicit hpackDecoder(size_t maxTableSize = 4096, size_t maxListSize = 0): m_table(maxTableSize),
+        m_limit(maxTableSize), m_maxListSize(maxListSize), m_listTooLarge(false) {}
+
+    /* 解码一个完整的头部块，失败（COMPRESSION_ERROR，或头部列表超限）返回 false */
+    bool decode(const uint8_t *data, size_t len, HeaderList &headers);
+    bool listTooLarge() const { return m_listTooLarge; }     // 上一次解码是否因为头部列表超限而失败
+
+private:
+    bool readString(const uint8_t *&p, const uint8_t *end, std::string &out);
+
+private:
+    hpackTable m_table;
+    size_t m_limit;         // SETTINGS_HEADER_TABLE_SIZE，动态表大小更新不能超过它
+    size_t m_maxListSize;
+    bool m_listTooLarge;
+};
+
+
+class hpackEncoder
+{
+public:
+    explicit hpackEncoder(size_t maxTableSize = 4096): m_table(maxTableSize), m_pendingSize(-1) {}
+
+    void encode(const HeaderList &headers, Buffer &out);
+    void setMaxTableSize(size_t maxSize);      // 对端 SETTINGS_HEADER_TABLE_SIZE 变化时调用
+
+private:
+    void writeString(const std::string &str, Buffer &out);
+
+private:
+    hpackTable m_table;
+    long m_pendingSize;     // 待在下一个头部块开头发出的动态表大小更新，-1 表示没有
+};
+
+
+namespace hpack
+{
+    void encodeInteger(uint64_t value, int prefixBits, uint8_t flags, Buffer &out);
+    bool decodeInteger(const uint8_t *&p, const uint8_t *end, int prefixBits, uint64_t &value);
+
+    size_t huffmanLength(const std::string &str);
+    void huffmanEncode(const std::string &str, Buffer &out);
+    bool huffmanDecode(const uint8_t *data, size_t len, std::string &out);
+}
+
+#endif
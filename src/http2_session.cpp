@@ -0,0 +1,637 @@
+#include "http2_session.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "../utils/Utils.h"
+
+using namespace std;
+
+const size_t http2Session::PREFACE_LEN;
+const uint32_t http2Session::MAX_CONCURRENT_STREAMS;
+const uint32_t http2Session::MAX_FRAME_SIZE;
+const uint32_t http2Session::MAX_HEADER_LIST_SIZE;
+const int32_t http2Session::DEFAULT_WINDOW;
+
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t readUint32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void appendUint32(Buffer& buff, uint32_t v) {
+    char b[4] = { static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8), static_cast<char>(v) };
+    buff.append(b, 4);
+}
+
+http2Session::http2Session(const Dispatcher& dispatcher): m_dispatcher(dispatcher),
+    m_decoder(4096, MAX_HEADER_LIST_SIZE), m_continuationStream(0),
+    m_continuationEnd(false), m_prefaceRecvd(false), m_settingsRecvd(false), m_goaway(false), m_peerGoaway(false),
+    m_lastStreamId(0), m_nextServe(0), m_sendWindow(DEFAULT_WINDOW), m_recvWindow(DEFAULT_WINDOW),
+    m_initialWindow(DEFAULT_WINDOW), m_peerMaxFrame(16384)
+{
+    writeSettings();        // 服务端连接前言：第一帧必须是 SETTINGS
+}
+
+bool http2Session::isPreface(const Buffer& buff, bool& complete) {
+    static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    size_t n = min(buff.readableBytes(), PREFACE_LEN);
+    complete = (n == PREFACE_LEN);
+    return n > 0 && memcmp(buff.peek(), PREFACE, n) == 0;
+}
+
+bool http2Session::upgrade(httpRequest& request) {
+    string settings;
+    if(!Utils::base64Decode(request.getHeader("HTTP2-Settings"), settings) || settings.size() % 6 != 0) {
+        return false;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(settings.data());
+    for(size_t i = 0; i < settings.size(); i += 6) {
+        if(applySetting((p[i] << 8) | p[i + 1], readUint32(p + i + 2)) != NO_ERROR) {
+            return false;
+        }
+    }
+    /* 升级请求本身成为流 1，它在客户端一侧已经是 half-closed */
+    shared_ptr<Stream> stream = make_shared<Stream>(1, m_initialWindow);
+    stream->remoteClosed = true;
+    dispatch(stream, request, httpRequest::GET_REQUEST);
+    m_streams[1] = stream;
+    m_lastStreamId = 1;
+    return true;
+}
+
+bool http2Session::onData(Buffer& buff) {
+    if(m_goaway) {              // 已经发了 GOAWAY，后续输入全部丢弃
+        buff.retrieveAll();
+        return false;
+    }
+    if(!m_prefaceRecvd) {
+        bool complete = false;
+        if(!isPreface(buff, complete)) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        if(!complete) {
+            return true;
+        }
+        buff.retrieve(PREFACE_LEN);
+        m_prefaceRecvd = true;
+    }
+    /* 帧头 9 字节：长度(24) 类型(8) 标志(8) R + 流 ID(31) */
+    while(buff.readableBytes() >= 9) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(buff.peek());
+        size_t len = (p[0] << 16) | (p[1] << 8) | p[2];
+        if(len > MAX_FRAME_SIZE) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        if(buff.readableBytes() < 9 + len) {
+            break;
+        }
+        bool ok = handleFrame(p[3], p[4], readUint32(p + 5) & 0x7fffffff, p + 9, len);
+        buff.retrieve(9 + len);
+        if(!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool http2Session::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len) {
+    if(!m_settingsRecvd && type != SETTINGS) {      // 客户端前言之后第一帧必须是 SETTINGS
+        return connectionError(PROTOCOL_ERROR);
+    }
+    if(m_continuationStream != 0 && (type != CONTINUATION || streamId != m_continuationStream)) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    switch(type)
+    {
+    case DATA:
+        return onDataFrame(flags, streamId, payload, len);
+    case HEADERS:
+        return onHeaders(flags, streamId, payload, len);
+    case PRIORITY:
+        if(streamId == 0) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        if(len != 5) {
+            resetStream(streamId, FRAME_SIZE_ERROR);
+        }
+        return true;            // 不做优先级调度
+    case RST_STREAM:
+        if(streamId == 0 || streamId > m_lastStreamId) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        if(len != 4) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        m_streams.erase(streamId);
+        return true;
+    case SETTINGS:
+        return onSettings(flags, streamId, payload, len);
+    case PING:
+        if(streamId != 0) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        if(len != 8) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        if(!(flags & FLAG_ACK)) {
+            writeFrameHeader(m_control, 8, PING, FLAG_ACK, 0);
+            m_control.append(payload, 8);
+        }
+        return true;
+    case GOAWAY:
+        if(streamId != 0) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        m_peerGoaway = true;    // 不再有新流，已有的流发完后关闭连接
+        return true;
+    case WINDOW_UPDATE:
+        return onWindowUpdate(streamId, payload, len);
+    case CONTINUATION:
+        if(m_continuationStream == 0) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        if(m_headerBlock.size() + len > MAX_HEADER_LIST_SIZE) {    // 不带 END_HEADERS 的 CONTINUATION 可以无限追加
+            return connectionError(ENHANCE_YOUR_CALM);
+        }
+        m_headerBlock.append(reinterpret_cast<const char*>(payload), len);
+        if(flags & FLAG_END_HEADERS) {
+            streamId = m_continuationStream;
+            m_continuationStream = 0;
+            return onHeaderBlock(streamId, m_continuationEnd);
+        }
+        return true;
+    case PUSH_PROMISE:          // 客户端不能推送
+        return connectionError(PROTOCOL_ERROR);
+    default:
+        return true;            // 未知类型的帧必须忽略
+    }
+}
+
+bool http2Session::onHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len) {
+    if(streamId == 0) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    size_t pad = 0;
+    if(flags & FLAG_PADDED) {
+        if(len < 1) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        pad = payload[0];
+        payload++;
+        len--;
+    }
+    if(flags & FLAG_PRIORITY) {
+        if(len < 5) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        payload += 5;
+        len -= 5;
+    }
+    if(pad > len) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    if(len - pad > MAX_HEADER_LIST_SIZE) {
+        return connectionError(ENHANCE_YOUR_CALM);
+    }
+    m_headerBlock.assign(reinterpret_cast<const char*>(payload), len - pad);
+    bool endStream = (flags & FLAG_END_STREAM) != 0;
+    if(!(flags & FLAG_END_HEADERS)) {
+        m_continuationStream = streamId;
+        m_continuationEnd = endStream;
+        return true;
+    }
+    return onHeaderBlock(streamId, endStream);
+}
+
+/* 头部块完整后解码，并还原成 HTTP/1.1 请求交给 httpRequest */
+bool http2Session::onHeaderBlock(uint32_t streamId, bool endStream) {
+    HeaderList headers;
+    /* 即使要拒绝这个流也必须先解码，保持 HPACK 动态表与对端同步 */
+    if(!m_decoder.decode(reinterpret_cast<const uint8_t*>(m_headerBlock.data()), m_headerBlock.size(), headers)) {
+        return connectionError(m_decoder.listTooLarge() ? ENHANCE_YOUR_CALM : COMPRESSION_ERROR);
+    }
+    m_headerBlock.clear();
+
+    auto it = m_streams.find(streamId);
+    if(it != m_streams.end()) {         // 已有的流上再来 HEADERS：trailer，必须结束该流
+        Stream& stream = *it->second;
+        if(stream.remoteClosed) {
+            resetStream(streamId, STREAM_CLOSED);
+        }
+        else if(!endStream) {
+            resetStream(streamId, PROTOCOL_ERROR);
+        }
+        else {
+            stream.remoteClosed = true;
+            if(stream.chunked) {
+                stream.input.append("0\r\n\r\n");
+            }
+            feedRequest(it->second);
+        }
+        return true;
+    }
+    if(streamId <= m_lastStreamId || streamId % 2 == 0) {   // 已关闭的流或者服务端编号
+        return connectionError(PROTOCOL_ERROR);
+    }
+    m_lastStreamId = streamId;
+    if(m_peerGoaway) {
+        return true;
+    }
+    if(m_streams.size() >= MAX_CONCURRENT_STREAMS) {
+        resetStream(streamId, REFUSED_STREAM);
+        return true;
+    }
+
+    string method, path, authority, lines;
+    bool hasLength = false;
+    for(auto& header: headers) {
+        const string& name = header.first;
+        const string& value = header.second;
+        if(name.find_first_of("\r\n") != string::npos || value.find_first_of("\r\n") != string::npos) {
+            resetStream(streamId, PROTOCOL_ERROR);
+            return true;
+        }
+        if(!name.empty() && name[0] == ':') {
+            if(name == ":method") {
+                method = value;
+            }
+            else if(name == ":path") {
+                path = value;
+            }
+            else if(name == ":authority") {
+                authority = value;
+            }
+            continue;
+        }
+        if(name == "connection" || name == "transfer-encoding") {   // HTTP/2 中不允许的逐跳头部
+            continue;
+        }
+        hasLength = hasLength || name == "content-length";
+        lines += name + ": " + value + "\r\n";
+    }
+    if(method.empty() || path.empty() || path.find(' ') != string::npos) {
+        resetStream(streamId, PROTOCOL_ERROR);
+        return true;
+    }
+
+    shared_ptr<Stream> stream = make_shared<Stream>(streamId, m_initialWindow);
+    stream->remoteClosed = endStream;
+    stream->input.append(method + " " + path + " HTTP/1.1\r\n");
+    if(!authority.empty()) {
+        stream->input.append("host: " + authority + "\r\n");
+    }
+    stream->input.append(lines);
+    if(!endStream && !hasLength) {
+        stream->chunked = true;
+        stream->input.append("transfer-encoding: chunked\r\n");     // 包体长度未知，DATA 帧按 chunked 喂给解析器
+    }
+    stream->input.append("\r\n");
+    feedRequest(stream);
+    m_streams[streamId] = stream;
+    return true;
+}
+
+bool http2Session::onDataFrame(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len) {
+    if(streamId == 0) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    size_t frameLen = len;              // 流控按整个负载（含填充）计算
+    m_recvWindow -= frameLen;
+    if(m_recvWindow < 0) {
+        return connectionError(FLOW_CONTROL_ERROR);
+    }
+    if(frameLen > 0) {                  // 数据随到随消费，立即归还连接窗口
+        writeWindowUpdate(0, frameLen);
+        m_recvWindow += frameLen;
+    }
+    size_t pad = 0;
+    if(flags & FLAG_PADDED) {
+        if(len < 1) {
+            return connectionError(FRAME_SIZE_ERROR);
+        }
+        pad = payload[0];
+        payload++;
+        len--;
+    }
+    if(pad > len) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    len -= pad;
+
+    auto it = m_streams.find(streamId);
+    if(it == m_streams.end() || it->second->remoteClosed) {
+        if(streamId > m_lastStreamId) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        resetStream(streamId, STREAM_CLOSED);
+        return true;
+    }
+    Stream& stream = *it->second;
+    bool endStream = (flags & FLAG_END_STREAM) != 0;
+    if(frameLen > 0 && !endStream) {
+        writeWindowUpdate(streamId, frameLen);
+    }
+    if(len > 0 && stream.chunked) {
+        char size[32];
+        snprintf(size, sizeof(size), "%zx\r\n", len);
+        stream.input.append(size, strlen(size));
+        stream.input.append(payload, len);
+        stream.input.append("\r\n", 2);
+    }
+    else if(len > 0) {
+        stream.input.append(payload, len);
+    }
+    if(endStream) {
+        stream.remoteClosed = true;
+        if(stream.chunked) {
+            stream.input.append("0\r\n\r\n", 5);
+        }
+    }
+    feedRequest(it->second);
+    return true;
+}
+
+bool http2Session::onSettings(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len) {
+    if(streamId != 0) {
+        return connectionError(PROTOCOL_ERROR);
+    }
+    if(flags & FLAG_ACK) {
+        return len == 0 ? true : connectionError(FRAME_SIZE_ERROR);
+    }
+    if(len % 6 != 0) {
+        return connectionError(FRAME_SIZE_ERROR);
+    }
+    for(size_t i = 0; i < len; i += 6) {
+        ERROR_CODE code = applySetting((payload[i] << 8) | payload[i + 1], readUint32(payload + i + 2));
+        if(code != NO_ERROR) {
+            return connectionError(code);
+        }
+    }
+    m_settingsRecvd = true;
+    writeFrameHeader(m_control, 0, SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+http2Session::ERROR_CODE http2Session::applySetting(uint16_t id, uint32_t value) {
+    switch(id)
+    {
+    case 0x1:       // SETTINGS_HEADER_TABLE_SIZE
+        m_encoder.setMaxTableSize(value);
+        break;
+    case 0x2:       // SETTINGS_ENABLE_PUSH，本端从不推送
+        if(value > 1) {
+            return PROTOCOL_ERROR;
+        }
+        break;
+    case 0x4:       // SETTINGS_INITIAL_WINDOW_SIZE，差值作用到所有已打开的流
+    {
+        if(value > MAX_WINDOW) {
+            return FLOW_CONTROL_ERROR;
+        }
+        int64_t delta = static_cast<int64_t>(value) - m_initialWindow;
+        for(auto& item: m_streams) {
+            item.second->sendWindow += delta;
+            if(item.second->sendWindow > MAX_WINDOW) {
+                return FLOW_CONTROL_ERROR;
+            }
+        }
+        m_initialWindow = value;
+        break;
+    }
+    case 0x5:       // SETTINGS_MAX_FRAME_SIZE
+        if(value < 16384 || value > 16777215) {
+            return PROTOCOL_ERROR;
+        }
+        m_peerMaxFrame = value;
+        break;
+    default:        // MAX_CONCURRENT_STREAMS / MAX_HEADER_LIST_SIZE 对服务端无约束，未知的忽略
+        break;
+    }
+    return NO_ERROR;
+}
+
+bool http2Session::onWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t len) {
+    if(len != 4) {
+        return connectionError(FRAME_SIZE_ERROR);
+    }
+    int64_t increment = readUint32(payload) & 0x7fffffff;
+    if(streamId == 0) {
+        if(increment == 0) {
+            return connectionError(PROTOCOL_ERROR);
+        }
+        m_sendWindow += increment;
+        return m_sendWindow <= MAX_WINDOW ? true : connectionError(FLOW_CONTROL_ERROR);
+    }
+    auto it = m_streams.find(streamId);
+    if(it == m_streams.end()) {
+        return true;
+    }
+    it->second->sendWindow += increment;
+    if(increment == 0 || it->second->sendWindow > MAX_WINDOW) {
+        resetStream(streamId, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+/* 把收到的请求数据交给 httpRequest，请求完整（或出错）后立即生成响应 */
+void http2Session::feedRequest(const shared_ptr<Stream>& ptr) {
+    Stream& stream = *ptr;
+    if(stream.dispatched) {         // 已经给出错误响应的流，后续包体直接丢弃
+        stream.input.retrieveAll();
+        return;
+    }
+    httpRequest::HTTP_CODE ret = stream.request.parse(stream.input);
+    if(ret == httpRequest::NO_REQUEST) {
+        if(!stream.remoteClosed) {
+            return;
+        }
+        ret = httpRequest::BAD_REQUEST;     // 流已结束而请求不完整（包体短于 content-length）
+    }
+    stream.input.retrieveAll();
+    dispatch(ptr, stream.request, ret);
+}
+
+/* 处理函数挂起时流先不参与输出，恢复后（事件循环线程，持有连接锁）再生成响应；期间流可能已被重置 */
+void http2Session::dispatch(const shared_ptr<Stream>& stream, httpRequest& request, httpRequest::HTTP_CODE ret) {
+    stream->dispatched = true;
+    shared_ptr<Stream> keep = stream;
+    bool ready = m_dispatcher(request, ret, stream->response, [this, keep] {
+        keep->pending = false;
+        auto it = m_streams.find(keep->id);
+        if(it != m_streams.end() && it->second == keep) {
+            prepareResponse(*keep);
+        }
+    });
+    if(ready) {
+        prepareResponse(*stream);
+    }
+    else {
+        stream->pending = true;
+    }
+}
+
+/* 复用 HTTP/1.1 的响应生成：响应头丢弃，包体取 mmap 的文件或写在缓冲区里的错误页面 */
+void http2Session::prepareResponse(Stream& stream) {
+    if(stream.response.isStream()) {
+        return;
+    }
+    Buffer head;
+    stream.response.makeResponse(head);
+    const char CRLF2[] = "\r\n\r\n";
+    const char* end = search(head.peek(), head.beginWriteConst(), CRLF2, CRLF2 + 4);
+    if(end != head.beginWriteConst()) {
+        head.retrieveUntil(end + 4);
+        stream.body.append(head.peek(), head.readableBytes());
+    }
+    if(stream.response.file() && stream.response.fileLen() > 0) {
+        stream.data = stream.response.file();
+        stream.dataLen = stream.response.fileLen();
+    }
+}
+
+/* 给一个流写一帧（HEADERS 或一个 DATA），受连接和流两级发送窗口限制；没有进展返回 false */
+bool http2Session::writeStream(Stream& stream, Buffer& buff) {
+    bool streaming = stream.response.isStream();
+    if(!stream.headersSent) {
+        HeaderList headers;
+        headers.emplace_back(":status", to_string(stream.response.code() == -1 ? 200 : stream.response.code()));
+        headers.emplace_back("content-type", stream.response.contentType());
+        size_t bodyLen = stream.data ? stream.dataLen : stream.body.readableBytes();
+        if(!streaming) {
+            headers.emplace_back("content-length", to_string(bodyLen));
+        }
+        for(auto &header: stream.response.headers()) {     // HTTP/2 的字段名必须小写
+            string name = header.first;
+            transform(name.begin(), name.end(), name.begin(), ::tolower);
+            headers.emplace_back(name, header.second);
+        }
+        Buffer block;
+        m_encoder.encode(headers, block);
+        bool endStream = !streaming && bodyLen == 0;
+        uint8_t type = HEADERS;
+        do {                    // 头部块超过对端最大帧长时拆成 CONTINUATION
+            size_t n = min<size_t>(block.readableBytes(), m_peerMaxFrame);
+            uint8_t flags = (type == HEADERS && endStream) ? FLAG_END_STREAM : 0;
+            if(n == block.readableBytes()) {
+                flags |= FLAG_END_HEADERS;
+            }
+            writeFrameHeader(buff, n, type, flags, stream.id);
+            buff.append(block.peek(), n);
+            block.retrieve(n);
+            type = CONTINUATION;
+        } while(block.readableBytes() > 0);
+        stream.headersSent = true;
+        stream.localClosed = endStream;
+        return true;
+    }
+
+    /* 数据源暂时没有数据时这一轮跳过该流；响应的 resume 由连接在分发时设置，
+        生产者调用后连接重新注册可写事件，写事件里的 output 会再次拉取 */
+    if(streaming && stream.body.readableBytes() == 0) {
+        stream.response.pullSource(stream.body);
+    }
+    const char* src = stream.data ? stream.data : stream.body.peek();
+    size_t avail = stream.data ? stream.dataLen : stream.body.readableBytes();
+    bool last = !stream.response.isStream();       // avail 之后不会再有数据
+    int64_t window = max<int64_t>(0, min(m_sendWindow, stream.sendWindow));
+    size_t n = min<size_t>(min<size_t>(avail, m_peerMaxFrame), window);
+    if(n == 0 && !(avail == 0 && last)) {
+        return false;
+    }
+    bool endStream = last && n == avail;
+    writeFrameHeader(buff, n, DATA, endStream ? FLAG_END_STREAM : 0, stream.id);
+    buff.append(src, n);
+    if(stream.data) {
+        stream.data += n;
+        stream.dataLen -= n;
+    }
+    else {
+        stream.body.retrieve(n);
+    }
+    m_sendWindow -= n;
+    stream.sendWindow -= n;
+    stream.localClosed = endStream;
+    return true;
+}
+
+bool http2Session::output(Buffer& buff, size_t watermark) {
+    /* 收到客户端的 SETTINGS 之前只发控制帧：升级时 101 之后的第一批数据保持很小，
+        也保证按对端的设置（最大帧长、初始窗口）发送 */
+    bool progress = m_settingsRecvd;
+    while(progress && buff.readableBytes() < watermark) {
+        buff.append(m_control.peek(), m_control.readableBytes());
+        m_control.retrieveAll();
+
+        /* 每个流一轮只写一帧，从上次停下的位置开始轮转 */
+        progress = false;
+        auto it = m_streams.lower_bound(m_nextServe);
+        for(size_t i = 0, n = m_streams.size(); i < n && buff.readableBytes() < watermark; i++) {
+            if(it == m_streams.end()) {
+                it = m_streams.begin();
+            }
+            Stream& stream = *it->second;
+            if(stream.dispatched && !stream.pending && !stream.localClosed && writeStream(stream, buff)) {
+                progress = true;
+            }
+            m_nextServe = it->first + 1;
+            if(stream.localClosed) {
+                if(!stream.remoteClosed) {      // 响应已经发完，不再需要请求剩余的包体
+                    resetStream(stream.id, NO_ERROR);
+                }
+                it = m_streams.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    buff.append(m_control.peek(), m_control.readableBytes());
+    m_control.retrieveAll();
+    return buff.readableBytes() > 0;
+}
+
+void http2Session::writeFrameHeader(Buffer& buff, size_t len, uint8_t type, uint8_t flags, uint32_t streamId) {
+    char head[9] = { static_cast<char>(len >> 16), static_cast<char>(len >> 8), static_cast<char>(len),
+                     static_cast<char>(type), static_cast<char>(flags) };
+    buff.append(head, 5);
+    appendUint32(buff, streamId & 0x7fffffff);
+}
+
+void http2Session::writeSettings() {
+    writeFrameHeader(m_control, 12, SETTINGS, 0, 0);
+    char setting[2] = { 0x0, 0x3 };     // SETTINGS_MAX_CONCURRENT_STREAMS
+    m_control.append(setting, 2);
+    appendUint32(m_control, MAX_CONCURRENT_STREAMS);
+    setting[1] = 0x6;                   // SETTINGS_MAX_HEADER_LIST_SIZE
+    m_control.append(setting, 2);
+    appendUint32(m_control, MAX_HEADER_LIST_SIZE);
+}
+
+void http2Session::writeWindowUpdate(uint32_t streamId, uint32_t increment) {
+    writeFrameHeader(m_control, 4, WINDOW_UPDATE, 0, streamId);
+    appendUint32(m_control, increment);
+}
+
+void http2Session::resetStream(uint32_t streamId, ERROR_CODE code) {
+    writeFrameHeader(m_control, 4, RST_STREAM, 0, streamId);
+    appendUint32(m_control, code);
+    auto it = m_streams.find(streamId);
+    if(it != m_streams.end() && !it->second->localClosed) {
+        m_streams.erase(it);
+    }
+}
+
+bool http2Session::connectionError(ERROR_CODE code) {
+    LOG_ERROR("HTTP/2 connection error: %d", code);
+    writeFrameHeader(m_control, 8, GOAWAY, 0, 0);
+    appendUint32(m_control, m_lastStreamId);
+    appendUint32(m_control, code);
+    m_goaway = true;
+    return false;
+}
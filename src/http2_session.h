@@ -0,0 +1,146 @@
+/* 明文 HTTP/2（h2c）会话
+
+    一个 httpConn 升级为 HTTP/2 后由本类接管：解析帧、维护 HPACK 上下文、流控和并发的流。
+    每个流的请求头被还原成 HTTP/1.1 文本交给 httpRequest 解析，包体按 chunked 的形式喂进去，
+    响应仍由 httpResponse 生成（静态文件 mmap、错误页面、流式数据源），这里只负责把它切成 HEADERS / DATA 帧。
+*/
+
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+#include "http_request.h"
+#include "http_response.h"
+#include "hpack.h"
+#include "../net/Buffer.h"
+
+using namespace net;
+
+class http2Session
+{
+public:
+    /* 把解析完的请求交给上层生成响应（与 HTTP/1.1 共用同一套分发逻辑）；
+        返回 false 表示响应稍后生成，届时调用最后一个参数 */
+    typedef std::function<bool(httpRequest&, httpRequest::HTTP_CODE, httpResponse&, const std::function<void()>&)> Dispatcher;
+
+    enum FRAME_TYPE {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9,
+    };
+
+    enum ERROR_CODE {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb,
+    };
+
+public:
+    explicit http2Session(const Dispatcher& dispatcher);
+    ~http2Session() = default;
+
+    /* 通过 Upgrade: h2c 升级：应用 HTTP2-Settings，并把触发升级的请求作为流 1 响应 */
+    bool upgrade(httpRequest& request);
+
+    /* 消费读缓冲区里完整的帧，连接级错误时排队 GOAWAY 并返回 false */
+    bool onData(Buffer& buff);
+
+    /* 输出待发的控制帧和各个流的 HEADERS / DATA，直到 buff 达到 watermark 或受流控限制 */
+    bool output(Buffer& buff, size_t watermark);
+
+    bool isAlive() const { return !m_goaway && !(m_peerGoaway && m_streams.empty()); }
+
+    static bool isPreface(const Buffer& buff, bool& complete);
+
+    static const size_t PREFACE_LEN = 24;
+    static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static const uint32_t MAX_FRAME_SIZE = 16384;          // 本端接收的最大帧，使用协议默认值
+    static const uint32_t MAX_HEADER_LIST_SIZE = 64 * 1024;    // 头部块和解码后的头部列表上限，超过时断开连接
+    static const int32_t DEFAULT_WINDOW = 65535;
+
+private:
+    struct Stream
+    {
+        Stream(uint32_t streamId, int64_t window): id(streamId), sendWindow(window), remoteClosed(false),
+            localClosed(false), headersSent(false), dispatched(false), pending(false), chunked(false), data(nullptr), dataLen(0) {}
+
+        uint32_t id;
+        int64_t sendWindow;
+        bool remoteClosed;          // 已收到 END_STREAM
+        bool localClosed;           // 已发送 END_STREAM
+        bool headersSent;
+        bool dispatched;
+        bool pending;               // 协程处理函数还没结束，响应尚未生成
+        bool chunked;               // 请求没有 content-length，DATA 按 chunked 喂给解析器
+        Buffer input;               // 还原成 HTTP/1.1 文本的请求，交给 request 解析
+        httpRequest request;
+        httpResponse response;
+        const char* data;           // 文件或错误页面的包体
+        size_t dataLen;
+        Buffer body;                // 错误页面或流式数据源产生的包体
+    };
+
+private:
+    bool handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onHeaders(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onHeaderBlock(uint32_t streamId, bool endStream);
+    bool onDataFrame(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onSettings(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    ERROR_CODE applySetting(uint16_t id, uint32_t value);
+    bool onWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t len);
+
+    void feedRequest(const std::shared_ptr<Stream>& stream);
+    void dispatch(const std::shared_ptr<Stream>& stream, httpRequest& request, httpRequest::HTTP_CODE ret);
+    void prepareResponse(Stream& stream);
+    bool writeStream(Stream& stream, Buffer& buff);
+
+    void writeFrameHeader(Buffer& buff, size_t len, uint8_t type, uint8_t flags, uint32_t streamId);
+    void writeSettings();
+    void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+    void resetStream(uint32_t streamId, ERROR_CODE code);
+    bool connectionError(ERROR_CODE code);
+
+private:
+    Dispatcher m_dispatcher;
+    hpackDecoder m_decoder;
+    hpackEncoder m_encoder;
+    std::map<uint32_t, std::shared_ptr<Stream>> m_streams;     // 挂起的处理函数也持有流，流被重置后仍然有效
+
+    Buffer m_control;               // 待发的控制帧（SETTINGS / PING / WINDOW_UPDATE / RST_STREAM / GOAWAY）
+    std::string m_headerBlock;      // HEADERS + CONTINUATION 拼起来的头部块
+    uint32_t m_continuationStream;  // 非 0 表示正在等待该流的 CONTINUATION
+    bool m_continuationEnd;         // 该头部块所在的 HEADERS 是否带 END_STREAM
+
+    bool m_prefaceRecvd;
+    bool m_settingsRecvd;
+    bool m_goaway;                  // 本端已发送 GOAWAY
+    bool m_peerGoaway;
+    uint32_t m_lastStreamId;
+    uint32_t m_nextServe;           // 轮转发送 DATA 的起点，避免总是编号小的流优先
+
+    int64_t m_sendWindow;           // 连接级发送窗口
+    int64_t m_recvWindow;           // 连接级接收窗口
+    int64_t m_initialWindow;        // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t m_peerMaxFrame;        // 对端 SETTINGS_MAX_FRAME_SIZE
+};
+
+#endif
@@ -1,18 +1,32 @@
 #include "http_connection.h"
 
+#include <algorithm>
+#include <sys/epoll.h>
+
 #include "../base/log.h"
+#include "../utils/Utils.h"
 
 using namespace std;
 
 const char* httpConn::m_srcDir;
 int httpConn::m_userCount;
 bool httpConn::m_isET;
+const size_t httpConn::STREAM_WATERMARK;
+unordered_map<string, wsSession::Handler> httpConn::WS_HANDLER;
+
+void httpConn::registerWebSocket(const string& path, const wsSession::Handler& handler)
+{
+    assert(path != "" && handler.onMessage);
+    WS_HANDLER[path] = handler;
+}
 
 httpConn::httpConn() 
 { 
     m_fd = -1;
     m_addr = { 0 };
     m_isClose = true;
+    m_pending = false;
+    m_generation = 0;
 };
 
 httpConn::~httpConn() { 
@@ -26,13 +40,29 @@ void httpConn::init(int fd, const sockaddr_in& addr) {
     m_fd = fd;
     m_readBuffer.retrieveAll();
     m_writeBuffer.retrieveAll();
+    m_request.init();
+    m_h2.reset();
+    m_ws.reset();
+    m_pending = false;
+    m_generation++;
+    m_cancel = std::make_shared<co::cancelToken>();
     m_isClose = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", m_fd, getIP(), getPort(), (int)m_userCount);
 }
 
 void httpConn::Close() 
 {
+    std::lock_guard<std::recursive_mutex> locker(m_mutex);
     m_response.unmapFile();
+    m_h2.reset();
+    m_ws.reset();
+    m_pending = false;
+    m_generation++;
+    if(m_cancel)
+    {
+        m_cancel->cancel();
+        m_cancel.reset();
+    }
     if(m_isClose == false)
     {
         m_isClose = true; 
@@ -76,6 +106,10 @@ ssize_t httpConn::read(int* saveErrno) {
 ssize_t httpConn::write(int* saveErrno) 
 {
     ssize_t len = -1;
+    if(toWriteBytes() == 0)     // 由推送或心跳触发的写事件，先取出待发的帧
+    {
+        fillStream();
+    }
     do {
         len = writev(m_fd, m_iv, m_iv_count);
         if(len <= 0) 
@@ -102,31 +136,182 @@ ssize_t httpConn::write(int* saveErrno)
             m_iv[0].iov_len -= len; 
             m_writeBuffer.retrieve(len);
         }
+        /* 流式响应：上一批发完了才拉取下一批，socket 不可写时不会继续产生数据 */
+        if(toWriteBytes() == 0 && !fillStream())
+        {
+            break;
+        }
     } while(m_isET || toWriteBytes() > 10240);
     return len;
 }
 
-bool httpConn::process() 
+/* 拉取下一批流式响应数据到写缓冲区，没有更多数据时返回 false */
+bool httpConn::fillStream()
 {
-    m_request.init();
-    if(m_readBuffer.readableBytes() <= 0)
+    if(m_h2)
+    {
+        m_writeBuffer.retrieveAll();
+        m_h2->output(m_writeBuffer, STREAM_WATERMARK);
+    }
+    else if(m_ws)
+    {
+        m_writeBuffer.retrieveAll();
+        m_ws->output(m_writeBuffer);
+    }
+    else if(m_response.isStream())
+    {
+        m_writeBuffer.retrieveAll();
+        m_response.nextChunk(m_writeBuffer, STREAM_WATERMARK);
+    }
+    else
     {
         return false;
     }
-    else if(m_request.parse(m_readBuffer)) 
+    setWriteBuffer();
+    return m_iv[0].iov_len > 0;
+}
+
+bool httpConn::dispatch(httpRequest& request, httpRequest::HTTP_CODE ret, httpResponse& response,
+    const std::function<void()>& ready, const std::shared_ptr<co::cancelToken>& token)
+{
+    if(ret == httpRequest::GET_REQUEST) 
     {
-        LOG_DEBUG("inprocess %s", m_request.path().c_str());
-        m_response.init(m_srcDir, m_request.path(), m_request.isKeepAlive(), 200);
+        LOG_DEBUG("inprocess %s", request.path().c_str());
+        response.init(m_srcDir, request.path(), request.isKeepAlive(), 200);
+        response.setResume(resumeCallback());
+        const httpRouter::route* route = request.route();
+        if(route && !route->lane.empty())
+        {
+            return co::spawn(runOnLane(route, request, response), ready, token);
+        }
+        if(route && route->asyncHandler)
+        {
+            return co::spawn(route->asyncHandler(request, response), ready, token);
+        }
+        if(route && route->handler)     // 没有路由的请求按路径返回静态文件
+        {
+            route->handler(request, response);
+        }
     } 
+    else if(ret == httpRequest::BODY_TOO_LARGE)
+    {
+        response.init(m_srcDir, request.path(), false, 413);
+    }
     else 
     {
-        m_response.init(m_srcDir, m_request.path(), false, 400);
+        response.init(m_srcDir, request.path(), false, 400);
+    }
+    return true;
+}
+
+/* 挪到路由的通道上执行处理函数（协程处理函数执行到第一次挂起），再回到事件循环线程收尾；
+    通道排满时不挪，直接回复 503。
+    通道线程不持有连接锁，事件循环线程可能同时关闭这个连接、甚至为新连接重新 init 它，
+    所以处理函数拿到的是请求和响应的副本，回来后拿到连接锁、确认还是原来那个连接才把响应写回 */
+co::Task<void> httpConn::runOnLane(const httpRouter::route* route, httpRequest& request, httpResponse& response)
+{
+    assert(!response.file());
+    uint64_t generation = m_generation;
+    httpRequest laneRequest(request);
+    httpResponse laneResponse(response);
+    bool moved = co_await co::switchTo(route->lane.c_str());     // 直接写成 if(!co_await ...) 时 GCC 12 会编译出非法指令
+    if(!moved)
+    {
+        LOG_WARN("Lane %s full, reject %s", route->lane.c_str(), request.path().c_str());
+        response.setCode(503);
+        co_return;
+    }
+    if(route->asyncHandler)
+    {
+        co_await route->asyncHandler(laneRequest, laneResponse);
+    }
+    else if(route->handler)
+    {
+        route->handler(laneRequest, laneResponse);
+    }
+    co_await co::switchTo(nullptr);
+    std::lock_guard<std::recursive_mutex> locker(m_mutex);
+    if(generation == m_generation)
+    {
+        response = laneResponse;
+    }
+}
+
+bool httpConn::process() 
+{
+    if(m_pending)
+    {
+        return false;
+    }
+    if(m_h2)
+    {
+        return processHttp2();
+    }
+    if(m_ws)
+    {
+        return processWebSocket();
+    }
+    if(m_request.isFinish())        // 上一个请求已经响应完，开始解析新请求；否则接着解析未收完的请求
+    {
+        m_request.init();
+    }
+    if(m_readBuffer.readableBytes() <= 0)
+    {
+        return false;
+    }
+    if(m_request.isIdle())          // 以 HTTP/2 连接前言开头的是 prior knowledge 的 h2c 连接
+    {
+        bool complete = false;
+        if(http2Session::isPreface(m_readBuffer, complete))
+        {
+            if(!complete)
+            {
+                return false;
+            }
+            LOG_INFO("Client[%d] speaks h2c", m_fd);
+            m_h2.reset(new http2Session(http2Dispatcher()));
+            return processHttp2();
+        }
+    }
+
+    httpRequest::HTTP_CODE ret = m_request.parse(m_readBuffer);
+    if(ret == httpRequest::NO_REQUEST)      // 请求还不完整，继续等待数据
+    {
+        return false;
+    }
+    if(ret == httpRequest::GET_REQUEST && upgradeHttp2())
+    {
+        return true;
+    }
+    if(ret == httpRequest::GET_REQUEST && WS_HANDLER.count(m_request.path()))
+    {
+        if(upgradeWebSocket())
+        {
+            return true;
+        }
+        ret = httpRequest::BAD_REQUEST;     // WebSocket 端点只接受合法的握手
+    }
+    if(!dispatch(m_request, ret, m_response, readyCallback(nullptr), m_cancel))
+    {
+        m_pending = true;           // 处理函数挂起，恢复前不再读取该连接
+        return false;
+    }
+    return makeResponse(ret);
+}
+
+bool httpConn::makeResponse(httpRequest::HTTP_CODE ret)
+{
+    if(ret != httpRequest::GET_REQUEST)     // 出错的请求不再解析，回复后关闭连接
+    {
+        m_readBuffer.retrieveAll();
+        m_request.init();
     }
 
     m_response.makeResponse(m_writeBuffer);
     /* 响应头 */
     m_iv[0].iov_base = const_cast<char*>(m_writeBuffer.peek());
     m_iv[0].iov_len = m_writeBuffer.readableBytes();
+    m_iv[1].iov_len = 0;
     m_iv_count = 1;
 
     /* 文件 */
@@ -138,3 +323,171 @@ bool httpConn::process()
     LOG_DEBUG("filesize:%d, %d  to %d", m_response.fileLen() , m_iv_count, toWriteBytes());
     return true;
 }
+
+/* Upgrade: h2c —— 回复 101 后以 HTTP/2 响应这个请求（流 1），之后整条连接都走 HTTP/2 */
+bool httpConn::upgradeHttp2()
+{
+    if(strcasecmp(m_request.getHeader("Upgrade").c_str(), "h2c") != 0 
+        || m_request.getHeader("HTTP2-Settings") == "" || m_request.bodyLen() > 0)
+    {
+        return false;
+    }
+    std::unique_ptr<http2Session> h2(new http2Session(http2Dispatcher()));
+    if(!h2->upgrade(m_request))
+    {
+        return false;
+    }
+    LOG_INFO("Client[%d] upgrades to h2c", m_fd);
+    m_h2 = std::move(h2);
+    m_writeBuffer.append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    return processHttp2();
+}
+
+/* HTTP/2：消费读缓冲区里的帧，把待发的帧写到写缓冲区 */
+bool httpConn::processHttp2()
+{
+    if(m_readBuffer.readableBytes() > 0)
+    {
+        m_h2->onData(m_readBuffer);
+    }
+    m_h2->output(m_writeBuffer, STREAM_WATERMARK);
+    setWriteBuffer();
+    return m_iv[0].iov_len > 0;
+}
+
+/* Upgrade: websocket 握手（RFC 6455 4.2），成功后释放 HTTP 相关的资源，整条连接只剩帧解析的状态 */
+bool httpConn::upgradeWebSocket()
+{
+    string connection = m_request.getHeader("Connection");
+    std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+    string key = m_request.getHeader("Sec-WebSocket-Key");
+    string nonce;
+    if(m_request.method() != "GET" || m_request.version() != "1.1"
+        || strcasecmp(m_request.getHeader("Upgrade").c_str(), "websocket") != 0
+        || connection.find("upgrade") == string::npos
+        || m_request.getHeader("Sec-WebSocket-Version") != "13"
+        || !Utils::base64Decode(key, nonce) || nonce.size() != 16 || m_request.bodyLen() > 0)
+    {
+        LOG_WARN("Client[%d] bad websocket handshake", m_fd);
+        return false;
+    }
+
+    const wsSession::Handler& handler = WS_HANDLER[m_request.path()];
+    m_ws = std::make_shared<wsSession>(&handler, m_request.path());
+    std::weak_ptr<wsSession> session = m_ws;
+    m_ws->setPusher([this, session](wsSession::OPCODE opcode, const string& msg) {
+        return push(session, opcode, msg);
+    });
+    LOG_INFO("Client[%d] upgrades to websocket %s", m_fd, m_request.path().c_str());
+
+    m_writeBuffer.append("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + wsSession::acceptKey(key) + "\r\n\r\n");
+    m_request.init();
+    m_response.unmapFile();
+    m_ws->open();
+    return processWebSocket();
+}
+
+/* WebSocket：消费读缓冲区里的帧，回调产生的帧写到写缓冲区 */
+bool httpConn::processWebSocket()
+{
+    if(m_readBuffer.readableBytes() > 0)
+    {
+        m_ws->onData(m_readBuffer);
+    }
+    /* 大消息把缓冲区撑大后，空闲时缩回初始大小 */
+    if(m_readBuffer.readableBytes() == 0 && m_readBuffer.writeableBytes() > wsSession::IDLE_CAPACITY)
+    {
+        m_readBuffer.shrink(0);
+    }
+    if(m_writeBuffer.readableBytes() == 0 && m_writeBuffer.writeableBytes() > wsSession::IDLE_CAPACITY)
+    {
+        m_writeBuffer.shrink(0);
+    }
+    if(m_writeBuffer.readableBytes() == 0)     // 上一批没发完时帧留在会话里，计入它的积压上限
+    {
+        m_ws->output(m_writeBuffer);
+    }
+    setWriteBuffer();
+    return m_iv[0].iov_len > 0;
+}
+
+/* 其它线程推送消息：拿到连接锁后写入帧，再注册可写事件让工作线程发送 */
+bool httpConn::push(const std::weak_ptr<wsSession>& session, wsSession::OPCODE opcode, const string& msg)
+{
+    std::lock_guard<std::recursive_mutex> locker(m_mutex);
+    std::shared_ptr<wsSession> ws = session.lock();
+    if(!ws || ws != m_ws || ws->isClosed())
+    {
+        return false;
+    }
+    bool sent = ws->send(opcode, msg.data(), msg.size());
+    Utils().modfd(Utils::m_epollfd, m_fd, EPOLLOUT, m_isET);    // 积压超限时也要把关闭帧发出去
+    return sent;
+}
+
+bool httpConn::heartbeat()
+{
+    std::unique_lock<std::recursive_mutex> locker(m_mutex, std::try_to_lock);
+    if(!locker.owns_lock() || m_pending)
+    {
+        return true;
+    }
+    if(!m_ws || !m_ws->heartbeat())
+    {
+        return false;
+    }
+    Utils().modfd(Utils::m_epollfd, m_fd, EPOLLOUT, m_isET);
+    return true;
+}
+
+void httpConn::setWriteBuffer()
+{
+    m_iv[0].iov_base = const_cast<char*>(m_writeBuffer.peek());
+    m_iv[0].iov_len = m_writeBuffer.readableBytes();
+    m_iv[1].iov_len = 0;
+    m_iv_count = 1;
+}
+
+/* 协程处理函数结束时在事件循环线程调用：连接还是原来那个才继续，HTTP/1.1 生成响应，HTTP/2 交给 ready */
+std::function<void()> httpConn::readyCallback(const std::function<void()>& ready)
+{
+    uint64_t generation = m_generation;
+    return [this, generation, ready] {
+        std::lock_guard<std::recursive_mutex> locker(m_mutex);
+        if(generation != m_generation)
+        {
+            return;
+        }
+        if(ready)
+        {
+            ready();
+        }
+        else if(m_pending)
+        {
+            m_pending = false;
+            makeResponse(httpRequest::GET_REQUEST);
+        }
+        Utils().modfd(Utils::m_epollfd, m_fd, EPOLLOUT, m_isET);
+    };
+}
+
+/* 流式数据源有了新数据：连接还是原来那个、也没有在等协程时重新注册可写事件，写事件里接着拉取 */
+httpResponse::Resume httpConn::resumeCallback()
+{
+    uint64_t generation = m_generation;
+    return [this, generation] {
+        std::lock_guard<std::recursive_mutex> locker(m_mutex);
+        if(generation == m_generation && !m_pending)
+        {
+            Utils().modfd(Utils::m_epollfd, m_fd, EPOLLOUT, m_isET);
+        }
+    };
+}
+
+http2Session::Dispatcher httpConn::http2Dispatcher()
+{
+    return [this](httpRequest& request, httpRequest::HTTP_CODE ret, httpResponse& response, const std::function<void()>& ready) {
+        return dispatch(request, ret, response, readyCallback(ready), m_cancel);
+    };
+}
@@ -2,9 +2,15 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
 
 #include "http_request.h"
 #include "http_response.h"
+#include "http2_session.h"
+#include "websocket.h"
 #include "../net/Buffer.h"
 
 using namespace net;
@@ -37,16 +43,52 @@ public:
         return m_iv[0].iov_len + m_iv[1].iov_len; 
     }
 
+    /* 需在 server 启动前注册，path 与请求路径完全匹配；普通的处理函数注册到 httpRouter */
+    static void registerWebSocket(const std::string &path, const wsSession::Handler &handler);
+
     bool isKeepAlive() const {
-        return m_request.isKeepAlive();
+        if(m_h2) {
+            return m_h2->isAlive();
+        }
+        return m_ws ? !m_ws->isClosed() : m_request.isKeepAlive();
     }
 
+    /* 空闲超时：WebSocket 连接发 ping 续期，正在处理中的连接也续期，其余返回 false 由调用者关闭 */
+    bool heartbeat();
+
+    /* 工作线程处理该连接时持有，ping 和跨线程推送也要先拿到它 */
+    std::recursive_mutex &mutex() { return m_mutex; }
+
 public:
     static bool m_isET;
     static const char *m_srcDir;
     static int m_userCount;
 //    static int m_epollfd;
 
+    static const size_t STREAM_WATERMARK = 16 * 1024;   // 流式响应每次最多缓冲的待发数据
+
+    /* 按请求生成响应，HTTP/1.1 与 HTTP/2 共用；路由是协程且挂起时返回 false，
+        协程结束（或被 token 取消）后在事件循环线程调用 ready，此前 request / response 必须保持有效 */
+    bool dispatch(httpRequest &request, httpRequest::HTTP_CODE ret, httpResponse &response,
+        const std::function<void()> &ready, const std::shared_ptr<co::cancelToken> &token = nullptr);
+
+    bool isPending() const { return m_pending; }    // 正在等待协程处理函数，不监听读事件
+    bool isStreaming() const { return !m_h2 && !m_ws && m_response.isStream(); }   // HTTP/1.1 流式响应还没结束
+
+private:
+    co::Task<void> runOnLane(const httpRouter::route* route, httpRequest& request, httpResponse& response);
+    bool fillStream();
+    bool makeResponse(httpRequest::HTTP_CODE ret);
+    std::function<void()> readyCallback(const std::function<void()> &ready);
+    httpResponse::Resume resumeCallback();
+    http2Session::Dispatcher http2Dispatcher();
+    bool upgradeHttp2();
+    bool processHttp2();
+    bool upgradeWebSocket();
+    bool processWebSocket();
+    bool push(const std::weak_ptr<wsSession> &session, wsSession::OPCODE opcode, const std::string &msg);
+    void setWriteBuffer();
+
 private:
     int m_fd;
     struct sockaddr_in m_addr;
@@ -61,5 +103,13 @@ private:
     httpRequest m_request;
     httpResponse m_response;
 
+    std::unique_ptr<http2Session> m_h2;     // 升级为 h2c 后非空，此后由它处理读写缓冲区
+    std::shared_ptr<wsSession> m_ws;        // 升级为 WebSocket 后非空，Pusher 持有它的 weak_ptr
+    std::recursive_mutex m_mutex;
+    bool m_pending;
+    uint64_t m_generation;                  // 每次 init / Close 加一，挂起的协程恢复时据此判断连接是否还是原来那个
+    std::shared_ptr<co::cancelToken> m_cancel;  // 连接上所有协程共用，Close 时取消，正在等待的查询、定时器随之放弃
+
+    static std::unordered_map<std::string, wsSession::Handler> WS_HANDLER;
 };
 
@@ -1,21 +1,58 @@
 #include "http_request.h"
 
+#include <random>
+
+#include "../utils/Utils.h"
+#include "user_filter.h"
+
 using namespace std;
 
+size_t httpRequest::m_bodyMemLimit = 64 * 1024;
+size_t httpRequest::m_maxBodySize = 8 * 1024 * 1024;
+const size_t httpRequest::MAX_TRAILER_SIZE;
+const size_t httpRequest::MAX_TRAILER_LINES;
+lru_cache<httpRequest::credential> httpRequest::m_credentials(10000, 60 * 1000);
+userStore *httpRequest::m_store = nullptr;
 
-/* 目前（默认）只支持静态资源的访问 */
-const unordered_set<string> httpRequest::DEFAULT_HTML{
-            "/index", "/register", "/login",
-             "/welcome", "/video", "/picture", };
+/* 口令摘要的盐，每次启动随机生成，缓存只在本进程内有效 */
+static const string PWD_SALT = [] {
+    random_device rd;
+    string salt(16, '\0');
+    for(char &c: salt) {
+        c = static_cast<char>(rd());
+    }
+    return salt;
+}();
+
+httpRequest::httpRequest(const httpRequest &other): m_state(other.m_state), m_bodyError(other.m_bodyError),
+    m_method(other.m_method), m_path(other.m_path), m_version(other.m_version), m_query(other.m_query),
+    m_body(other.m_body), m_header(other.m_header), m_post(other.m_post), m_contentLen(other.m_contentLen),
+    m_bodyLen(other.m_bodyLen), m_bodyFd(other.m_bodyFd >= 0 ? dup(other.m_bodyFd) : -1),
+    m_trailerLen(other.m_trailerLen), m_trailerLines(other.m_trailerLines),
+    m_bodyHandler(other.m_bodyHandler), m_route(other.m_route), m_params(other.m_params) {
+}
 
-const unordered_map<string, int> httpRequest::DEFAULT_HTML_TAG {
-            {"/register.html", 0}, {"/login.html", 1},  };
+httpRequest::~httpRequest() {
+    if(m_bodyFd >= 0) {
+        close(m_bodyFd);
+    }
+}
 
 void httpRequest::init() {
-    m_method = m_path = m_version = m_body = "";
+    m_method = m_path = m_version = m_query = m_body = "";
     m_state = REQUEST_LINE;
+    m_bodyError = BAD_REQUEST;
     m_header.clear();
     m_post.clear();
+    m_contentLen = m_bodyLen = 0;
+    m_trailerLen = m_trailerLines = 0;
+    if(m_bodyFd >= 0) {
+        close(m_bodyFd);
+        m_bodyFd = -1;
+    }
+    m_bodyHandler = nullptr;
+    m_route = nullptr;
+    m_params.count = 0;
 }
 
 bool httpRequest::isKeepAlive() const {
@@ -26,60 +63,101 @@ bool httpRequest::isKeepAlive() const {
 }
 
 
-/* 主状态机 */
-bool httpRequest::parse(Buffer& buff) {
+/* 主状态机
+    返回 NO_REQUEST 表示数据还不完整，已解析的部分保留在状态机里，等下次读到数据后继续；
+    包体按 Content-Length 或 chunked 分帧，边收边从缓冲区取走，不会整体堆积在读缓冲区里 */
+httpRequest::HTTP_CODE httpRequest::parse(Buffer& buff) {
     const char CRLF[] = "\r\n";
-    if(buff.readableBytes() <= 0) {     // 缓冲区不可读
-        return false;
-    }
-    while(buff.readableBytes() && m_state != FINISH) {
+    while(m_state != FINISH) {
+        if(m_state == BODY || m_state == CHUNK_DATA) {  // 包体数据按长度读取，不按行
+            size_t len = std::min(buff.readableBytes(), m_contentLen);
+            if(len == 0 && m_contentLen > 0) {
+                return NO_REQUEST;
+            }
+            if(!appendBody(buff.peek(), len)) {
+                return m_bodyError;
+            }
+            buff.retrieve(len);
+            m_contentLen -= len;
+            if(m_contentLen == 0) {
+                if(m_state == CHUNK_DATA) {
+                    m_state = CHUNK_CRLF;
+                }
+                else if(!finishBody()) {
+                    return m_bodyError;
+                }
+            }
+            continue;
+        }
+
         const char* lineEnd = search(buff.peek(), buff.beginWriteConst(), CRLF, CRLF + 2);  // 查找当前行结尾字符地址
+        if(lineEnd == buff.beginWriteConst()) {     // 还没收到完整的一行
+            if(m_state == CHUNK_TRAILER && m_trailerLen + buff.readableBytes() > MAX_TRAILER_SIZE) {
+                LOG_ERROR("Chunk trailer too large");
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
         std::string line(buff.peek(), lineEnd);     // line 返回代表本行的字符串
+        buff.retrieveUntil(lineEnd + 2);            // 调整读指针位置
         switch(m_state)
         {
         case REQUEST_LINE:
             if(!parseRequestLine(line)) {       // 解析请求行
-                return false;
+                return BAD_REQUEST;
             }
-            parsePath();
             break;    
         case HEADERS:
-            parseHeader(line);
-            if(buff.readableBytes() <= 2) {     // 如果缓冲区可读字段小于2，那么就认为解析完了，状态转移到FINISH
-                m_state = FINISH;
+            if(line.empty()) {                  // 空行，头部结束
+                if(!beginBody()) {
+                    return m_bodyError;
+                }
+            }
+            else {
+                parseHeader(line);
+            }
+            break;
+        case CHUNK_SIZE:
+        {
+            char* end = nullptr;
+            unsigned long long size = strtoull(line.c_str(), &end, 16);     // 忽略 ';' 之后的块扩展
+            if(end == line.c_str() || (*end != '\0' && *end != ';' && *end != ' ')) {
+                LOG_ERROR("Bad chunk size: %s", line.c_str());
+                return BAD_REQUEST;
+            }
+            if(size > m_maxBodySize - m_bodyLen) {
+                return BODY_TOO_LARGE;
+            }
+            m_contentLen = size;
+            m_state = (size == 0) ? CHUNK_TRAILER : CHUNK_DATA;
+            break;
+        }
+        case CHUNK_CRLF:
+            if(!line.empty()) {                 // 块数据后面必须紧跟 CRLF
+                return BAD_REQUEST;
             }
+            m_state = CHUNK_SIZE;
             break;
-        case BODY:
-            parseBody(line);        // 解析body
+        case CHUNK_TRAILER:             // trailer 只计数不保存，总长度和行数有上限
+            m_trailerLen += line.size() + 2;
+            m_trailerLines += line.empty() ? 0 : 1;
+            if(m_trailerLen > MAX_TRAILER_SIZE || m_trailerLines > MAX_TRAILER_LINES) {
+                LOG_ERROR("Chunk trailer too large");
+                return BAD_REQUEST;
+            }
+            if(line.empty() && !finishBody()) {
+                return m_bodyError;
+            }
             break;
         default:
             break;
         }
-        if(lineEnd == buff.beginWrite())    // 缓冲区内容已经被读取完
-        { 
-            break; 
-        }
-        buff.retrieveUntil(lineEnd + 2);    // 调整读指针位置
     }
     LOG_DEBUG("[%s], [%s], [%s]", m_method.c_str(), m_path.c_str(), m_version.c_str());     // 打印 方法、资源路径、版本号
-    return true;
+    return GET_REQUEST;
 }
 
-void httpRequest::parsePath() {
-    if(m_path == "/") {
-        m_path = "/index.html";     // 设置默认资源
-    }
-    else {                          // 在默认静态资源库里查找匹配到的html
-        for(auto &item: DEFAULT_HTML) {
-            if(item == m_path) {
-                m_path += ".html";
-                break;
-            }
-        }
-    }
-}
-
-/* 正则匹配解析请求行 */
+/* 正则匹配解析请求行，随后按方法和路径（不含查询串）匹配路由 */
 bool httpRequest::parseRequestLine(const string& line) {
     regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
     smatch subMatch;
@@ -87,6 +165,12 @@ bool httpRequest::parseRequestLine(const string& line) {
         m_method = subMatch[1];
         m_path = subMatch[2];
         m_version = subMatch[3];
+        size_t query = m_path.find('?');
+        if(query != string::npos) {
+            m_query = m_path.substr(query + 1);
+            m_path.erase(query);
+        }
+        m_route = httpRouter::GetInstance()->match(m_method.c_str(), m_path.data(), m_path.size(), m_params);
         m_state = HEADERS;
         return true;
     }
@@ -94,24 +178,135 @@ bool httpRequest::parseRequestLine(const string& line) {
     return false;
 }
 
-/* 解析头部字段 */
+/* 解析头部字段；HTTP/2 会把 Cookie 拆成多个字段，按 "; " 拼回一个 */
 void httpRequest::parseHeader(const string& line) {
     regex patten("^([^:]*): ?(.*)$");
     smatch subMatch;
     if(regex_match(line, subMatch, patten)) {
-        m_header[subMatch[1]] = subMatch[2];
+        string &value = m_header[subMatch[1]];
+        if(value != "" && strcasecmp(subMatch[1].str().c_str(), "Cookie") == 0) {
+            value += "; " + subMatch[2].str();
+        }
+        else {
+            value = subMatch[2];
+        }
+    }
+}
+
+/* 头部解析完，根据 Transfer-Encoding / Content-Length 决定包体的分帧方式 */
+bool httpRequest::beginBody() {
+    if(m_route && m_route->onBody) {
+        m_bodyHandler = &m_route->onBody;
+    }
+
+    string te = getHeader("Transfer-Encoding");
+    string cl = getHeader("Content-Length");
+    if(te != "") {                      // 两者同时出现时以 Transfer-Encoding 为准
+        if(strcasecmp(te.c_str(), "chunked") != 0) {
+            LOG_ERROR("Unsupported Transfer-Encoding: %s", te.c_str());
+            return false;
+        }
+        m_state = CHUNK_SIZE;
+        return true;
+    }
+    if(cl != "") {
+        char* end = nullptr;
+        unsigned long long len = strtoull(cl.c_str(), &end, 10);
+        if(end == cl.c_str() || *end != '\0' || cl[0] == '-') {
+            LOG_ERROR("Bad Content-Length: %s", cl.c_str());
+            return false;
+        }
+        if(len > m_maxBodySize) {
+            m_bodyError = BODY_TOO_LARGE;
+            return false;
+        }
+        m_contentLen = len;
+        if(len > 0) {
+            m_state = BODY;
+            return true;
+        }
+    }
+    return finishBody();                // 没有包体
+}
+
+/* 收到一段包体：优先交给注册的回调，其次放内存，超过阈值后转存到临时文件 */
+bool httpRequest::appendBody(const char* data, size_t len) {
+    if(len > m_maxBodySize - m_bodyLen) {
+        m_bodyError = BODY_TOO_LARGE;
+        return false;
+    }
+    m_bodyLen += len;
+    if(m_bodyHandler) {
+        if(!(*m_bodyHandler)(*this, data, len)) {
+            m_bodyError = BAD_REQUEST;
+            return false;
+        }
+        return true;
+    }
+    if(m_bodyFd < 0 && m_bodyLen > m_bodyMemLimit && !spillBody()) {
+        m_bodyError = INTERNAL_ERROR;
+        return false;
+    }
+    if(m_bodyFd < 0) {
+        m_body.append(data, len);
+        return true;
     }
-    else {                          // 头部没有，那就转移到BODY状态去试着解析
-        m_state = BODY;
+    if(!writeBody(data, len)) {
+        m_bodyError = INTERNAL_ERROR;
+        return false;
     }
+    return true;
 }
 
-/* 解析包体（POST方法） */
-void httpRequest::parseBody(const string& line) {
-    m_body = line;
-    parsePost();
-    m_state = FINISH;               // 包体解析完毕，那么转台转移到 FINISH
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+/* 写临时文件，处理部分写入和 EINTR */
+bool httpRequest::writeBody(const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(m_bodyFd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Write body file error: %d", errno);
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* 创建匿名临时文件，把已经缓存在内存里的包体挪过去 */
+bool httpRequest::spillBody() {
+    char name[] = "/tmp/webserver_body_XXXXXX";
+    m_bodyFd = mkstemp(name);
+    if(m_bodyFd < 0) {
+        LOG_ERROR("Create body file error: %d", errno);
+        return false;
+    }
+    unlink(name);       // 文件随 fd 关闭自动删除
+    LOG_DEBUG("Body of %s spills to file, fd:%d", m_path.c_str(), m_bodyFd);
+    string body;
+    body.swap(m_body);
+    return writeBody(body.data(), body.size());
+}
+
+/* 包体接收完毕；回调在包体结束时拒绝请求则返回 false */
+bool httpRequest::finishBody() {
+    m_state = FINISH;               // 包体解析完毕，那么状态转移到 FINISH
+    if(m_bodyHandler) {
+        if(!(*m_bodyHandler)(*this, nullptr, 0)) {
+            m_bodyError = BAD_REQUEST;
+            return false;
+        }
+    }
+    else if(m_bodyFd >= 0) {
+        lseek(m_bodyFd, 0, SEEK_SET);
+    }
+    else if(!m_body.empty()) {
+        parsePost();
+    }
+    LOG_DEBUG("Body len:%d", (int)m_bodyLen);
+    return true;
 }
 
 int httpRequest::converHex(char ch) {   // 16进制数转10进制
@@ -124,25 +319,9 @@ int httpRequest::converHex(char ch) {   // 16进制数转10进制
 
 void httpRequest::parsePost() 
 {
-    if(m_method == "POST" && m_header["Content-Type"] == "application/x-www-form-urlencoded") 
+    if(m_method == "POST" && getHeader("Content-Type") == "application/x-www-form-urlencoded") 
     {
-        parseFromUrlencoded();
-        if(DEFAULT_HTML_TAG.count(m_path))  // 要找的页面是否在默认页面里
-        {
-            int tag = DEFAULT_HTML_TAG.find(m_path)->second;    // 有的话，查找它
-            LOG_DEBUG("Tag:%d", tag);
-            if(tag == 0 || tag == 1) 
-            {
-                bool isLogin = (tag == 1);                  // 存在的话，设置login 为 true
-                if(userVerify(m_post["username"], m_post["password"], isLogin))   // 验证通过去 欢迎页面
-                {
-                    m_path = "/welcome.html";
-                } 
-                else {                                                          // 否则去 错误页面
-                    m_path = "/error.html";
-                }
-            }
-        }
+        parseFromUrlencoded();      // 表单交给路由的处理函数用 getPost() 读取
     }   
 }
 
@@ -195,78 +374,110 @@ void httpRequest::parseFromUrlencoded()
 }
 
 
-/* 登陆验证 */
-bool httpRequest::userVerify(const string &name, const string &pwd, bool isLogin) {
+/* 登陆验证：经 userStore 的异步接口查询，等待期间不占用线程和连接 */
+co::Task<httpRequest::VERIFY_RESULT> httpRequest::userVerifyAsync(string name, string pwd, bool isLogin)
+{
     if(name == "" || pwd == "") 
     { 
-        return false; 
+        co_return VERIFY_FAILED; 
     }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    LOG_INFO("Verify name:%s", name.c_str());
 
-    /* RAII方式获得一个数据库连接池的连接 */
-    MYSQL* sql;
-    connctionRAII(&sql,  conn_pool::GetInstance());
-    assert(sql);
-    
-    bool flag = false;
-    char order[256] = { 0 };
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { 
-        flag = true; 
+    credential cred;
+    if(!m_credentials.get(name, cred) && needLookup(name, isLogin, cred))
+    {
+        userStore::result res = co_await m_store->find(name);
+        if(!res.ok)
+        {
+            LOG_WARN("Verify %s failed: %s", name.c_str(), res.error.c_str());
+            co_return VERIFY_UNAVAILABLE;
+        }
+        cred = loadCredential(name, res);
+    }
+    bool ok = checkCredential(cred, pwd, isLogin);
+    if(isLogin || !ok)
+    {
+        co_return ok ? VERIFY_OK : VERIFY_FAILED;
     }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, passwd FROM user WHERE username='%s' LIMIT 1", name.c_str());    // 注意要写的SQL语句正确性（要和自己建的数据库表匹配）
-    LOG_DEBUG("%s", order);
 
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
+    userStore::result res = co_await m_store->add(name, pwd);
+    bool registered = res.ok && !res.exists;
+    if(!registered)
+    {
+        LOG_DEBUG("Insert error: %s", res.exists ? "user used" : res.error.c_str());
     }
-    res = mysql_store_result(sql);
+    storeCredential(name, pwd, registered);
+    co_return registered ? VERIFY_OK : (res.ok ? VERIFY_FAILED : VERIFY_UNAVAILABLE);
+}
+
+void httpRequest::initCredentialCache(size_t capacity, int ttlMs)
+{
+    m_credentials.reset(capacity, ttlMs);
+}
+
+string httpRequest::pwdDigest(const string &pwd)
+{
+    unsigned char digest[20];
+    Utils::sha1(PWD_SALT + pwd, digest);
+    return string(reinterpret_cast<const char*>(digest), sizeof(digest));
+}
 
-    while(MYSQL_ROW row = mysql_fetch_row(res)) 
+/* 查询结果：用户不存在同样缓存，重复注册检查和错误的用户名也不用再查库 */
+httpRequest::credential httpRequest::loadCredential(const string &name, const userStore::result &res)
+{
+    credential cred{false, ""};
+    if(res.exists)
     {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) 
-            { 
-                flag = true; 
-            }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
-        }
+        cred.exists = true;
+        cred.verifier = pwdDigest(res.passwd);
+        userFilter::GetInstance()->add(name);
     }
-    mysql_free_result(res);
+    m_credentials.put(name, cred);
+    return cred;
+}
 
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) 
+/* 注册时过滤器报告用户名一定不存在，就不用查库，直接 INSERT，由唯一键兜底 */
+bool httpRequest::needLookup(const string &name, bool isLogin, credential &cred)
+{
+    if(isLogin || userFilter::GetInstance()->mayExist(name))
     {
-        LOG_DEBUG("regirster!");printf("regirster");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, passwd) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) 
-        { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
+        return true;
     }
+    cred = credential{false, ""};
+    return false;
+}
 
-    // 在此释放刚才登录注册占用的连接  
-    conn_pool::GetInstance()->ReleaseConnection(sql);
+/* 登录：用户存在且口令一致；注册：用户名未被使用 */
+bool httpRequest::checkCredential(const credential &cred, const string &pwd, bool isLogin)
+{
+    if(!isLogin)
+    {
+        if(cred.exists)
+        {
+            LOG_DEBUG("user used!");
+        }
+        return !cred.exists;
+    }
+    if(cred.exists && cred.verifier != pwdDigest(pwd))
+    {
+        LOG_DEBUG("pwd error!");
+        return false;
+    }
+    return cred.exists;
+}
 
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
+/* 注册成功后缓存新用户；失败时（可能被别处抢先注册）丢掉缓存的“不存在”，下次重新查库 */
+void httpRequest::storeCredential(const string &name, const string &pwd, bool registered)
+{
+    if(registered)
+    {
+        m_credentials.put(name, credential{true, pwdDigest(pwd)});
+        userFilter::GetInstance()->add(name);
+    }
+    else
+    {
+        m_credentials.erase(name);
+    }
 }
 
 std::string httpRequest::path() const{
@@ -284,6 +495,50 @@ std::string httpRequest::version() const {
     return m_version;
 }
 
+std::string httpRequest::param(const std::string& name) const {
+    if(!m_route) {
+        return "";
+    }
+    for(int i = 0; i < m_params.count && i < static_cast<int>(m_route->params.size()); i++) {
+        if(m_route->params[i] == name) {
+            return m_path.substr(m_params.offset[i], m_params.len[i]);
+        }
+    }
+    return "";
+}
+
+std::string httpRequest::getHeader(const std::string& key) const {
+    for(auto &item: m_header) {
+        if(strcasecmp(item.first.c_str(), key.c_str()) == 0) {
+            return item.second;
+        }
+    }
+    return "";
+}
+
+/* Cookie: a=1; b=2，名字区分大小写，取第一个同名的 */
+std::string httpRequest::cookie(const std::string& name) const {
+    string header = getHeader("Cookie");
+    size_t pos = 0;
+    while(pos < header.size()) {
+        size_t end = header.find(';', pos);
+        end = end == string::npos ? header.size() : end;
+        while(pos < end && header[pos] == ' ') {
+            pos++;
+        }
+        size_t eq = header.find('=', pos);
+        if(eq < end && header.compare(pos, eq - pos, name) == 0) {
+            size_t valueEnd = end;
+            while(valueEnd > eq + 1 && header[valueEnd - 1] == ' ') {
+                valueEnd--;
+            }
+            return header.substr(eq + 1, valueEnd - eq - 1);
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
 std::string httpRequest::getPost(const std::string& key) const {
     assert(key != "");
     if(m_post.count(key) == 1) {
@@ -298,4 +553,4 @@ std::string httpRequest::getPost(const char* key) const {
         return m_post.find(key)->second;
     }
     return "";
-}
\ No newline at end of file
+}
\ No newline at end of file
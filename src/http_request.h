@@ -3,15 +3,19 @@
 #define HTTP_REQUEST_H
 
 #include <unordered_map>
-#include <unordered_set>
 #include <string>
 #include <regex>
+#include <functional>
 #include <errno.h>     
-#include <mysql/mysql.h>  //mysql
+#include <stdlib.h>     // mkstemp
+#include <strings.h>    // strcasecmp
+#include <unistd.h>     // write, unlink
 
+#include "router.h"
 #include "../net/Buffer.h"
 #include "../base/log.h"
-#include "../base/sql_conn_pool.h"
+#include "user_store.h"
+#include "../base/lru_cache.h"
 
 using namespace net;
 
@@ -21,7 +25,11 @@ public:
     enum PARSE_STATE{
         REQUEST_LINE,
         HEADERS,
-        BODY,
+        BODY,           // Content-Length 定长包体
+        CHUNK_SIZE,     // Transfer-Encoding: chunked 的块长度行
+        CHUNK_DATA,     // 块数据
+        CHUNK_CRLF,     // 块数据后的 CRLF
+        CHUNK_TRAILER,  // 最后一个块之后的 trailer 头部
         FINISH,
     };
 
@@ -34,42 +42,106 @@ public:
         FILE_REQUEST,
         INTERNAL_ERROR,
         CLOSED_CONNECTION, 
+        BODY_TOO_LARGE,         // 包体超过 m_maxBodySize
     };
 
+    enum VERIFY_RESULT{
+        VERIFY_OK,
+        VERIFY_FAILED,          // 用户名或口令不对、用户名已被注册
+        VERIFY_UNAVAILABLE,     // 用户存储出错、超时或熔断，不是用户的问题
+    };
+
+    typedef httpRouter::BodyCallBack BodyCallBack;
+
 public:
-    httpRequest(){init();};
-    ~httpRequest() = default;
+    httpRequest(): m_bodyFd(-1) {init();};
+    httpRequest(const httpRequest &other);      // 包体临时文件的描述符 dup 一份，各自关闭
+    httpRequest &operator=(const httpRequest &) = delete;
+    ~httpRequest();
 
     void init();
-    bool parse(Buffer &buff);
+    HTTP_CODE parse(Buffer &buff);
+    bool isFinish() const { return m_state == FINISH; }
+    bool isIdle() const { return m_state == REQUEST_LINE; }    // 还没有收到完整的请求行
 
     std::string path() const;   // url
     std::string &path();
     std::string method() const;
     std::string version() const;
+    const std::string &query() const { return m_query; }       // '?' 之后的部分
+    const httpRouter::route *route() const { return m_route; }  // 匹配到的路由，没有时为 nullptr
+    std::string param(const std::string &name) const;           // 路由中 :name / *name 匹配到的值
     std::string getPost(const std::string &key) const;
     std::string getPost(const char *key) const;
+    std::string getHeader(const std::string &key) const;     // 头部字段名不区分大小写
+    std::string cookie(const std::string &name) const;       // Cookie 头里 name 的值，没有时为空
+
+    const std::string &body() const { return m_body; }      // 内存中的包体（未落盘时）
+    int bodyFd() const { return m_bodyFd; }                 // 包体超过内存阈值后所在的临时文件，否则为 -1
+    size_t bodyLen() const { return m_bodyLen; }
 
     bool isKeepAlive() const;
+
+    /* 登录注册验证，经 userStore 的异步接口查询，等待期间不占用线程和连接 */
+    static co::Task<VERIFY_RESULT> userVerifyAsync(std::string name, std::string pwd, bool isLogin);
+
+    /* 登录注册用的用户存储，需在 server 启动前设置，由调用方持有 */
+    static void setUserStore(userStore *store) { m_store = store; }
+
+    /* 用户凭据缓存：查库结果按用户名缓存，命中时登录不再访问数据库；需在 server 启动前调用，capacity 为 0 时关闭 */
+    static void initCredentialCache(size_t capacity, int ttlMs);
+    static lru_stats credentialStats() { return m_credentials.getStats(); }
+
+public:
+    static size_t m_bodyMemLimit;       // 包体超过该值则转存到临时文件
+    static size_t m_maxBodySize;        // 允许的最大包体长度
+
+    static const size_t MAX_TRAILER_SIZE = 8 * 1024;    // chunked 包体 trailer 的总长度上限（含 CRLF）
+    static const size_t MAX_TRAILER_LINES = 32;
+
 private:
     bool parseRequestLine(const std::string &line);
     void parseHeader(const std::string &line);
-    void parseBody(const std::string &line);
-    void parsePath();
+    bool beginBody();
+    bool appendBody(const char *data, size_t len);
+    bool spillBody();
+    bool writeBody(const char *data, size_t len);
+    bool finishBody();
     void parsePost();
     void parseFromUrlencoded();
 
-    static bool userVerify(const std::string& name, const std::string& pwd, bool isLogin);
     static int converHex(char ch);
 
+    /* 只缓存口令加盐后的摘要，不保存明文；exists 为 false 表示库里没有这个用户 */
+    struct credential
+    {
+        bool exists;
+        std::string verifier;
+    };
+    static std::string pwdDigest(const std::string &pwd);
+    static bool needLookup(const std::string &name, bool isLogin, credential &cred);
+    static credential loadCredential(const std::string &name, const userStore::result &res);
+    static bool checkCredential(const credential &cred, const std::string &pwd, bool isLogin);
+    static void storeCredential(const std::string &name, const std::string &pwd, bool registered);
+
+    static lru_cache<credential> m_credentials;
+    static userStore *m_store;
+
 private:
     PARSE_STATE m_state;
-    std::string m_method, m_path, m_version, m_body;
+    HTTP_CODE m_bodyError;
+    std::string m_method, m_path, m_version, m_query, m_body;
     std::unordered_map<std::string, std::string> m_header;
     std::unordered_map<std::string, std::string> m_post;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
+    size_t m_contentLen;        // Content-Length 声明的长度 / 当前块剩余长度
+    size_t m_bodyLen;           // 已收到的包体长度
+    int m_bodyFd;
+    size_t m_trailerLen;        // 已收到的 trailer 字节数和行数
+    size_t m_trailerLines;
+    const BodyCallBack *m_bodyHandler;
+    const httpRouter::route *m_route;
+    httpRouter::params m_params;        // 参数值在 m_path 中的位置
 };
 
 
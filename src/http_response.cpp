@@ -21,8 +21,8 @@ const unordered_map<string, string> httpResponse::SUFFIX_TYPE = {
     { ".avi",   "video/x-msvideo" },
     { ".gz",    "application/x-gzip" },
     { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
+    { ".css",   "text/css" },
+    { ".js",    "text/javascript" },
 };
 
 const unordered_map<int, string> httpResponse::CODE_STATUS = {
@@ -30,12 +30,16 @@ const unordered_map<int, string> httpResponse::CODE_STATUS = {
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 413, "Payload Too Large" },
+    { 503, "Service Unavailable" },
 };
 
 const unordered_map<int, string> httpResponse::CODE_PATH = {
     { 400, "/400.html" },
     { 403, "/403.html" },
     { 404, "/404.html" },
+    { 413, "/413.html" },
+    { 503, "/error.html" },
 };
 
 httpResponse::httpResponse() {
@@ -62,14 +66,72 @@ void httpResponse::init(const string& srcDir, string& path, bool isKeepAlive, in
     m_srcDir = srcDir;
     m_mmFile = nullptr; 
     m_mmFileStat = { 0 };
+    m_contentType = "";
+    m_source = nullptr;
+    m_resume = nullptr;
+    m_headers.clear();
+}
+
+void httpResponse::stream(const string& contentType, const ChunkSource& source) {
+    assert(source);
+    m_contentType = contentType;
+    m_source = source;
+}
+
+/* 从数据源拉取包体并按 chunked 编码追加到 buff，直到 buff 中待发数据达到 watermark；
+    数据源结束后写入最后的 0 长度块，返回 false。数据源某次没有产生数据时提前返回，
+    等生产者调用 resume 后连接再拉取 */
+bool httpResponse::nextChunk(Buffer& buff, size_t watermark) {
+    while(m_source && buff.readableBytes() < watermark) {
+        /* 先占位定长的 chunk-size（允许前导 0），数据源直接写进 buff，写完再回填长度 */
+        buff.append("00000000\r\n", 10);
+        size_t before = buff.readableBytes();
+        bool more = pullSource(buff);
+        size_t len = buff.readableBytes() - before;
+        if(len > 0) {
+            char size[17];
+            snprintf(size, sizeof(size), "%08zx", len);
+            memcpy(buff.beginWrite() - len - 10, size, 8);
+            buff.append("\r\n", 2);
+        }
+        else {
+            buff.unwrite(10);
+            if(more) {
+                break;
+            }
+        }
+        if(!more) {
+            buff.append("0\r\n\r\n", 5);
+        }
+    }
+    return isStream();
+}
+
+bool httpResponse::pullSource(Buffer& buff) {
+    if(!m_source) {
+        return false;
+    }
+    if(!m_source(buff)) {
+        m_source = nullptr;
+        return false;
+    }
+    return true;
 }
 
 void httpResponse::makeResponse(Buffer& buff) {
+    if(isStream()) {                /* 流式响应：只写响应头，包体后续由连接按需拉取 */
+        m_code = (m_code == -1) ? 200 : m_code;
+        addStateLine(buff);
+        addHeader(buff);
+        buff.append("Transfer-Encoding: chunked\r\n\r\n");
+        return;
+    }
+
     /* 判断请求的资源文件 */
-    if(stat((m_srcDir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode)) {
+    if(CODE_PATH.count(m_code) == 0 && (stat((m_srcDir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode))) {
         m_code = 404;
     }
-    else if(!(m_mmFileStat.st_mode & S_IROTH)) {
+    else if(CODE_PATH.count(m_code) == 0 && !(m_mmFileStat.st_mode & S_IROTH)) {
         m_code = 403;
     }
     else if(m_code == -1) { 
@@ -117,7 +179,10 @@ void httpResponse::addHeader(Buffer& buff) {
     } else{
         buff.append("close\r\n");
     }
-    buff.append("Content-type: " + getFileType() + "\r\n");
+    buff.append("Content-type: " + contentType() + "\r\n");
+    for(auto &header: m_headers) {
+        buff.append(header.first + ": " + header.second + "\r\n");
+    }
 }
 
 void httpResponse::addContent(Buffer& buff) {
@@ -130,8 +195,9 @@ void httpResponse::addContent(Buffer& buff) {
     /* 将文件映射到内存提高文件的访问速度 
         MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
     LOG_DEBUG("file path %s", (m_srcDir + m_path).data());
-    int* mmRet = (int*)mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
+    void* mmRet = mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    if(mmRet == MAP_FAILED) {
+        close(srcFd);
         errorContent(buff, "File NotFound!");
         return; 
     }
@@ -147,6 +213,10 @@ void httpResponse::unmapFile() {
     }
 }
 
+string httpResponse::contentType() {
+    return m_contentType == "" ? getFileType() : m_contentType;
+}
+
 string httpResponse::getFileType() {
     /* 判断文件类型 */
     string::size_type idx = m_path.find_last_of('.');
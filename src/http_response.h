@@ -3,10 +3,13 @@
 
 
 #include <unordered_map>
+#include <vector>
+#include <functional>
 #include <fcntl.h>       // open
 #include <unistd.h>      // close
 #include <sys/stat.h>    // stat
 #include <sys/mman.h>    // mmap, munmap
+#include <string.h>      // strlen
 #include "../net/Buffer.h"
 #include "../base/log.h"
 
@@ -14,6 +17,13 @@ using namespace net;
 
 class httpResponse
 {
+public:
+    /* 流式响应的数据源：每次往 Buffer 里追加一段包体，返回 false 表示包体已经全部产生；
+        返回 true 但没有追加数据时连接停止拉取，直到生产者调用 resume */
+    typedef std::function<bool(Buffer&)> ChunkSource;
+    /* 数据源有了新数据时调用，可以在任意线程、连接关闭后调用；拉取时持有连接锁，调用前要先放开数据源自己的锁 */
+    typedef std::function<void()> Resume;
+
 public:
     httpResponse(/* args */);
     ~httpResponse();
@@ -25,6 +35,22 @@ public:
     size_t fileLen() const;
     void errorContent(Buffer& buff, std::string message);
     int code() const { return m_code; }
+    void setCode(int code) { m_code = code; }
+    void setPath(const std::string& path) { m_path = path; }    // 改为返回资源目录下的另一个文件
+    /* 额外的响应头（如 Set-Cookie），原样写出，可以重复 */
+    void setHeader(const std::string& name, const std::string& value) { m_headers.emplace_back(name, value); }
+    const std::vector<std::pair<std::string, std::string>>& headers() const { return m_headers; }
+
+    /* 切换为 chunked 流式响应：makeResponse 只写响应头，包体由 nextChunk 按需拉取 */
+    void stream(const std::string& contentType, const ChunkSource& source);
+    bool isStream() const { return static_cast<bool>(m_source); }
+    bool nextChunk(Buffer& buff, size_t watermark);
+    bool pullSource(Buffer& buff);      // 不做 chunked 编码，直接取原始包体（HTTP/2 使用）
+    void setResume(const Resume& resume) { m_resume = resume; }     // 由连接在分发请求前设置
+    const Resume& resume() const { return m_resume; }
+
+    std::string contentType();
+
 private:
     void addStateLine(Buffer &buff);
     void addHeader(Buffer &buff);
@@ -42,6 +68,11 @@ private:
     char* m_mmFile; 
     struct stat m_mmFileStat;
 
+    std::string m_contentType;
+    ChunkSource m_source;
+    Resume m_resume;
+    std::vector<std::pair<std::string, std::string>> m_headers;
+
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
@@ -0,0 +1,182 @@
+#include "memory_user_store.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../base/log.h"
+
+using namespace std;
+
+memoryUserStore::memoryUserStore(int shardNum): m_shardNum(shardNum > 0 ? shardNum : 1), m_fd(-1)
+{
+    m_shards.reset(new shard[m_shardNum]);
+}
+
+memoryUserStore::~memoryUserStore()
+{
+    if(m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool memoryUserStore::init(const string &path)
+{
+    m_path = path;
+    if(m_path.empty())
+    {
+        return true;
+    }
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(m_fd < 0)
+    {
+        LOG_ERROR("User store %s: %s", m_path.c_str(), strerror(errno));
+        return false;
+    }
+    return load();
+}
+
+memoryUserStore::shard &memoryUserStore::shardOf(const string &name)
+{
+    return m_shards[hash<string>()(name) % m_shardNum];
+}
+
+/* 重放日志；解析到不完整或损坏的记录就停下，把文件截到最后一条完整记录 */
+bool memoryUserStore::load()
+{
+    string data;
+    char buf[65536];
+    ssize_t n;
+    while((n = pread(m_fd, buf, sizeof(buf), data.size())) > 0)
+    {
+        data.append(buf, n);
+    }
+    if(n < 0)
+    {
+        LOG_ERROR("User store %s: %s", m_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    size_t pos = 0, users = 0;
+    while(pos < data.size())
+    {
+        char *end;
+        const char *p = data.c_str() + pos;
+        unsigned long nameLen = strtoul(p, &end, 10);
+        if(*end != ' ')
+        {
+            break;
+        }
+        unsigned long pwdLen = strtoul(end + 1, &end, 10);
+        if(*end != ' ')
+        {
+            break;
+        }
+        size_t start = end + 1 - data.c_str();
+        if(nameLen > data.size() || pwdLen > data.size() || start + nameLen + pwdLen >= data.size()
+            || data[start + nameLen + pwdLen] != '\n')
+        {
+            break;
+        }
+        string name = data.substr(start, nameLen);
+        shard &s = shardOf(name);
+        if(s.users.emplace(std::move(name), data.substr(start + nameLen, pwdLen)).second)
+        {
+            users++;
+        }
+        pos = start + nameLen + pwdLen + 1;
+    }
+    if(pos < data.size())
+    {
+        LOG_WARN("User store %s: dropping %zu bytes of incomplete record at offset %zu", m_path.c_str(), data.size() - pos, pos);
+        if(ftruncate(m_fd, pos) != 0)
+        {
+            LOG_ERROR("User store %s: %s", m_path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    LOG_INFO("User store %s: %zu users loaded", m_path.c_str(), users);
+    return true;
+}
+
+/* 写失败时把文件截回写之前的长度，不留半条记录 */
+bool memoryUserStore::append(const string &name, const string &pwd)
+{
+    string record = to_string(name.size()) + ' ' + to_string(pwd.size()) + ' ' + name + pwd + '\n';
+    lock_guard<mutex> locker(m_fileMutex);
+    off_t size = lseek(m_fd, 0, SEEK_END);
+    ssize_t n = write(m_fd, record.data(), record.size());
+    if(n == static_cast<ssize_t>(record.size()))
+    {
+        return true;
+    }
+    LOG_ERROR("User store %s: append failed: %s", m_path.c_str(), n < 0 ? strerror(errno) : "short write");
+    if(size >= 0 && ftruncate(m_fd, size) != 0)
+    {
+        LOG_ERROR("User store %s: %s", m_path.c_str(), strerror(errno));
+    }
+    return false;
+}
+
+co::Task<userStore::result> memoryUserStore::find(string name)
+{
+    result res;
+    res.ok = true;
+    shard &s = shardOf(name);
+    lock_guard<mutex> locker(s.mutex);
+    unordered_map<string, string>::iterator it = s.users.find(name);
+    if(it != s.users.end())
+    {
+        res.exists = true;
+        res.passwd = it->second;
+    }
+    co_return res;
+}
+
+/* 先写日志再放进内存，分片锁保证同名的注册只有一个成功 */
+co::Task<userStore::result> memoryUserStore::add(string name, string pwd)
+{
+    result res;
+    shard &s = shardOf(name);
+    lock_guard<mutex> locker(s.mutex);
+    if(s.users.count(name))
+    {
+        res.ok = true;
+        res.exists = true;
+        co_return res;
+    }
+    if(m_fd >= 0 && !append(name, pwd))
+    {
+        res.error = "append failed";
+        co_return res;
+    }
+    s.users.emplace(name, pwd);
+    res.ok = true;
+    co_return res;
+}
+
+bool memoryUserStore::count(size_t &users)
+{
+    users = 0;
+    for(size_t i = 0; i < m_shardNum; i++)
+    {
+        lock_guard<mutex> locker(m_shards[i].mutex);
+        users += m_shards[i].users.size();
+    }
+    return true;
+}
+
+bool memoryUserStore::scan(const function<void(const string &)> &fn)
+{
+    for(size_t i = 0; i < m_shardNum; i++)
+    {
+        lock_guard<mutex> locker(m_shards[i].mutex);
+        for(auto &user: m_shards[i].users)
+        {
+            fn(user.first);
+        }
+    }
+    return true;
+}
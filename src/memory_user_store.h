@@ -0,0 +1,54 @@
+#ifndef MEMORY_USER_STORE_H
+#define MEMORY_USER_STORE_H
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "user_store.h"
+
+/* 进程内的用户存储：按用户名哈希分片，每个分片一把锁，登录之间基本不争用
+
+    可选一个只追加的日志文件：init 时重放，每次注册成功前先追加一条再放进内存。
+    - 记录格式为 "<用户名长度> <口令长度> <用户名><口令>\n"，用户名、口令里有什么字符都行
+    - 末尾不完整的记录（写到一半进程退出）在重放时截掉
+    - 只 write 不 fsync：进程崩溃不丢数据，机器掉电可能丢最后几条
+    - 追加由一把文件锁串行，只有注册会拿它
+*/
+class memoryUserStore: public userStore
+{
+public:
+    explicit memoryUserStore(int shardNum = 64);
+    ~memoryUserStore();
+
+    /* path 为空时只在内存里；文件打不开或读失败时返回 false */
+    bool init(const std::string &path);
+
+    co::Task<result> find(std::string name) override;
+    co::Task<result> add(std::string name, std::string pwd) override;
+    bool count(size_t &users) override;
+    bool scan(const std::function<void(const std::string &)> &fn) override;
+    const char *name() const override { return "memory"; }
+
+private:
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::string> users;
+    };
+
+    shard &shardOf(const std::string &name);
+    bool load();
+    bool append(const std::string &name, const std::string &pwd);
+
+private:
+    size_t m_shardNum;
+    std::unique_ptr<shard[]> m_shards;
+
+    std::string m_path;
+    int m_fd;
+    std::mutex m_fileMutex;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "mysql_user_store.h"
+
+#include <stdlib.h>
+#include <mysql/mysqld_error.h>
+
+#include "../base/sql_async.h"
+#include "../base/log.h"
+#include "user_writer.h"
+
+using namespace std;
+
+mysqlUserStore::mysqlUserStore(sql_router *router, const breaker_config &breaker):
+    m_router(router), m_db(sql_async::GetInstance()), m_writer(userWriter::GetInstance()), m_breaker("mysql", breaker)
+{
+}
+
+mysqlUserStore::mysqlUserStore(const sql_endpoint &primary, const vector<sql_endpoint> &replicas, const options &opt):
+    m_ownRouter(new sql_router), m_ownDb(new sql_async), m_ownWriter(new userWriter), m_breaker(primary.name, opt.breaker)
+{
+    m_router = m_ownRouter.get();
+    m_db = m_ownDb.get();
+    m_writer = m_ownWriter.get();
+    m_router->init(primary, replicas, opt.user, opt.passWord, opt.dbName,
+        opt.maxConn, opt.minConn, opt.waitMs, opt.localConn);
+    m_db->init(m_router, opt.sqlThreads, opt.timeoutMs);
+    m_writer->init(m_router->primary(), opt.batchRows, opt.batchDelayMs, m_db);
+}
+
+/* 先停写线程和查询线程，它们还在用连接池 */
+mysqlUserStore::~mysqlUserStore()
+{
+    m_ownWriter.reset();
+    m_ownDb.reset();
+    m_ownRouter.reset();
+}
+
+/* 没有行表示用户不存在 */
+userStore::result mysqlUserStore::fromSelect(const sql_result &res)
+{
+    result out;
+    out.ok = res.ok;
+    out.error = res.error;
+    if(res.ok && !res.rows.empty() && res.rows[0].size() > 1)
+    {
+        out.exists = true;
+        out.passwd = res.rows[0][1];
+    }
+    return out;
+}
+
+/* 重复键说明用户名已被占用，不算失败 */
+userStore::result mysqlUserStore::fromInsert(const sql_result &res)
+{
+    result out;
+    out.ok = res.ok || res.errcode == ER_DUP_ENTRY;
+    out.exists = res.errcode == ER_DUP_ENTRY;
+    out.error = res.error;
+    return out;
+}
+
+userStore::result mysqlUserStore::rejected()
+{
+    result out;
+    out.error = "circuit open";
+    return out;
+}
+
+long long mysqlUserStore::elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+/* 被取消时没有结果，只归还熔断器的试探名额 */
+co::Task<userStore::result> mysqlUserStore::find(string name)
+{
+    unsigned long long probe;
+    if(!m_breaker.allow(probe))
+    {
+        co_return rejected();
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<string> params{name};
+    sql_result res;
+    try
+    {
+        res = co_await m_db->lookup(conn_pool::USER_SELECT, std::move(params));
+    }
+    catch(...)
+    {
+        m_breaker.release(probe);
+        throw;
+    }
+    result out = fromSelect(res);
+    m_breaker.record(out.ok, elapsedMs(start), probe);
+    co_return out;
+}
+
+co::Task<userStore::result> mysqlUserStore::add(string name, string pwd)
+{
+    unsigned long long probe;
+    if(!m_breaker.allow(probe))
+    {
+        co_return rejected();
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    sql_result res;
+    try
+    {
+        res = co_await m_writer->insert(name, pwd);
+    }
+    catch(...)
+    {
+        m_breaker.release(probe);
+        throw;
+    }
+    result out = fromInsert(res);
+    m_breaker.record(out.ok, elapsedMs(start), probe);
+    co_return out;
+}
+
+bool mysqlUserStore::count(size_t &users)
+{
+    MYSQL *sql;
+    connctionRAII sqlRAII(&sql, m_router->primary());
+    if(!sql || mysql_query(sql, "SELECT COUNT(*) FROM user") != 0)
+    {
+        LOG_ERROR("Count users error: %s", sql ? mysql_error(sql) : "no connection");
+        return false;
+    }
+    MYSQL_RES *res = mysql_store_result(sql);
+    MYSQL_ROW row = res ? mysql_fetch_row(res) : nullptr;
+    users = (row && row[0]) ? strtoull(row[0], nullptr, 10) : 0;
+    mysql_free_result(res);
+    return row != nullptr;
+}
+
+/* mysql_use_result 逐行读，不把整张表放进内存 */
+bool mysqlUserStore::scan(const function<void(const string &)> &fn)
+{
+    MYSQL *sql;
+    connctionRAII sqlRAII(&sql, m_router->primary());
+    MYSQL_RES *res = nullptr;
+    if(!sql || mysql_query(sql, "SELECT username FROM user") != 0 || !(res = mysql_use_result(sql)))
+    {
+        LOG_ERROR("Scan users error: %s", sql ? mysql_error(sql) : "no connection");
+        return false;
+    }
+    while(MYSQL_ROW row = mysql_fetch_row(res))
+    {
+        unsigned long *lengths = mysql_fetch_lengths(res);
+        fn(string(row[0], lengths[0]));
+    }
+    bool ok = mysql_errno(sql) == 0;
+    if(!ok)
+    {
+        LOG_ERROR("Scan users error: %s", mysql_error(sql));
+    }
+    mysql_free_result(res);
+    return ok;
+}
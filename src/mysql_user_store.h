@@ -0,0 +1,67 @@
+#ifndef MYSQL_USER_STORE_H
+#define MYSQL_USER_STORE_H
+
+#include <memory>
+#include <vector>
+#include <chrono>
+
+#include "user_store.h"
+#include "../base/sql_router.h"
+#include "../base/circuit_breaker.h"
+
+class sql_async;
+class userWriter;
+
+/* 用户存在 MySQL 的 user 表里：异步查询经 sql_async（只读副本、合并相同查询），注册经 userWriter 组提交
+    查询和注册经过熔断器：库连不上或变慢时快速返回 ok 为 false，不再每次等到超时 */
+class mysqlUserStore: public userStore
+{
+public:
+    /* 连接池、查询线程、注册写线程的参数，各分片相同 */
+    struct options
+    {
+        std::string user;
+        std::string passWord;
+        std::string dbName;
+        unsigned int maxConn = 8;
+        unsigned int minConn = 0;
+        int waitMs = 1000;
+        unsigned int localConn = 1;
+        int sqlThreads = 4;
+        int timeoutMs = 3000;
+        int batchRows = 64;
+        int batchDelayMs = 2;
+        breaker_config breaker;
+    };
+
+    /* 用 sql_async、userWriter 单例，由 WebServer 负责 init 和 stop */
+    explicit mysqlUserStore(sql_router *router, const breaker_config &breaker = breaker_config());
+    /* 分片用：自己建一套 sql_router、sql_async、userWriter，析构时关掉；连不上时照样建好，查询时报错 */
+    mysqlUserStore(const sql_endpoint &primary, const std::vector<sql_endpoint> &replicas, const options &opt);
+    ~mysqlUserStore();
+
+    co::Task<result> find(std::string name) override;
+    co::Task<result> add(std::string name, std::string pwd) override;
+    bool count(size_t &users) override;
+    bool scan(const std::function<void(const std::string &)> &fn) override;
+    const char *name() const override { return "mysql"; }
+
+    breaker_stats breakerStats() { return m_breaker.getStats(); }
+
+private:
+    static result fromSelect(const sql_result &res);
+    static result fromInsert(const sql_result &res);
+    static result rejected();
+    static long long elapsedMs(std::chrono::steady_clock::time_point start);
+
+private:
+    sql_router *m_router;
+    sql_async *m_db;
+    userWriter *m_writer;
+    std::unique_ptr<sql_router> m_ownRouter;
+    std::unique_ptr<sql_async> m_ownDb;
+    std::unique_ptr<userWriter> m_ownWriter;
+    circuit_breaker m_breaker;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "router.h"
+
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#include "http_request.h"
+#include "http_response.h"
+
+using namespace std;
+
+const int httpRouter::params::MAX_PARAMS;
+
+struct httpRouter::node
+{
+    string path;                            // 静态片段（压缩后的边），根节点和参数节点为空
+    vector<unique_ptr<node>> statics;       // 首字符互不相同
+    unique_ptr<node> param;                 // :name
+    unique_ptr<node> wildcard;              // *name，总是叶子
+    unique_ptr<route> routes[METHOD_NUM];
+};
+
+httpRouter::httpRouter(): m_root(new node)
+{
+}
+
+httpRouter::~httpRouter()
+{
+}
+
+httpRouter* httpRouter::GetInstance()
+{
+    static httpRouter router;
+    return &router;
+}
+
+httpRouter::METHOD httpRouter::toMethod(const char* method)
+{
+    static const char* NAMES[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS" };
+    for(int i = 0; i < ANY; i++)
+    {
+        if(strcmp(method, NAMES[i]) == 0)
+        {
+            return static_cast<METHOD>(i);
+        }
+    }
+    return ANY;
+}
+
+void httpRouter::add(METHOD method, const string& pattern, const Handler& handler, const BodyCallBack& onBody)
+{
+    unique_ptr<route> r(new route);
+    r->handler = handler;
+    r->onBody = onBody;
+    insert(method, pattern, std::move(r));
+}
+
+void httpRouter::addAsync(METHOD method, const string& pattern, const AsyncHandler& handler, const BodyCallBack& onBody)
+{
+    assert(handler);
+    unique_ptr<route> r(new route);
+    r->asyncHandler = handler;
+    r->onBody = onBody;
+    insert(method, pattern, std::move(r));
+}
+
+void httpRouter::insert(METHOD method, const string& pattern, unique_ptr<route> r)
+{
+    assert(method < METHOD_NUM);
+    node* n = walk(pattern, r->params);
+    assert(r->params.size() <= static_cast<size_t>(params::MAX_PARAMS));
+    n->routes[method] = std::move(r);
+}
+
+void httpRouter::setLane(const string& pattern, const string& lane)
+{
+    vector<string> names;
+    node* n = walk(pattern, names);
+    for(auto& r: n->routes)
+    {
+        if(r)
+        {
+            r->lane = lane;
+        }
+    }
+}
+
+/* 沿 pattern 走到对应的节点，没有的节点就建出来，参数名依次放进 names */
+httpRouter::node* httpRouter::walk(const string& pattern, vector<string>& names)
+{
+    assert(!pattern.empty() && pattern[0] == '/');
+    node* n = m_root.get();
+    size_t i = 0;
+    while(i < pattern.size())
+    {
+        if(pattern[i] == ':')
+        {
+            size_t end = pattern.find('/', i);
+            end = (end == string::npos) ? pattern.size() : end;
+            names.push_back(pattern.substr(i + 1, end - i - 1));
+            if(!n->param)
+            {
+                n->param.reset(new node);
+            }
+            n = n->param.get();
+            i = end;
+        }
+        else if(pattern[i] == '*')
+        {
+            names.push_back(pattern.substr(i + 1));
+            if(!n->wildcard)
+            {
+                n->wildcard.reset(new node);
+            }
+            n = n->wildcard.get();
+            i = pattern.size();
+        }
+        else
+        {
+            size_t end = pattern.find_first_of(":*", i);
+            end = (end == string::npos) ? pattern.size() : end;
+            n = insertStatic(n, pattern.substr(i, end - i));
+            i = end;
+        }
+    }
+    return n;
+}
+
+/* 沿静态边插入 seg，与已有的边只有部分公共前缀时把那条边拆成两段 */
+httpRouter::node* httpRouter::insertStatic(node* n, const string& seg)
+{
+    size_t pos = 0;
+    while(pos < seg.size())
+    {
+        unique_ptr<node>* slot = nullptr;
+        for(auto& child: n->statics)
+        {
+            if(child->path[0] == seg[pos])
+            {
+                slot = &child;
+                break;
+            }
+        }
+        if(!slot)
+        {
+            n->statics.emplace_back(new node);
+            n->statics.back()->path = seg.substr(pos);
+            return n->statics.back().get();
+        }
+
+        node* child = slot->get();
+        size_t k = 0;
+        while(k < child->path.size() && pos + k < seg.size() && child->path[k] == seg[pos + k])
+        {
+            k++;
+        }
+        if(k < child->path.size())
+        {
+            unique_ptr<node> mid(new node);
+            mid->path = child->path.substr(0, k);
+            (*slot)->path.erase(0, k);
+            mid->statics.push_back(std::move(*slot));
+            *slot = std::move(mid);
+            child = slot->get();
+        }
+        n = child;
+        pos += k;
+    }
+    return n;
+}
+
+const httpRouter::route* httpRouter::routeOf(const node* n, METHOD method)
+{
+    if(n->routes[method])
+    {
+        return n->routes[method].get();
+    }
+    if(method == HEAD && n->routes[GET])
+    {
+        return n->routes[GET].get();
+    }
+    return n->routes[ANY].get();
+}
+
+const httpRouter::route* httpRouter::match(const char* method, const char* path, size_t len, params& result) const
+{
+    result.count = 0;
+    return find(m_root.get(), path, path, path + len, toMethod(method), result);
+}
+
+/* 从节点 n 继续匹配 [p, end)：静态 > 参数 > 通配，走不通时回溯并撤销记录的参数 */
+const httpRouter::route* httpRouter::find(const node* n, const char* path, const char* p, const char* end,
+    METHOD method, params& result) const
+{
+    if(p == end)
+    {
+        const route* r = routeOf(n, method);
+        if(r)
+        {
+            return r;
+        }
+    }
+    else
+    {
+        for(auto& child: n->statics)
+        {
+            if(child->path[0] != *p)
+            {
+                continue;
+            }
+            size_t len = child->path.size();
+            if(static_cast<size_t>(end - p) >= len && memcmp(p, child->path.data(), len) == 0)
+            {
+                const route* r = find(child.get(), path, p + len, end, method, result);
+                if(r)
+                {
+                    return r;
+                }
+            }
+            break;
+        }
+        if(n->param && *p != '/' && result.count < params::MAX_PARAMS)
+        {
+            const char* q = p;
+            while(q < end && *q != '/')
+            {
+                q++;
+            }
+            int saved = result.count;
+            result.offset[saved] = p - path;
+            result.len[saved] = q - p;
+            result.count++;
+            const route* r = find(n->param.get(), path, q, end, method, result);
+            if(r)
+            {
+                return r;
+            }
+            result.count = saved;
+        }
+    }
+    if(n->wildcard && result.count < params::MAX_PARAMS)
+    {
+        const route* r = routeOf(n->wildcard.get(), method);
+        if(r)
+        {
+            result.offset[result.count] = p - path;
+            result.len[result.count] = end - p;
+            result.count++;
+            return r;
+        }
+    }
+    return nullptr;
+}
+
+void httpRouter::mount(const string& prefix, const string& dir)
+{
+    assert(!prefix.empty() && prefix.back() == '/' && !dir.empty());
+    string root = (dir.back() == '/') ? dir.substr(0, dir.size() - 1) : dir;
+    add(GET, prefix + "*file", [root](httpRequest& request, httpResponse& response) {
+        string file = "/" + request.param("file");
+        struct stat st;
+        if(file.find("/..") != string::npos)       // 不允许跳出挂载目录
+        {
+            response.setCode(403);
+        }
+        else if(stat((root + file).c_str(), &st) < 0 || S_ISDIR(st.st_mode))
+        {
+            response.setCode(404);              // 错误页面仍从资源目录返回
+        }
+        else
+        {
+            response.init(root, file, request.isKeepAlive(), 200);
+        }
+    });
+}
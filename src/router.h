@@ -0,0 +1,110 @@
+/* 路由：方法 + 路径 -> 处理函数
+
+    按路径建一棵压缩前缀树（radix tree），每个节点按方法挂处理函数：
+    - 静态片段：共享前缀的路径合并成一条边，子节点首字符互不相同
+    - :name   匹配一个路径段（到下一个 '/' 为止）
+    - *name   匹配剩余的全部路径，只能出现在末尾，mount() 的静态目录就是这样实现的
+    匹配时静态片段优先，其次参数，最后通配，走不通时回溯。参数只记录在路径中的偏移，匹配过程不分配内存。
+*/
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stddef.h>
+
+#include "../base/coroutine.h"
+
+class httpRequest;
+class httpResponse;
+
+class httpRouter
+{
+public:
+    /* 生成响应：调用前 response 已按请求路径初始化为静态文件，处理函数可改路径、状态码或设置流式数据源 */
+    typedef std::function<void(httpRequest&, httpResponse&)> Handler;
+
+    /* 协程处理函数：等待数据库、文件时挂起而不占用工作线程，恢复后在事件循环线程上继续 */
+    typedef std::function<co::Task<void>(httpRequest&, httpResponse&)> AsyncHandler;
+
+    /* 包体流式回调：每到一段数据调用一次，len == 0 表示包体结束；返回 false 则中止请求 */
+    typedef std::function<bool(const httpRequest&, const char*, size_t)> BodyCallBack;
+
+    enum METHOD {
+        GET,
+        HEAD,
+        POST,
+        PUT,
+        DELETE,
+        PATCH,
+        OPTIONS,
+        ANY,            // 该路径上没有注册对应方法时使用
+        METHOD_NUM,
+    };
+
+    struct route
+    {
+        Handler handler;
+        AsyncHandler asyncHandler;          // 与 handler 二选一
+        BodyCallBack onBody;
+        std::vector<std::string> params;    // 参数名，按在路径中出现的顺序
+        std::string lane;                   // 非空时处理函数在这个执行通道上跑，不占 io 线程
+    };
+
+    /* 一次匹配得到的参数值，以 [offset, offset + len) 的形式指向请求路径 */
+    struct params
+    {
+        static const int MAX_PARAMS = 8;
+        int count;
+        size_t offset[MAX_PARAMS];
+        size_t len[MAX_PARAMS];
+    };
+
+public:
+    httpRouter();
+    ~httpRouter();
+
+    static httpRouter* GetInstance();
+
+    /* 需在 server 启动前注册，重复注册同一方法和路径时覆盖 */
+    void add(METHOD method, const std::string& pattern, const Handler& handler, const BodyCallBack& onBody = nullptr);
+    void get(const std::string& pattern, const Handler& handler) { add(GET, pattern, handler); }
+    void post(const std::string& pattern, const Handler& handler, const BodyCallBack& onBody = nullptr) {
+        add(POST, pattern, handler, onBody);
+    }
+
+    void addAsync(METHOD method, const std::string& pattern, const AsyncHandler& handler, const BodyCallBack& onBody = nullptr);
+    void getAsync(const std::string& pattern, const AsyncHandler& handler) { addAsync(GET, pattern, handler); }
+    void postAsync(const std::string& pattern, const AsyncHandler& handler, const BodyCallBack& onBody = nullptr) {
+        addAsync(POST, pattern, handler, onBody);
+    }
+
+    /* 给 pattern 上已注册的所有方法指定执行通道（如 "blocking/db"），会阻塞的处理函数不和静态文件请求排在一起；
+        通道排满时直接回复 503 */
+    void setLane(const std::string& pattern, const std::string& lane);
+
+    /* 把 prefix 开头的 GET 请求映射到 dir 目录下的文件，prefix 需以 '/' 结尾 */
+    void mount(const std::string& prefix, const std::string& dir);
+
+    /* 没有匹配的路由时返回 nullptr；HEAD 没有注册时使用 GET 的路由 */
+    const route* match(const char* method, const char* path, size_t len, params& result) const;
+
+    static METHOD toMethod(const char* method);
+
+private:
+    struct node;
+
+    void insert(METHOD method, const std::string& pattern, std::unique_ptr<route> r);
+    node* walk(const std::string& pattern, std::vector<std::string>& names);
+    node* insertStatic(node* n, const std::string& seg);
+    const route* find(const node* n, const char* path, const char* p, const char* end, METHOD method, params& result) const;
+    static const route* routeOf(const node* n, METHOD method);
+
+private:
+    std::unique_ptr<node> m_root;
+};
+
+#endif
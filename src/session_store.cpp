@@ -0,0 +1,284 @@
+#include "session_store.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/random.h>
+
+#include "../base/log.h"
+
+using namespace std;
+
+sessionStore::sessionStore(): m_ttlMs(0), m_shardNum(1), m_shardCapacity(0), m_hits(0), m_misses(0)
+{
+    m_shards.reset(new shard[m_shardNum]);
+}
+
+sessionStore *sessionStore::GetInstance()
+{
+    static sessionStore store;
+    return &store;
+}
+
+void sessionStore::init(int ttlMs, size_t maxSessions, const string &snapshotPath, int shardNum)
+{
+    m_ttlMs = ttlMs;
+    m_shardNum = shardNum > 0 ? shardNum : 1;
+    m_shardCapacity = (maxSessions + m_shardNum - 1) / m_shardNum;
+    m_shardCapacity = m_shardCapacity > 0 ? m_shardCapacity : 1;
+    m_shards.reset(new shard[m_shardNum]);
+    m_path = snapshotPath;
+    if(enabled() && !m_path.empty())
+    {
+        load();
+    }
+}
+
+int64_t sessionStore::now()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t sessionStore::wallNow()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool sessionStore::randomId(string &id)
+{
+    unsigned char bytes[16];
+    size_t got = 0;
+    while(got < sizeof(bytes))
+    {
+        ssize_t n = getrandom(bytes + got, sizeof(bytes) - got, 0);
+        if(n < 0 && errno != EINTR)
+        {
+            LOG_ERROR("getrandom: %s", strerror(errno));
+            return false;
+        }
+        got += n > 0 ? n : 0;
+    }
+    static const char HEX[] = "0123456789abcdef";
+    id.resize(sizeof(bytes) * 2);
+    for(size_t i = 0; i < sizeof(bytes); i++)
+    {
+        id[2 * i] = HEX[bytes[i] >> 4];
+        id[2 * i + 1] = HEX[bytes[i] & 0xf];
+    }
+    return true;
+}
+
+sessionStore::shard &sessionStore::shardOf(const string &id)
+{
+    return m_shards[hash<string>()(id) % m_shardNum];
+}
+
+size_t sessionStore::expireShard(shard &s, int64_t current)
+{
+    size_t removed = 0;
+    for(unordered_map<string, session>::iterator it = s.sessions.begin(); it != s.sessions.end(); )
+    {
+        if(it->second.expires <= current)
+        {
+            it = s.sessions.erase(it);
+            removed++;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+string sessionStore::create(const string &user)
+{
+    string id;
+    if(!enabled() || !randomId(id))
+    {
+        return "";
+    }
+    int64_t current = now();
+    shard &s = shardOf(id);
+    lock_guard<mutex> locker(s.mutex);
+    if(s.sessions.size() >= m_shardCapacity && expireShard(s, current) == 0)
+    {
+        s.sessions.erase(s.sessions.begin());
+    }
+    s.sessions[id] = session { user, current + m_ttlMs };
+    return id;
+}
+
+bool sessionStore::find(const string &id, string &user)
+{
+    if(!enabled() || id.empty())
+    {
+        return false;
+    }
+    int64_t current = now();
+    shard &s = shardOf(id);
+    {
+        lock_guard<mutex> locker(s.mutex);
+        unordered_map<string, session>::iterator it = s.sessions.find(id);
+        if(it != s.sessions.end() && it->second.expires > current)
+        {
+            it->second.expires = current + m_ttlMs;
+            user = it->second.user;
+            m_hits++;
+            return true;
+        }
+    }
+    m_misses++;
+    return false;
+}
+
+void sessionStore::remove(const string &id)
+{
+    shard &s = shardOf(id);
+    lock_guard<mutex> locker(s.mutex);
+    s.sessions.erase(id);
+}
+
+size_t sessionStore::expire()
+{
+    size_t removed = 0;
+    int64_t current = now();
+    for(size_t i = 0; i < m_shardNum; i++)
+    {
+        lock_guard<mutex> locker(m_shards[i].mutex);
+        removed += expireShard(m_shards[i], current);
+    }
+    return removed;
+}
+
+size_t sessionStore::size()
+{
+    size_t total = 0;
+    for(size_t i = 0; i < m_shardNum; i++)
+    {
+        lock_guard<mutex> locker(m_shards[i].mutex);
+        total += m_shards[i].sessions.size();
+    }
+    return total;
+}
+
+/* 每行 "<会话 ID> <过期的墙上时间毫秒> <用户名长度> <用户名>\n"；逐个分片拷出来再写，写文件时不拿分片锁 */
+bool sessionStore::save()
+{
+    if(!enabled() || m_path.empty())
+    {
+        return true;
+    }
+    lock_guard<mutex> saveLocker(m_saveMutex);
+    int64_t current = now(), wall = wallNow();
+    string data;
+    size_t count = 0;
+    for(size_t i = 0; i < m_shardNum; i++)
+    {
+        lock_guard<mutex> locker(m_shards[i].mutex);
+        for(const auto &item: m_shards[i].sessions)
+        {
+            if(item.second.expires > current)
+            {
+                data += item.first + ' ' + to_string(item.second.expires - current + wall) + ' '
+                    + to_string(item.second.user.size()) + ' ' + item.second.user + '\n';
+                count++;
+            }
+        }
+    }
+
+    string tmp = m_path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0)
+    {
+        LOG_ERROR("Session snapshot %s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    size_t written = 0;
+    while(written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    bool ok = written == data.size() && fsync(fd) == 0;
+    close(fd);
+    if(!ok || rename(tmp.c_str(), m_path.c_str()) != 0)
+    {
+        LOG_ERROR("Session snapshot %s: %s", m_path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    LOG_DEBUG("Session snapshot %s: %zu sessions", m_path.c_str(), count);
+    return true;
+}
+
+/* 解析到损坏的行就停下，之前读到的照样用 */
+bool sessionStore::load()
+{
+    int fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        if(errno != ENOENT)
+        {
+            LOG_ERROR("Session snapshot %s: %s", m_path.c_str(), strerror(errno));
+        }
+        return errno == ENOENT;
+    }
+    string data;
+    char buf[65536];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        data.append(buf, n);
+    }
+    close(fd);
+
+    int64_t current = now(), wall = wallNow();
+    size_t pos = 0, loaded = 0;
+    while(pos < data.size())
+    {
+        size_t space = data.find(' ', pos);
+        if(space == string::npos)
+        {
+            break;
+        }
+        string id = data.substr(pos, space - pos);
+        char *end;
+        long long expires = strtoll(data.c_str() + space + 1, &end, 10);
+        if(*end != ' ')
+        {
+            break;
+        }
+        unsigned long userLen = strtoul(end + 1, &end, 10);
+        size_t start = end + 1 - data.c_str();
+        if(*end != ' ' || userLen > data.size() || start + userLen >= data.size() || data[start + userLen] != '\n')
+        {
+            break;
+        }
+        if(expires > wall)
+        {
+            shard &s = shardOf(id);
+            int64_t left = expires - wall < m_ttlMs ? expires - wall : m_ttlMs;     // ttl 改小了也不超过新的 ttl
+            s.sessions[id] = session { data.substr(start, userLen), current + left };
+            loaded++;
+        }
+        pos = start + userLen + 1;
+    }
+    if(pos < data.size())
+    {
+        LOG_WARN("Session snapshot %s: ignoring %zu bytes of damaged data at offset %zu", m_path.c_str(), data.size() - pos, pos);
+    }
+    LOG_INFO("Session snapshot %s: %zu sessions loaded", m_path.c_str(), loaded);
+    return true;
+}
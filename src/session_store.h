@@ -0,0 +1,79 @@
+/* 登录会话：登录成功后发一个 Cookie，之后的请求凭它认出用户，不再访问用户存储
+
+    会话 ID 是 128 位随机数的十六进制，放在 Cookie sid 里（HttpOnly，SameSite=Lax）。
+    会话按 ID 哈希分片，每个分片一把锁；每次 find 命中都把过期时间往后推 ttl（滑动过期），
+    过期的会话 find 时就当不存在，由 WebServer 的定时器定期调 expire 清掉。
+    - 可选快照文件：save 把没过期的会话写到临时文件再 rename，init 时读回来，重启后已登录的用户不用重新登录；
+      快照里存的是墙上时间的过期时刻，读回时换算成剩余时间
+    - 每个分片最多 maxSessions / 分片数 个会话，满了先清过期的，仍然满就随便挤掉一个
+*/
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+class sessionStore
+{
+public:
+    static sessionStore *GetInstance();
+
+    /* ttlMs <= 0 时关闭，create 返回空串；快照文件读失败只记日志，当作没有会话 */
+    void init(int ttlMs, size_t maxSessions, const std::string &snapshotPath, int shardNum = 64);
+    bool enabled() const { return m_ttlMs > 0; }
+    int ttlMs() const { return m_ttlMs; }
+
+    /* 新建会话，返回会话 ID；取不到随机数时返回空串 */
+    std::string create(const std::string &user);
+    /* 会话有效时写出用户名并续期 */
+    bool find(const std::string &id, std::string &user);
+    void remove(const std::string &id);
+
+    /* 清掉过期的会话，返回清掉的个数；会遍历所有会话，不要在事件循环线程调用 */
+    size_t expire();
+    /* 写快照，没有配置快照文件时直接返回 true；会阻塞 */
+    bool save();
+
+    size_t size();
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+    sessionStore();
+
+private:
+    struct session
+    {
+        std::string user;
+        int64_t expires;            // steady_clock 毫秒
+    };
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, session> sessions;
+    };
+
+    static int64_t now();
+    static int64_t wallNow();
+    static bool randomId(std::string &id);
+    shard &shardOf(const std::string &id);
+    static size_t expireShard(shard &s, int64_t current);
+    bool load();
+
+private:
+    int m_ttlMs;
+    size_t m_shardNum;
+    size_t m_shardCapacity;
+    std::unique_ptr<shard[]> m_shards;
+    std::string m_path;
+    std::mutex m_saveMutex;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
+
+#endif
@@ -0,0 +1,314 @@
+#include "sharded_user_store.h"
+
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "memory_user_store.h"
+#include "../base/log.h"
+
+using namespace std;
+
+const int shard_stats::BUCKETS;
+const int shard_stats::BUCKET_MS[shard_stats::BUCKETS] = { 1, 5, 10, 50, 100, 500, 1000, 0 };
+
+shardedUserStore::shardedUserStore(const mysqlUserStore::options &opt): m_options(opt), m_size(-1)
+{
+    m_mtime.tv_sec = 0;
+    m_mtime.tv_nsec = 0;
+}
+
+shardedUserStore::~shardedUserStore()
+{
+    m_map.reset();
+    m_retired.clear();
+}
+
+shared_ptr<shardedUserStore::shardMap> shardedUserStore::current()
+{
+    lock_guard<mutex> locker(m_mutex);
+    return m_map;
+}
+
+shared_ptr<shardedUserStore::shard> shardedUserStore::route(const string &name)
+{
+    shared_ptr<shardMap> map = current();
+    int i = map ? map->ring.locate(name) : -1;
+    return i < 0 ? nullptr : map->shards[i];
+}
+
+userStore::result shardedUserStore::unavailable()
+{
+    result res;
+    res.error = "no shard";
+    return res;
+}
+
+void shardedUserStore::record(shard &s, clock::time_point start, const result &res)
+{
+    unsigned long long us = chrono::duration_cast<chrono::microseconds>(clock::now() - start).count();
+    ++s.calls;
+    if(!res.ok)
+    {
+        ++s.errors;
+    }
+    s.totalUs += us;
+    unsigned long long longest = s.maxUs;
+    while(us > longest && !s.maxUs.compare_exchange_weak(longest, us))
+    {
+    }
+    int bucket = 0;
+    while(bucket < shard_stats::BUCKETS - 1 && us >= shard_stats::BUCKET_MS[bucket] * 1000ULL)
+    {
+        bucket++;
+    }
+    ++s.latency[bucket];
+}
+
+/* mysql 的地址是逗号分隔的 host[:port]，第一个是主库，端口缺省 3306；memory 的地址是文件路径，- 表示不落盘 */
+shared_ptr<userStore> shardedUserStore::open(const string &name, const string &type, const string &address)
+{
+    if(type == "memory")
+    {
+        shared_ptr<memoryUserStore> store = make_shared<memoryUserStore>();
+        return store->init(address == "-" ? "" : address) ? store : nullptr;
+    }
+    vector<sql_endpoint> endpoints;
+    stringstream list(address);
+    string item;
+    while(getline(list, item, ','))
+    {
+        sql_endpoint ep;
+        size_t colon = item.rfind(':');
+        ep.host = item.substr(0, colon);
+        ep.port = colon == string::npos ? 3306 : atoi(item.c_str() + colon + 1);
+        ep.name = endpoints.empty() ? name : name + "-r" + to_string(endpoints.size());
+        if(ep.host.empty() || ep.port <= 0 || ep.port > 65535)
+        {
+            LOG_ERROR("Shard %s: invalid address %s", name.c_str(), item.c_str());
+            return nullptr;
+        }
+        endpoints.push_back(ep);
+    }
+    if(endpoints.empty())
+    {
+        return nullptr;
+    }
+    vector<sql_endpoint> replicas(endpoints.begin() + 1, endpoints.end());
+    return make_shared<mysqlUserStore>(endpoints[0], replicas, m_options);
+}
+
+/* 先把整个文件解析、新分片建好，都成功了才替换；换下来的分片放进 m_retired */
+bool shardedUserStore::load(const string &path)
+{
+    lock_guard<mutex> loadLocker(m_loadMutex);
+    m_path = path;
+    struct stat st;
+    if(stat(path.c_str(), &st) == 0)
+    {
+        m_mtime = st.st_mtim;
+        m_size = st.st_size;
+    }
+    ifstream in(path);
+    if(!in)
+    {
+        LOG_ERROR("Open shard map %s error", path.c_str());
+        return false;
+    }
+
+    shared_ptr<shardMap> old = current();
+    shared_ptr<shardMap> map = make_shared<shardMap>();
+    set<string> names;
+    set<string> addresses;
+    string line;
+    for(int lineNo = 1; getline(in, line); lineNo++)
+    {
+        istringstream fields(line.substr(0, line.find('#')));
+        vector<string> words;
+        string word;
+        while(fields >> word)
+        {
+            words.push_back(word);
+        }
+        if(words.empty())
+        {
+            continue;
+        }
+        int weight = words.size() == 4 ? atoi(words[3].c_str()) : 1;
+        if(words.size() < 3 || words.size() > 4 || weight <= 0 || (words[1] != "mysql" && words[1] != "memory")
+            || !names.insert(words[0]).second || !addresses.insert(words[1] + " " + words[2]).second)
+        {
+            LOG_ERROR("Shard map %s:%d invalid: %s", path.c_str(), lineNo, line.c_str());
+            return false;
+        }
+
+        shared_ptr<shard> s;
+        shared_ptr<userStore> store;
+        for(size_t i = 0; old && i < old->shards.size(); i++)
+        {
+            const shared_ptr<shard> &prev = old->shards[i];
+            if(prev->type == words[1] && prev->address == words[2])
+            {
+                store = prev->store;
+                s = prev->name == words[0] ? prev : nullptr;
+                break;
+            }
+        }
+        if(!s)
+        {
+            s = make_shared<shard>();
+            s->name = words[0];
+            s->type = words[1];
+            s->address = words[2];
+            s->store = store ? store : open(s->name, s->type, s->address);
+            if(!s->store)
+            {
+                LOG_ERROR("Shard map %s:%d: open shard %s error", path.c_str(), lineNo, s->name.c_str());
+                return false;
+            }
+        }
+        map->ring.add(s->name, weight);
+        map->shards.push_back(s);
+    }
+    if(map->shards.empty())
+    {
+        LOG_ERROR("Shard map %s has no shard", path.c_str());
+        return false;
+    }
+
+    {
+        lock_guard<mutex> locker(m_mutex);
+        m_map = map;
+    }
+    for(size_t i = 0; old && i < old->shards.size(); i++)
+    {
+        bool kept = false;
+        for(const shared_ptr<shard> &s: map->shards)
+        {
+            kept = kept || s == old->shards[i];
+        }
+        if(!kept)
+        {
+            m_retired.push_back(old->shards[i]);
+        }
+    }
+    for(size_t i = 0; i < map->shards.size(); i++)
+    {
+        const shard &s = *map->shards[i];
+        LOG_INFO("Shard %s: %s %s, %.1f%% of users", s.name.c_str(), s.type.c_str(), s.address.c_str(),
+            map->ring.share(i) * 100);
+    }
+    return true;
+}
+
+bool shardedUserStore::reloadIfChanged()
+{
+    string path;
+    {
+        lock_guard<mutex> loadLocker(m_loadMutex);
+        for(vector<shared_ptr<shard>>::iterator it = m_retired.begin(); it != m_retired.end(); )
+        {
+            it = it->use_count() == 1 ? m_retired.erase(it) : it + 1;
+        }
+        struct stat st;
+        if(m_path.empty() || stat(m_path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        if(st.st_mtim.tv_sec == m_mtime.tv_sec && st.st_mtim.tv_nsec == m_mtime.tv_nsec && st.st_size == m_size)
+        {
+            return false;
+        }
+        path = m_path;
+    }
+    LOG_INFO("Shard map %s changed, reloading", path.c_str());
+    return load(path);
+}
+
+co::Task<userStore::result> shardedUserStore::find(string name)
+{
+    shared_ptr<shard> s = route(name);
+    if(!s)
+    {
+        co_return unavailable();
+    }
+    clock::time_point start = clock::now();
+    result res = co_await s->store->find(name);
+    record(*s, start, res);
+    co_return res;
+}
+
+co::Task<userStore::result> shardedUserStore::add(string name, string pwd)
+{
+    shared_ptr<shard> s = route(name);
+    if(!s)
+    {
+        co_return unavailable();
+    }
+    clock::time_point start = clock::now();
+    result res = co_await s->store->add(name, pwd);
+    record(*s, start, res);
+    co_return res;
+}
+
+/* 有一个分片失败就算失败，过滤器宁可不重建也不能漏掉用户 */
+bool shardedUserStore::count(size_t &users)
+{
+    shared_ptr<shardMap> map = current();
+    users = 0;
+    for(size_t i = 0; map && i < map->shards.size(); i++)
+    {
+        size_t n = 0;
+        if(!map->shards[i]->store->count(n))
+        {
+            return false;
+        }
+        users += n;
+    }
+    return map != nullptr;
+}
+
+bool shardedUserStore::scan(const function<void(const string &)> &fn)
+{
+    shared_ptr<shardMap> map = current();
+    for(size_t i = 0; map && i < map->shards.size(); i++)
+    {
+        if(!map->shards[i]->store->scan(fn))
+        {
+            return false;
+        }
+    }
+    return map != nullptr;
+}
+
+vector<shard_stats> shardedUserStore::getStats()
+{
+    vector<shard_stats> out;
+    shared_ptr<shardMap> map = current();
+    for(size_t i = 0; map && i < map->shards.size(); i++)
+    {
+        const shard &s = *map->shards[i];
+        shard_stats item;
+        item.name = s.name;
+        item.type = s.type;
+        item.address = s.address;
+        item.share = map->ring.share(i);
+        item.calls = s.calls;
+        item.errors = s.errors;
+        item.totalUs = s.totalUs;
+        item.maxUs = s.maxUs;
+        for(int b = 0; b < shard_stats::BUCKETS; b++)
+        {
+            item.latency[b] = s.latency[b];
+        }
+        if(mysqlUserStore *mysql = dynamic_cast<mysqlUserStore *>(s.store.get()))
+        {
+            item.hasBreaker = true;
+            item.breaker = mysql->breakerStats();
+        }
+        out.push_back(item);
+    }
+    return out;
+}
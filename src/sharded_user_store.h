@@ -0,0 +1,111 @@
+/* 用户表水平分片：按用户名一致性哈希到多个存储实例
+
+    分片表是一个文本文件，每行一个分片：名字、类型、地址，可选权重，# 开头的行是注释
+        s1  mysql   10.0.0.1:3306,10.0.0.2:3306     # 主库在前，其余是只读副本
+        s2  mysql   10.0.0.3:3306   2               # 权重 2，分到约两倍的用户
+        s3  memory  /data/users-s3.aof              # 进程内存储，- 表示不落盘
+    mysql 分片各自一套连接池、查询线程和注册写线程（mysqlUserStore 的分片构造），memory 分片是 memoryUserStore。
+    - 分片表可以在运行中重新加载：类型、地址没变的分片沿用原来的实例，只改名字、权重不重建；
+      文件有错时整个忽略，继续用原来的分片表
+    - 换下来的实例等手上的请求做完，在下一次 reloadIfChanged（blocking 线程）里析构，不在事件循环里关连接池
+    - 只负责路由，不迁移数据：加一个分片后约 1/N 的用户改落到新分片，在那里查不到，需要先把这部分数据搬过去
+    - 每个分片统计调用次数、失败次数和耗时分布
+*/
+
+#ifndef SHARDED_USER_STORE_H
+#define SHARDED_USER_STORE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <time.h>
+#include <sys/types.h>
+
+#include "user_store.h"
+#include "mysql_user_store.h"
+#include "../base/consistent_hash.h"
+
+struct shard_stats
+{
+    static const int BUCKETS = 8;
+    static const int BUCKET_MS[BUCKETS];    // 耗时分桶的上界，最后一个（0）表示更长
+
+    std::string name;
+    std::string type;
+    std::string address;
+    double share = 0;                       // 分到的哈希空间比例
+    unsigned long long calls = 0;
+    unsigned long long errors = 0;          // 结果 ok 为 false 的次数，不含用户不存在、重名
+    unsigned long long totalUs = 0;
+    unsigned long long maxUs = 0;
+    unsigned long long latency[BUCKETS] = {};
+    bool hasBreaker = false;                // mysql 分片各自一个熔断器
+    breaker_stats breaker;
+
+    double avgMs() const { return calls ? totalUs / 1000.0 / calls : 0; }
+};
+
+class shardedUserStore: public userStore
+{
+public:
+    explicit shardedUserStore(const mysqlUserStore::options &opt);
+    ~shardedUserStore();
+
+    /* 读分片表并切换过去，会阻塞（建 mysql 分片的连接池、重放 memory 分片的文件）；失败时返回 false，分片表不变 */
+    bool load(const std::string &path);
+    /* 文件的修改时间或大小变了才重新 load，顺便析构已经没人用的旧分片；返回是否切换了分片表 */
+    bool reloadIfChanged();
+
+    co::Task<result> find(std::string name) override;
+    co::Task<result> add(std::string name, std::string pwd) override;
+    bool count(size_t &users) override;
+    bool scan(const std::function<void(const std::string &)> &fn) override;
+    const char *name() const override { return "sharded"; }
+
+    std::vector<shard_stats> getStats();
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct shard
+    {
+        std::string name;
+        std::string type;
+        std::string address;
+        std::shared_ptr<userStore> store;       // 只改名字时新旧分片共用一个实例
+        std::atomic<unsigned long long> calls { 0 };
+        std::atomic<unsigned long long> errors { 0 };
+        std::atomic<unsigned long long> totalUs { 0 };
+        std::atomic<unsigned long long> maxUs { 0 };
+        std::atomic<unsigned long long> latency[shard_stats::BUCKETS] = {};
+    };
+
+    struct shardMap
+    {
+        consistent_hash ring;
+        std::vector<std::shared_ptr<shard>> shards;     // 下标与 ring 的节点下标一致
+    };
+
+    std::shared_ptr<shardMap> current();
+    std::shared_ptr<shard> route(const std::string &name);
+    std::shared_ptr<userStore> open(const std::string &name, const std::string &type, const std::string &address);
+    static void record(shard &s, clock::time_point start, const result &res);
+    static result unavailable();
+
+private:
+    mysqlUserStore::options m_options;
+
+    std::mutex m_mutex;                                 // 保护 m_map 的替换和读取
+    std::shared_ptr<shardMap> m_map;
+
+    std::mutex m_loadMutex;                             // load 串行执行，保护以下成员
+    std::string m_path;
+    struct timespec m_mtime;
+    off_t m_size;
+    std::vector<std::shared_ptr<shard>> m_retired;      // 换下来、可能还有请求在用的分片
+};
+
+#endif
@@ -0,0 +1,130 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE HpackTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../../net/Buffer.cpp"
+#include "../hpack.cpp"
+
+using namespace std;
+
+static string fromHex(const string& hex)      // RFC 7541 附录 C 的十六进制示例
+{
+  string out;
+  for(size_t i = 0; i + 1 < hex.size(); i += 2)
+  {
+    out.push_back(static_cast<char>(stoi(hex.substr(i, 2), nullptr, 16)));
+  }
+  return out;
+}
+
+static bool decodeHex(hpackDecoder& decoder, const string& hex, HeaderList& headers)
+{
+  string block = fromHex(hex);
+  headers.clear();
+  return decoder.decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), headers);
+}
+
+BOOST_AUTO_TEST_SUITE (Hpacktest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testInteger)
+{
+  Buffer buf;
+  hpack::encodeInteger(1337, 5, 0x00, buf);                                       // C.1.2：1337 用 5 位前缀编码为 1f 9a 0a
+  BOOST_CHECK_EQUAL(buf.readableBytes(), 3);
+  BOOST_CHECK_EQUAL(buf.toStringPiece(), fromHex("1f9a0a"));
+
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf.peek());
+  uint64_t value = 0;
+  BOOST_CHECK(hpack::decodeInteger(p, p + buf.readableBytes(), 5, value));
+  BOOST_CHECK_EQUAL(value, 1337);
+
+  const uint8_t truncated[] = { 0x1f, 0x9a };                                     // 续位未结束
+  p = truncated;
+  BOOST_CHECK(!hpack::decodeInteger(p, truncated + 2, 5, value));
+}
+
+BOOST_AUTO_TEST_CASE(testHuffman)
+{
+  Buffer buf;
+  hpack::huffmanEncode("www.example.com", buf);                                   // C.4.1
+  BOOST_CHECK_EQUAL(buf.toStringPiece(), fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+  BOOST_CHECK_EQUAL(hpack::huffmanLength("www.example.com"), 12);
+
+  string out;
+  BOOST_CHECK(hpack::huffmanDecode(reinterpret_cast<const uint8_t*>(buf.peek()), buf.readableBytes(), out));
+  BOOST_CHECK_EQUAL(out, "www.example.com");
+
+  const uint8_t badPadding[] = { 0xf1, 0xe3, 0x00 };                              // 填充不是全 1
+  out.clear();
+  BOOST_CHECK(!hpack::huffmanDecode(badPadding, sizeof(badPadding), out));
+}
+
+BOOST_AUTO_TEST_CASE(testDecodeRequestsWithHuffman)
+{
+  hpackDecoder decoder;
+  HeaderList headers;
+
+  BOOST_CHECK(decodeHex(decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff", headers));          // C.4.1
+  BOOST_CHECK_EQUAL(headers.size(), 4);
+  BOOST_CHECK_EQUAL(headers[0].first, ":method");
+  BOOST_CHECK_EQUAL(headers[0].second, "GET");
+  BOOST_CHECK_EQUAL(headers[3].first, ":authority");
+  BOOST_CHECK_EQUAL(headers[3].second, "www.example.com");
+
+  BOOST_CHECK(decodeHex(decoder, "828684be5886a8eb10649cbf", headers));                     // C.4.2：引用动态表
+  BOOST_CHECK_EQUAL(headers.size(), 5);
+  BOOST_CHECK_EQUAL(headers[3].second, "www.example.com");
+  BOOST_CHECK_EQUAL(headers[4].first, "cache-control");
+  BOOST_CHECK_EQUAL(headers[4].second, "no-cache");
+
+  BOOST_CHECK(decodeHex(decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf", headers)); // C.4.3
+  BOOST_CHECK_EQUAL(headers.size(), 5);
+  BOOST_CHECK_EQUAL(headers[1].second, "https");
+  BOOST_CHECK_EQUAL(headers[4].first, "custom-key");
+  BOOST_CHECK_EQUAL(headers[4].second, "custom-value");
+
+  BOOST_CHECK(!decodeHex(decoder, "ff", headers));                                            // 截断的索引
+  BOOST_CHECK(!decodeHex(decoder, "8200", headers));                                          // 字面量缺少名字和值
+}
+
+BOOST_AUTO_TEST_CASE(testEncoderRoundTrip)
+{
+  hpackEncoder encoder;
+  hpackDecoder decoder;
+  HeaderList in = { {":status", "200"}, {"content-type", "text/html"}, {"content-length", "737"} };
+
+  for(int i = 0; i < 3; i++)
+  {
+    Buffer block;
+    encoder.encode(in, block);
+    if(i > 0)
+    {
+      BOOST_CHECK_LT(block.readableBytes(), 10);                                  // 第二次起 content-type 走动态表索引
+    }
+    HeaderList out;
+    BOOST_CHECK(decoder.decode(reinterpret_cast<const uint8_t*>(block.peek()), block.readableBytes(), out));
+    BOOST_CHECK(out == in);
+  }
+
+  encoder.setMaxTableSize(0);                                                     // 表大小更新必须随下一个头部块发出
+  Buffer block;
+  encoder.encode(in, block);
+  BOOST_CHECK_EQUAL(static_cast<uint8_t>(block.peek()[0]), 0x20);
+  HeaderList out;
+  BOOST_CHECK(decoder.decode(reinterpret_cast<const uint8_t*>(block.peek()), block.readableBytes(), out));
+  BOOST_CHECK(out == in);
+}
+
+BOOST_AUTO_TEST_CASE(testMaxListSize)
+{
+  hpackDecoder decoder(4096, 200);
+  HeaderList headers;
+  BOOST_CHECK(decodeHex(decoder, "828684", headers));                                         // 3 个字段共 123 字节
+  BOOST_CHECK(!decoder.listTooLarge());
+  BOOST_CHECK(!decodeHex(decoder, "8286848282", headers));                                    // 重复的索引把列表撑过上限
+  BOOST_CHECK(decoder.listTooLarge());
+  BOOST_CHECK(!decodeHex(decoder, "ff", headers));                                            // 普通的解码错误不算超限
+  BOOST_CHECK(!decoder.listTooLarge());
+}
+
+BOOST_AUTO_TEST_SUITE_END()       // 结束 suit
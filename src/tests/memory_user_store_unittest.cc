@@ -0,0 +1,154 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE MemoryUserStoreTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../../net/Buffer.cpp"
+#include "../../base/log.cpp"
+#include "../memory_user_store.cpp"
+
+using namespace std;
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/memory_user_store_unittest", 2000, 800000, 0); }
+};
+
+static string tempPath()
+{
+  char path[] = "/tmp/user_store_XXXXXX";
+  int fd = mkstemp(path);
+  close(fd);
+  return path;
+}
+
+static off_t fileSize(const string &path)
+{
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+/* 内存存储的 find / add 不会挂起，spawn 返回时已经拿到结果；多个线程里也会调用，不用 BOOST_REQUIRE */
+static co::Task<void> collect(co::Task<userStore::result> task, userStore::result &out)
+{
+  out = co_await task;
+}
+
+static userStore::result run(co::Task<userStore::result> task)
+{
+  userStore::result out;
+  co::spawn(collect(std::move(task), out), [] {});
+  return out;
+}
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+BOOST_AUTO_TEST_SUITE (MemoryUserStoretest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testFindAdd)
+{
+  memoryUserStore store(4);
+  BOOST_CHECK(store.init(""));
+
+  userStore::result res = run(store.find("alice"));
+  BOOST_CHECK(res.ok && !res.exists);
+
+  res = run(store.add("alice", "pw1"));
+  BOOST_CHECK(res.ok && !res.exists);
+  res = run(store.add("alice", "pw2"));
+  BOOST_CHECK(res.ok && res.exists);          // 重名不覆盖
+
+  res = run(store.find("alice"));
+  BOOST_CHECK(res.ok && res.exists);
+  BOOST_CHECK_EQUAL(res.passwd, "pw1");
+
+  run(store.add("bob", "pw"));
+  size_t users = 0;
+  BOOST_CHECK(store.count(users));
+  BOOST_CHECK_EQUAL(users, 2);
+  vector<string> names;
+  BOOST_CHECK(store.scan([&names](const string &name) { names.push_back(name); }));
+  sort(names.begin(), names.end());
+  BOOST_CHECK(names == vector<string>({ "alice", "bob" }));
+}
+
+BOOST_AUTO_TEST_CASE(testConcurrentAdd)
+{
+  memoryUserStore store;
+  store.init("");
+  atomic<int> added(0);
+  vector<thread> threads;
+  for(int t = 0; t < 8; t++)
+  {
+    threads.emplace_back([&store, &added] {
+      for(int i = 0; i < 1000; i++)
+      {
+        if(!run(store.add("user" + to_string(i), "pw")).exists)
+        {
+          added++;
+        }
+      }
+    });
+  }
+  for(auto &t: threads)
+  {
+    t.join();
+  }
+  BOOST_CHECK_EQUAL(added, 1000);
+}
+
+/* 用户名、口令里有空格、换行、数字也能原样重放 */
+BOOST_AUTO_TEST_CASE(testReplay)
+{
+  string path = tempPath();
+  {
+    memoryUserStore store;
+    BOOST_CHECK(store.init(path));
+    run(store.add("alice", "pw"));
+    run(store.add("12 3", "a\nb c"));
+    run(store.add("", "empty"));
+  }
+  memoryUserStore store;
+  BOOST_CHECK(store.init(path));
+  BOOST_CHECK_EQUAL(run(store.find("alice")).passwd, "pw");
+  BOOST_CHECK_EQUAL(run(store.find("12 3")).passwd, "a\nb c");
+  BOOST_CHECK(run(store.find("")).exists);
+  size_t users = 0;
+  store.count(users);
+  BOOST_CHECK_EQUAL(users, 3);
+  unlink(path.c_str());
+}
+
+/* 写到一半的记录在重放时截掉，之后追加的记录不受影响 */
+BOOST_AUTO_TEST_CASE(testTruncatedTail)
+{
+  string path = tempPath();
+  {
+    memoryUserStore store;
+    store.init(path);
+    run(store.add("alice", "pw"));
+  }
+  off_t good = fileSize(path);
+  int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+  BOOST_CHECK(write(fd, "5 2 bob", 7) == 7);
+  close(fd);
+
+  {
+    memoryUserStore store;
+    BOOST_CHECK(store.init(path));
+    BOOST_CHECK_EQUAL(fileSize(path), good);
+    BOOST_CHECK(!run(store.find("bob")).exists);
+    run(store.add("carol", "pw"));
+  }
+  memoryUserStore store;
+  BOOST_CHECK(store.init(path));
+  BOOST_CHECK(run(store.find("alice")).exists);
+  BOOST_CHECK(run(store.find("carol")).exists);
+  unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE RouterTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../../net/Buffer.cpp"
+#include "../../base/log.cpp"
+#include "../../base/bloom_filter.cpp"
+#include "../../utils/Utils.cpp"
+#include "../user_filter.cpp"
+#include "../http_request.cpp"
+#include "../http_response.cpp"
+#include "../router.cpp"
+
+using namespace std;
+
+static string value(const string& path, const httpRouter::params& result, int i)
+{
+  return path.substr(result.offset[i], result.len[i]);
+}
+
+BOOST_AUTO_TEST_SUITE (Routertest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testStatic)
+{
+  httpRouter router;
+  router.get("/index", nullptr);
+  router.get("/inbox", nullptr);          // 与 /index 共享前缀 "/in"，插入时拆分边
+  router.get("/in", nullptr);
+  router.post("/index", nullptr);
+
+  httpRouter::params result;
+  string path = "/inbox";
+  const httpRouter::route* inbox = router.match("GET", path.data(), path.size(), result);
+  BOOST_CHECK(inbox != nullptr);
+  path = "/in";
+  BOOST_CHECK(router.match("GET", path.data(), path.size(), result) != nullptr);
+  path = "/index";
+  const httpRouter::route* get = router.match("GET", path.data(), path.size(), result);
+  BOOST_CHECK(get != nullptr && get != inbox);
+  BOOST_CHECK(router.match("HEAD", path.data(), path.size(), result) == get);   // HEAD 使用 GET 的路由
+  BOOST_CHECK(router.match("POST", path.data(), path.size(), result) != get);
+  BOOST_CHECK(router.match("PUT", path.data(), path.size(), result) == nullptr);
+  path = "/inde";
+  BOOST_CHECK(router.match("GET", path.data(), path.size(), result) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(testParams)
+{
+  httpRouter router;
+  router.get("/user/:id", nullptr);
+  router.get("/user/:id/posts/:post", nullptr);
+  router.get("/user/me", nullptr);
+
+  httpRouter::params result;
+  string path = "/user/42/posts/7";
+  const httpRouter::route* r = router.match("GET", path.data(), path.size(), result);
+  BOOST_REQUIRE(r != nullptr);
+  BOOST_CHECK_EQUAL(result.count, 2);
+  BOOST_CHECK_EQUAL(r->params[1], "post");
+  BOOST_CHECK_EQUAL(value(path, result, 0), "42");
+  BOOST_CHECK_EQUAL(value(path, result, 1), "7");
+
+  path = "/user/me";                      // 静态片段优先于参数
+  r = router.match("GET", path.data(), path.size(), result);
+  BOOST_REQUIRE(r != nullptr);
+  BOOST_CHECK(r->params.empty());
+
+  path = "/user/";                        // 参数不能为空
+  BOOST_CHECK(router.match("GET", path.data(), path.size(), result) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(testWildcard)
+{
+  httpRouter router;
+  router.get("/files/*path", nullptr);
+  router.get("/files/:name/meta", nullptr);
+
+  httpRouter::params result;
+  string path = "/files/a/b.txt";         // 参数分支走不通，回溯到通配
+  const httpRouter::route* r = router.match("GET", path.data(), path.size(), result);
+  BOOST_REQUIRE(r != nullptr);
+  BOOST_CHECK_EQUAL(result.count, 1);
+  BOOST_CHECK_EQUAL(r->params[0], "path");
+  BOOST_CHECK_EQUAL(value(path, result, 0), "a/b.txt");
+
+  path = "/files/a/meta";
+  r = router.match("GET", path.data(), path.size(), result);
+  BOOST_REQUIRE(r != nullptr);
+  BOOST_CHECK_EQUAL(r->params[0], "name");
+  BOOST_CHECK_EQUAL(value(path, result, 0), "a");
+
+  path = "/files/";
+  BOOST_CHECK(router.match("GET", path.data(), path.size(), result) != nullptr);
+  BOOST_CHECK_EQUAL(result.len[0], 0);
+}
+
+/* 通道按路径设置到已注册的各个方法上，不影响共享前缀的其它路由 */
+BOOST_AUTO_TEST_CASE(testLane)
+{
+  httpRouter router;
+  router.get("/report/:id", nullptr);
+  router.post("/report/:id", nullptr);
+  router.get("/reports", nullptr);
+  router.setLane("/report/:id", "blocking/db");
+
+  httpRouter::params result;
+  string path = "/report/7";
+  BOOST_CHECK_EQUAL(router.match("GET", path.data(), path.size(), result)->lane, "blocking/db");
+  BOOST_CHECK_EQUAL(router.match("POST", path.data(), path.size(), result)->lane, "blocking/db");
+  path = "/reports";
+  BOOST_CHECK_EQUAL(router.match("GET", path.data(), path.size(), result)->lane, "");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
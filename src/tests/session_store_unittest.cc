@@ -0,0 +1,87 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE SessionStoreTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <thread>
+
+#include "../../net/Buffer.cpp"
+#include "../../base/log.cpp"
+#include "../session_store.cpp"
+
+using namespace std;
+
+struct logFixture
+{
+  logFixture() { Log::get_instance()->init("/tmp/session_store_unittest", 2000, 800000, 0); }
+};
+
+BOOST_GLOBAL_FIXTURE(logFixture);
+
+BOOST_AUTO_TEST_SUITE (SessionStoretest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testCreateFind)
+{
+  sessionStore store;
+  store.init(60 * 1000, 1000, "", 4);
+  string a = store.create("alice");
+  string b = store.create("alice");
+  BOOST_CHECK_EQUAL(a.size(), 32);
+  BOOST_CHECK(a != b);                      // 同一用户的每次登录各是一个会话
+
+  string user;
+  BOOST_CHECK(store.find(a, user));
+  BOOST_CHECK_EQUAL(user, "alice");
+  BOOST_CHECK(!store.find("0123456789abcdef0123456789abcdef", user));
+  store.remove(a);
+  BOOST_CHECK(!store.find(a, user));
+  BOOST_CHECK(store.find(b, user));
+  BOOST_CHECK_EQUAL(store.size(), 1);
+
+  sessionStore disabled;
+  disabled.init(0, 1000, "");
+  BOOST_CHECK_EQUAL(disabled.create("alice"), "");
+}
+
+/* 访问过的会话续期，没访问的过期后 find 不到，expire 清掉 */
+BOOST_AUTO_TEST_CASE(testSlidingExpiry)
+{
+  sessionStore store;
+  store.init(100, 1000, "", 4);
+  string active = store.create("alice");
+  string idle = store.create("bob");
+  string user;
+  for(int i = 0; i < 4; i++)
+  {
+    this_thread::sleep_for(chrono::milliseconds(40));
+    BOOST_CHECK(store.find(active, user));
+  }
+  BOOST_CHECK(!store.find(idle, user));
+  BOOST_CHECK_EQUAL(store.expire(), 1);
+  BOOST_CHECK_EQUAL(store.size(), 1);
+}
+
+/* 快照读回后会话仍有效，用户名里的空格、换行原样保留 */
+BOOST_AUTO_TEST_CASE(testSnapshot)
+{
+  char path[] = "/tmp/sessions_XXXXXX";
+  close(mkstemp(path));
+  unlink(path);
+  string a, b;
+  {
+    sessionStore store;
+    store.init(60 * 1000, 1000, path, 4);
+    a = store.create("alice");
+    b = store.create("b o\nb");
+    BOOST_CHECK(store.save());
+  }
+  sessionStore store;
+  store.init(60 * 1000, 1000, path, 8);
+  string user;
+  BOOST_CHECK(store.find(a, user));
+  BOOST_CHECK_EQUAL(user, "alice");
+  BOOST_CHECK(store.find(b, user));
+  BOOST_CHECK_EQUAL(user, "b o\nb");
+  unlink(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
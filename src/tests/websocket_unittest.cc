@@ -0,0 +1,155 @@
+// 定义了程序名, 将在输出消息中使用
+#define BOOST_TEST_MODULE WebSocketTest
+#include <boost/test/included/unit_test.hpp>
+
+#include <vector>
+
+#include "../../net/Buffer.cpp"
+#include "../../utils/Utils.cpp"
+#include "../websocket.cpp"
+
+using namespace std;
+
+static string clientFrame(uint8_t opcode, const string& payload, bool fin = true)    // 客户端帧必须带掩码
+{
+  const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+  string frame;
+  frame.push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+  if(payload.size() < 126)
+  {
+    frame.push_back(static_cast<char>(0x80 | payload.size()));
+  }
+  else
+  {
+    frame.push_back(static_cast<char>(0x80 | 126));
+    frame.push_back(static_cast<char>(payload.size() >> 8));
+    frame.push_back(static_cast<char>(payload.size() & 0xFF));
+  }
+  frame.append(reinterpret_cast<const char*>(key), 4);
+  string masked = payload;
+  for(size_t i = 0; i < masked.size(); i++)
+  {
+    masked[i] ^= key[i % 4];
+  }
+  return frame + masked;
+}
+
+BOOST_AUTO_TEST_SUITE (WebSockettest)  // 定义 test suit 名
+
+BOOST_AUTO_TEST_CASE(testAcceptKey)
+{
+  BOOST_CHECK_EQUAL(wsSession::acceptKey("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");   // RFC 6455 1.3 的示例
+}
+
+BOOST_AUTO_TEST_CASE(testMask)
+{
+  const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+  for(size_t len = 0; len < 100; len++)           // 覆盖 SIMD、8 字节和逐字节三段
+  {
+    for(size_t offset = 0; offset < 4; offset++)
+    {
+      string data(len, 'x');
+      for(size_t i = 0; i < len; i++)
+      {
+        data[i] = static_cast<char>(i * 7);
+      }
+      string expect = data;
+      for(size_t i = 0; i < len; i++)
+      {
+        expect[i] ^= key[(i + offset) % 4];
+      }
+      wsSession::mask(&data[0], len, key, offset);
+      BOOST_CHECK(data == expect);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testUtf8)
+{
+  BOOST_CHECK(wsSession::isValidUtf8("h\xc3\xa9llo \xf0\x9f\x98\x80", 11));
+  BOOST_CHECK(!wsSession::isValidUtf8("\xc0\xaf", 2));          // 过长编码
+  BOOST_CHECK(!wsSession::isValidUtf8("\xed\xa0\x80", 3));      // 代理区
+  BOOST_CHECK(!wsSession::isValidUtf8("\xe2\x82", 2));          // 被截断
+}
+
+BOOST_AUTO_TEST_CASE(testFragments)
+{
+  vector<string> messages;
+  wsSession::Handler handler;
+  handler.onMessage = [&messages](wsSession& session, wsSession::OPCODE opcode, const string& msg) {
+    messages.push_back(msg);
+    session.send(opcode, msg.data(), msg.size());
+  };
+  wsSession session(&handler, "/ws");
+
+  Buffer in;
+  in.append(clientFrame(wsSession::TEXT, "Hel", false));
+  in.append(clientFrame(wsSession::PING, "p"));                 // 控制帧可以插在分片之间
+  string tail = clientFrame(wsSession::CONTINUATION, string(300, 'o'));
+  in.append(tail.substr(0, 10));                                // 帧只收到一部分
+  BOOST_CHECK(session.onData(in));
+  BOOST_CHECK(messages.empty());
+  BOOST_CHECK_EQUAL(in.readableBytes(), 10);
+
+  in.append(tail.substr(10));
+  BOOST_CHECK(session.onData(in));
+  BOOST_CHECK_EQUAL(messages.size(), 1);
+  BOOST_CHECK(messages[0] == "Hel" + string(300, 'o'));
+
+  Buffer out;
+  BOOST_CHECK(session.output(out));
+  string pong = out.retrievetoString(3);
+  BOOST_CHECK(pong == string("\x8a\x01p", 3));
+  BOOST_CHECK_EQUAL(static_cast<uint8_t>(out.peek()[0]), 0x81);  // 回显的消息不带掩码，长度用 16 位表示
+  BOOST_CHECK_EQUAL(static_cast<uint8_t>(out.peek()[1]), 126);
+  BOOST_CHECK_EQUAL(out.readableBytes(), 4 + 303);
+}
+
+BOOST_AUTO_TEST_CASE(testProtocolError)
+{
+  uint16_t closed = 0;
+  wsSession::Handler handler;
+  handler.onMessage = [](wsSession&, wsSession::OPCODE, const string&) {};
+  handler.onClose = [&closed](wsSession&, uint16_t code) { closed = code; };
+  wsSession session(&handler, "/ws");
+
+  Buffer in;
+  in.append(clientFrame(wsSession::CONTINUATION, "x"));          // 没有开始的消息却收到续帧
+  BOOST_CHECK(!session.onData(in));
+  BOOST_CHECK(session.isClosed());
+  BOOST_CHECK_EQUAL(closed, wsSession::PROTOCOL_ERROR);
+  BOOST_CHECK(!session.heartbeat());
+}
+
+BOOST_AUTO_TEST_CASE(testOutboundLimit)
+{
+  uint16_t closed = 0;
+  wsSession::Handler handler;
+  handler.onClose = [&closed](wsSession&, uint16_t code) { closed = code; };
+  wsSession session(&handler, "/ws");
+
+  string chunk(64 * 1024, 'x');
+  size_t queued = 0;
+  while(session.send(wsSession::BINARY, chunk.data(), chunk.size()))    // 一直不调用 output，模拟对端不读
+  {
+    queued += chunk.size();
+    BOOST_REQUIRE_LE(queued, wsSession::MAX_OUTBOUND);
+  }
+  BOOST_CHECK(session.isClosed());
+  BOOST_CHECK_EQUAL(closed, wsSession::POLICY_VIOLATION);
+  BOOST_CHECK(!session.send("late"));
+
+  wsSession pinged(&handler, "/ws");
+  Buffer in;
+  string ping = clientFrame(wsSession::PING, string(125, 'p'));
+  bool alive = true;
+  for(size_t i = 0; alive && i < wsSession::MAX_OUTBOUND / 125 + 1; i++)    // 只发 ping 不读 pong
+  {
+    in.append(ping);
+    alive = pinged.onData(in);
+  }
+  BOOST_CHECK(!alive);
+  BOOST_CHECK(pinged.isClosed());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+#include "user_filter.h"
+
+#include <algorithm>
+
+#include "../base/coroutine.h"
+#include "../base/executor_lane.h"
+#include "../base/log.h"
+
+using namespace std;
+
+const size_t userFilter::MIN_EXPECTED;
+
+userFilter::userFilter(): m_store(nullptr), m_fpRate(0), m_rebuilding(false)
+{
+}
+
+userFilter *userFilter::GetInstance()
+{
+    static userFilter filter;
+    return &filter;
+}
+
+void userFilter::init(userStore *store, double fpRate)
+{
+    m_store = store;
+    m_fpRate = fpRate;
+}
+
+/* 先取用户数估计大小并留一倍余量，再逐个加入用户名 */
+bool userFilter::rebuild()
+{
+    if(!m_store || m_fpRate <= 0)
+    {
+        return false;
+    }
+    {
+        lock_guard<mutex> locker(m_mutex);
+        if(m_rebuilding)
+        {
+            return false;
+        }
+        m_rebuilding = true;
+    }
+
+    shared_ptr<bloom_filter> filter;
+    size_t users = 0;
+    if(m_store->count(users))
+    {
+        filter = make_shared<bloom_filter>(max(users * 2, MIN_EXPECTED), m_fpRate);
+        {
+            lock_guard<mutex> locker(m_mutex);
+            m_building = filter;
+        }
+        bloom_filter *building = filter.get();
+        if(!m_store->scan([building](const string &name) { building->add(name); }))
+        {
+            filter.reset();
+        }
+    }
+    if(!filter)
+    {
+        LOG_ERROR("User filter rebuild error");
+    }
+
+    lock_guard<mutex> locker(m_mutex);
+    if(filter)
+    {
+        m_filter = filter;
+        LOG_INFO("User filter rebuilt: %zu users, %zu bits, %d hashes, %zu bytes",
+            filter->count(), filter->bits(), filter->hashes(), filter->memory());
+    }
+    m_building.reset();
+    m_rebuilding = false;
+    return filter != nullptr;
+}
+
+bool userFilter::mayExist(const string &name)
+{
+    lock_guard<mutex> locker(m_mutex);
+    return !m_filter || m_filter->mayContain(name);
+}
+
+/* 加入数超过预期后误判率上升，交给 blocking 线程按新的行数重建；
+   缓存未命中时会重复加入已有用户，这种加入不计数，也不会触发重建 */
+void userFilter::add(const string &name)
+{
+    bool grow = false;
+    {
+        lock_guard<mutex> locker(m_mutex);
+        if(m_building)
+        {
+            m_building->add(name);
+        }
+        if(m_filter)
+        {
+            grow = m_filter->add(name) && !m_rebuilding && m_filter->count() > m_filter->expected();
+        }
+    }
+    if(grow && co::Executor::instance())
+    {
+        co::Executor::instance()->offload([this] { rebuild(); }, LANE_DB);
+    }
+}
+
+shared_ptr<const bloom_filter> userFilter::current()
+{
+    lock_guard<mutex> locker(m_mutex);
+    return m_filter;
+}
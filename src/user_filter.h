@@ -0,0 +1,49 @@
+/* 已注册用户名的布隆过滤器，注册时的快速路径
+
+    启动时经 userStore 扫一遍所有用户名建立，注册成功时加入，定期重建以纳入别处写入的用户。
+    过滤器报告“一定不存在”时注册跳过 SELECT 直接 INSERT，username 上的唯一键仍是最终判断。
+    只用于注册：登录没有这样的兜底，仍以查库为准。
+*/
+
+#ifndef USER_FILTER_H
+#define USER_FILTER_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+
+#include "../base/bloom_filter.h"
+#include "user_store.h"
+
+class userFilter
+{
+public:
+    static userFilter *GetInstance();
+
+    /* fpRate <= 0 时关闭，mayExist 总是返回 true */
+    void init(userStore *store, double fpRate);
+
+    /* 扫一遍用户名建立新的过滤器再替换旧的，会阻塞，不要在事件循环线程调用；已有重建在进行时直接返回 */
+    bool rebuild();
+
+    bool mayExist(const std::string &name);
+    void add(const std::string &name);
+
+    /* 当前过滤器，没有建立时为空，统计用 */
+    std::shared_ptr<const bloom_filter> current();
+
+    userFilter();
+
+private:
+    static const size_t MIN_EXPECTED = 1024;
+
+    userStore *m_store;
+    double m_fpRate;
+
+    std::mutex m_mutex;
+    std::shared_ptr<bloom_filter> m_filter;
+    std::shared_ptr<bloom_filter> m_building;       // 重建期间注册的用户名同时加入，替换后不会漏掉
+    bool m_rebuilding;
+};
+
+#endif
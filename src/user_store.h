@@ -0,0 +1,39 @@
+/* 用户存储接口
+
+    httpRequest 只通过它查用户和注册，背后可以是 MySQL（mysqlUserStore），也可以是进程内的
+    memoryUserStore：没有数据库的机器上压测登录注册的吞吐，或者小规模部署不装 MySQL。
+    凭据缓存、布隆过滤器在接口之上，对各实现都生效。
+*/
+
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <string>
+#include <functional>
+
+#include "../base/coroutine.h"
+
+class userStore
+{
+public:
+    struct result
+    {
+        bool ok = false;            // false 表示存储不可用、超时等，与“不存在”“重名”区分开
+        bool exists = false;        // find：用户存在；add：用户名已被占用，没有写入
+        std::string passwd;         // find 找到时的口令
+        std::string error;
+    };
+
+    virtual ~userStore() {}
+
+    virtual co::Task<result> find(std::string name) = 0;
+    virtual co::Task<result> add(std::string name, std::string pwd) = 0;
+
+    /* 用户数的估计和逐个列出用户名，重建布隆过滤器用，会阻塞；失败时返回 false */
+    virtual bool count(size_t &users) = 0;
+    virtual bool scan(const std::function<void(const std::string &)> &fn) = 0;
+
+    virtual const char *name() const = 0;
+};
+
+#endif
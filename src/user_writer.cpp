@@ -0,0 +1,276 @@
+#include "user_writer.h"
+
+#include <unordered_set>
+#include <assert.h>
+#include <mysql/mysqld_error.h>
+
+#include "../base/sql_async.h"
+#include "../base/log.h"
+
+using namespace std;
+
+struct userWriter::row
+{
+    string name;
+    string pwd;
+    sql_result res;                     // errcode 为 0 且 ok 为 false 表示还没有结果
+    shared_ptr<co::wakeup> waker;       // 没有事件循环时为空，就地写入
+};
+
+/* 与 blocking 一样只在写完后恢复，取消在恢复后检查 */
+struct userWriter::awaiter: co::cancellable
+{
+    userWriter *self;
+    shared_ptr<row> r;
+
+    awaiter(userWriter *w, shared_ptr<row> rw): self(w), r(std::move(rw)) {}
+
+    bool await_ready() const noexcept { return !co::Executor::instance(); }
+
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        userWriter *w = self;
+        shared_ptr<row> rw = r;
+        if(!bind(h, nullptr)) {
+            return false;
+        }
+        rw->waker = make_shared<co::wakeup>(h);
+        {
+            lock_guard<mutex> locker(w->m_mutex);
+            if(w->m_rows.empty())
+            {
+                w->m_first = chrono::steady_clock::now();
+            }
+            w->m_rows.push_back(rw);
+        }
+        w->m_cond.notify_one();
+        return true;
+    }
+
+    sql_result await_resume() {
+        check();
+        if(!r->waker)
+        {
+            vector<shared_ptr<row>> batch{r};
+            self->write(batch);
+        }
+        return std::move(r->res);
+    }
+};
+
+static void fail(sql_result &res, unsigned int errcode, const string &error)
+{
+    res.ok = false;
+    res.errcode = errcode;
+    res.error = error;
+}
+
+
+userWriter::userWriter(): m_pool(nullptr), m_db(nullptr), m_batchRows(0), m_batchDelay(0), m_stop(false), m_batches(0), m_batchedRows(0)
+{
+}
+
+userWriter::~userWriter()
+{
+    stop();
+}
+
+userWriter *userWriter::GetInstance()
+{
+    static userWriter writer;
+    return &writer;
+}
+
+void userWriter::init(conn_pool *pool, int batchRows, int batchDelayMs, sql_async *db)
+{
+    assert(pool && !m_thread.joinable());
+    m_pool = pool;
+    m_db = db ? db : sql_async::GetInstance();
+    m_batchRows = batchRows;
+    m_batchDelay = chrono::milliseconds(batchDelayMs > 0 ? batchDelayMs : 0);
+    m_stop = false;
+    if(m_batchRows > 1)
+    {
+        m_thread = thread(&userWriter::run, this);
+    }
+}
+
+void userWriter::stop()
+{
+    {
+        lock_guard<mutex> locker(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if(m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+co::Task<sql_result> userWriter::insert(string name, string pwd)
+{
+    if(m_batchRows <= 1)
+    {
+        vector<string> params{name, pwd};
+        co_return co_await m_db->execute(conn_pool::USER_INSERT, std::move(params));
+    }
+    shared_ptr<row> r = make_shared<row>();
+    r->name = std::move(name);
+    r->pwd = std::move(pwd);
+    awaiter a(this, r);
+    co_return co_await a;
+}
+
+/* 写线程：第一行到达后最多再等 batchDelay 凑批，满 batchRows 行或停止时立即写；停止前把已入队的写完 */
+void userWriter::run()
+{
+    while(true)
+    {
+        vector<shared_ptr<row>> batch;
+        {
+            unique_lock<mutex> locker(m_mutex);
+            m_cond.wait(locker, [this] { return m_stop || !m_rows.empty(); });
+            if(m_rows.empty())
+            {
+                return;
+            }
+            m_cond.wait_until(locker, m_first + m_batchDelay, [this] {
+                return m_stop || m_rows.size() >= static_cast<size_t>(m_batchRows);
+            });
+            if(m_rows.size() <= static_cast<size_t>(m_batchRows))
+            {
+                batch.swap(m_rows);
+            }
+            else
+            {
+                batch.assign(m_rows.begin(), m_rows.begin() + m_batchRows);
+                m_rows.erase(m_rows.begin(), m_rows.begin() + m_batchRows);
+                m_first = chrono::steady_clock::now();
+            }
+        }
+        write(batch);
+        for(auto &r: batch)
+        {
+            r->waker->fire();
+        }
+    }
+}
+
+/* 批内重名的只保留第一个；多行写入需要回退时逐行执行预处理语句 */
+void userWriter::write(vector<shared_ptr<row>> &batch)
+{
+    MYSQL *conn = m_pool->GetConnection();
+    if(!conn)
+    {
+        for(auto &r: batch)
+        {
+            fail(r->res, 0, "no connection");
+        }
+        return;
+    }
+
+    vector<shared_ptr<row>> rows;
+    unordered_set<string> names;
+    for(auto &r: batch)
+    {
+        if(names.insert(r->name).second)
+        {
+            rows.push_back(r);
+        }
+        else
+        {
+            fail(r->res, ER_DUP_ENTRY, "Duplicate entry '" + r->name + "'");
+        }
+    }
+    if(rows.size() == 1 || !writeBatch(conn, rows))
+    {
+        for(auto &r: rows)
+        {
+            if(r->res.errcode == 0)
+            {
+                m_pool->ExecuteStmt(conn, conn_pool::USER_INSERT, {r->name, r->pwd}, r->res);
+            }
+        }
+    }
+    m_pool->ReleaseConnection(conn);
+}
+
+/* 一个事务写完一批；返回 false 表示没有写成（比如别处并发写入导致重复键），已回滚，未判定的行需要逐行重试 */
+bool userWriter::writeBatch(MYSQL *conn, vector<shared_ptr<row>> &rows)
+{
+    string in, values;
+    for(auto &r: rows)
+    {
+        in += (in.empty() ? "" : ", ") + quote(conn, r->name);
+    }
+
+    if(mysql_query(conn, "BEGIN") != 0)
+    {
+        LOG_ERROR("Register batch error: %s", mysql_error(conn));
+        return false;
+    }
+
+    /* 找出库里已有的用户名，FOR UPDATE 同时锁住其余用户名所在的间隙，提交前别处插不进来 */
+    string order = "SELECT username FROM user WHERE username IN (" + in + ") FOR UPDATE";
+    MYSQL_RES *res = nullptr;
+    if(mysql_query(conn, order.c_str()) != 0 || !(res = mysql_store_result(conn)))
+    {
+        LOG_ERROR("Register batch error: %s", mysql_error(conn));
+        mysql_query(conn, "ROLLBACK");
+        return false;
+    }
+    unordered_set<string> existing;
+    while(MYSQL_ROW fields = mysql_fetch_row(res))
+    {
+        unsigned long *lengths = mysql_fetch_lengths(res);
+        existing.emplace(fields[0], lengths[0]);
+    }
+    mysql_free_result(res);
+
+    vector<shared_ptr<row>> fresh;
+    for(auto &r: rows)
+    {
+        if(existing.count(r->name))
+        {
+            fail(r->res, ER_DUP_ENTRY, "Duplicate entry '" + r->name + "'");
+        }
+        else
+        {
+            values += (values.empty() ? "(" : ", (") + quote(conn, r->name) + ", " + quote(conn, r->pwd) + ")";
+            fresh.push_back(r);
+        }
+    }
+    if(fresh.empty())
+    {
+        mysql_query(conn, "ROLLBACK");
+        return true;
+    }
+
+    order = "INSERT INTO user(username, passwd) VALUES " + values;
+    if(mysql_query(conn, order.c_str()) != 0 || mysql_query(conn, "COMMIT") != 0)
+    {
+        LOG_WARN("Register batch of %zu rolled back: %s", fresh.size(), mysql_error(conn));
+        mysql_query(conn, "ROLLBACK");
+        return false;
+    }
+    for(auto &r: fresh)
+    {
+        r->res.ok = true;
+        r->res.affected = 1;
+    }
+    m_batches++;
+    m_batchedRows += fresh.size();
+    LOG_DEBUG("Register batch: %zu rows, %zu duplicate", fresh.size(), rows.size() - fresh.size());
+    return true;
+}
+
+string userWriter::quote(MYSQL *conn, const string &value)
+{
+    string out(value.size() * 2 + 3, '\0');
+    out[0] = '\'';
+    unsigned long n = mysql_real_escape_string(conn, &out[1], value.data(), value.size());
+    out.resize(n + 1);
+    out += '\'';
+    return out;
+}
@@ -0,0 +1,73 @@
+/* 注册写入的组提交
+
+    并发的注册不再各自 autocommit 一条 INSERT：写线程收集 N ms 内或满 M 行的注册，
+    在一个事务里用一条多行 INSERT 写入，提交后逐个恢复等待的协程，各自拿到自己那一行的结果。
+    - 重名按行判断：批内重复的只保留第一个；事务里先 SELECT ... FOR UPDATE 找出库里已有的（同时锁住间隙）
+    - 批量写入失败（比如别处并发写入导致重复键）时回滚，改为逐行插入
+    - 入队后这一行一定会写完，不随连接取消提前恢复，恢复后再抛出 co::cancelled
+*/
+
+#ifndef USER_WRITER_H
+#define USER_WRITER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <stdint.h>
+
+#include "../base/coroutine.h"
+#include "../base/sql_conn_pool.h"
+
+class sql_async;
+
+class userWriter
+{
+public:
+    static userWriter *GetInstance();
+
+    /* batchRows <= 1 时不攒批，insert 直接经 db（默认 sql_async 单例）执行预处理语句 */
+    void init(conn_pool *pool, int batchRows, int batchDelayMs, sql_async *db = nullptr);
+    void stop();
+
+    /* 失败时 errcode 为 ER_DUP_ENTRY 表示用户名已存在 */
+    co::Task<sql_result> insert(std::string name, std::string pwd);
+
+    /* 以批量事务写入的批数和行数，统计用 */
+    uint64_t batches() const { return m_batches; }
+    uint64_t batchedRows() const { return m_batchedRows; }
+
+    userWriter();
+    ~userWriter();
+
+private:
+    struct row;
+    struct awaiter;
+
+    void run();
+    void write(std::vector<std::shared_ptr<row>> &batch);
+    bool writeBatch(MYSQL *conn, std::vector<std::shared_ptr<row>> &rows);
+    static std::string quote(MYSQL *conn, const std::string &value);
+
+private:
+    conn_pool *m_pool;
+    sql_async *m_db;
+    int m_batchRows;
+    std::chrono::milliseconds m_batchDelay;
+    std::thread m_thread;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::shared_ptr<row>> m_rows;
+    std::chrono::steady_clock::time_point m_first;      // 本批第一行入队的时间
+    bool m_stop;
+
+    std::atomic<uint64_t> m_batches;        // 只由写线程修改
+    std::atomic<uint64_t> m_batchedRows;
+};
+
+#endif
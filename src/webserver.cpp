@@ -1,9 +1,11 @@
 #include "webserver.h"
+#include "mysql_user_store.h"
+#include "memory_user_store.h"
+#include "sharded_user_store.h"
 
-WebServer::WebServer() :m_threadpool(new ThreadPool(8)) ,m_timer(new HeapTimer())
+WebServer::WebServer() :users(nullptr), m_timer(new HeapTimer()), m_ioLane(nullptr), m_roundUs(0), m_targetWaitMs(0), m_wakeupFd(-1), m_timerSeq(MAX_FD), m_filterRebuildMs(0),
+    m_shards(nullptr), m_sessionSweeps(0)
 { 
-    users = new httpConn[MAX_FD];
-
     /* 资源所在目录 */
     m_srcDir = getcwd(nullptr, 200);
     assert(m_srcDir);
@@ -14,6 +16,17 @@ WebServer::WebServer() :m_threadpool(new ThreadPool(8)) ,m_timer(new HeapTimer()
 
 WebServer::~WebServer()
 {
+    /* 先等工作线程把手上的任务做完再 join，之后才能释放连接和各个单例 */
+    for(std::unique_ptr<executor_lane> &lane: m_lanes)
+    {
+        lane.reset();
+    }
+    sessionStore::GetInstance()->save();
+    userWriter::GetInstance()->stop();
+    sql_async::GetInstance()->stop();
+    sql_router::GetInstance()->stop();
+    co::Executor::setInstance(nullptr);
+    close(m_wakeupFd);
     close(m_epollfd);
     close(m_listenfd);
     close(m_pipefd[1]);
@@ -29,14 +42,31 @@ WebServer::~WebServer()
 void WebServer::init(int port, int timeOutMs,int trigMode, bool optLinger, 
         int sqlPort, string sqlUsername, string sqlPasswd, 
         string dbName, int connPoolNum, int threadNum,
-        bool openLog, int logQueueSize)
+        bool openLog, int logQueueSize,
+        size_t bodyMemLimit, size_t maxBodySize,
+        int blockingThreadNum, int sqlThreadNum, int sqlTimeoutMs,
+        size_t credCacheSize, int credCacheTtlMs,
+        double userFilterFpRate, int userFilterRebuildMs,
+        int regBatchRows, int regBatchDelayMs,
+        int connPoolMin, int connWaitMs, int connPerThread,
+        const string &sqlHost, const std::vector<sql_endpoint> &sqlReplicas,
+        const string &userStoreType, const string &userStorePath,
+        double breakerFailureRate, int breakerSlowMs, int breakerOpenMs,
+        int sessionTtlMs, size_t maxSessions, const string &sessionSnapshot,
+        const string &loopCpus, const string &workerCpus,
+        int dbThreadNum, size_t laneQueueMax,
+        int minThreadNum, int targetWaitMs)
 {
     m_port = port;
     m_timeoutMs = timeOutMs;
     httpConn::m_userCount = 0;
     httpConn::m_srcDir = m_srcDir;
+    httpRequest::m_bodyMemLimit = bodyMemLimit;
+    httpRequest::m_maxBodySize = maxBodySize;
+    httpRequest::initCredentialCache(credCacheSize, credCacheTtlMs);
 
     initEventMode(trigMode);
+    initRoutes();
     if( openLog )
     {
         Log::get_instance()->init("./log/ServerLog", 2000, 800000, logQueueSize);
@@ -51,17 +81,104 @@ void WebServer::init(int port, int timeOutMs,int trigMode, bool optLinger,
                             (l_trig_mode ? "ET": "LT"),
                             (trig_mode ? "ET": "LT"));
             LOG_INFO("srcDir: %s", httpConn::m_srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("SqlConnPool num: %d (min %d, wait %dms, per thread %d), ThreadPool num: %d, blocking threads: %d, db threads: %d",
+                            connPoolNum, connPoolMin, connWaitMs, connPerThread, threadNum, blockingThreadNum, dbThreadNum);
+            LOG_INFO("Sql threads: %d, query timeout: %dms", sqlThreadNum, sqlTimeoutMs);
+            LOG_INFO("Body mem limit: %zu, max body size: %zu", bodyMemLimit, maxBodySize);
+            LOG_INFO("Credential cache size: %zu, ttl: %dms", credCacheSize, credCacheTtlMs);
+            LOG_INFO("User filter fp rate: %g, rebuild interval: %dms", userFilterFpRate, userFilterRebuildMs);
+            LOG_INFO("Register batch rows: %d, batch delay: %dms", regBatchRows, regBatchDelayMs);
+            LOG_INFO("User store: %s %s", userStoreType.c_str(), userStorePath.c_str());
+            LOG_INFO("Circuit breaker failure rate: %g, slow: %dms, open: %dms", breakerFailureRate, breakerSlowMs, breakerOpenMs);
+            LOG_INFO("Session ttl: %dms, max sessions: %zu, snapshot: %s", sessionTtlMs, maxSessions, sessionSnapshot.c_str());
         }
     }
+    /* threadNum、blockingThreadNum、dbThreadNum 是各通道线程数的上限，先起 minThreadNum 个，按排队时间增减 */
+    m_targetWaitMs = targetWaitMs;
+    initAffinity(loopCpus, workerCpus, std::min(minThreadNum, threadNum), threadNum);
+    m_lanes.emplace_back(new executor_lane(LANE_FILE, std::min(minThreadNum, blockingThreadNum), blockingThreadNum, laneQueueMax));
+    m_lanes.emplace_back(new executor_lane(LANE_DB, std::min(minThreadNum, dbThreadNum), dbThreadNum, laneQueueMax));
+    for(const std::unique_ptr<executor_lane> &lane: m_lanes)
+    {
+        lane_stats s = lane->takeStats();
+        LOG_INFO("Lane %s: %zu-%zu threads, queue limit %zu, target wait %dms", s.name.c_str(), s.minThreads, s.maxThreads,
+            s.maxQueue, m_targetWaitMs);
+    }
     
-    conn_pool::GetInstance()->init("localhost", sqlUsername, sqlPasswd, dbName, 3306, connPoolNum);
+    /* memory：用户放在进程内，不连数据库；查一次和查过滤器差不多快，也不用过滤器
+        sharded：userStorePath 是分片表，各分片自己建连接池，不用 sql_router 等单例；定期检查分片表是否改过
+        mysql：主库即 conn_pool::GetInstance()，写入、注册和过滤器重建都在主库上
+        mysql 和 sharded 的每个 MySQL 分片各有一个熔断器 */
+    breaker_config breaker;
+    breaker.failureRate = breakerFailureRate;
+    breaker.slowMs = breakerSlowMs;
+    breaker.openMs = breakerOpenMs;
+    if(userStoreType == "memory")
+    {
+        memoryUserStore *store = new memoryUserStore();
+        m_userStore.reset(store);
+        if(!store->init(userStorePath))
+        {
+            m_stop = true;
+        }
+        userFilterFpRate = 0;
+    }
+    else if(userStoreType == "sharded")
+    {
+        mysqlUserStore::options opt;
+        opt.user = sqlUsername;
+        opt.passWord = sqlPasswd;
+        opt.dbName = dbName;
+        opt.maxConn = connPoolNum;
+        opt.minConn = connPoolMin;
+        opt.waitMs = connWaitMs;
+        opt.localConn = connPerThread;
+        opt.sqlThreads = sqlThreadNum;
+        opt.timeoutMs = sqlTimeoutMs;
+        opt.batchRows = regBatchRows;
+        opt.batchDelayMs = regBatchDelayMs;
+        opt.breaker = breaker;
+        m_shards = new shardedUserStore(opt);
+        m_userStore.reset(m_shards);
+        if(!m_shards->load(userStorePath))
+        {
+            m_stop = true;
+        }
+        runAfter(SHARD_MAP_INTERVAL, std::bind(&WebServer::reloadShardMap, this));
+    }
+    else
+    {
+        sql_router *router = sql_router::GetInstance();
+        router->init(sql_endpoint { "primary", sqlHost, sqlPort }, sqlReplicas, sqlUsername, sqlPasswd, dbName,
+            connPoolNum, connPoolMin, connWaitMs, connPerThread);
+        sql_async::GetInstance()->init(router, sqlThreadNum, sqlTimeoutMs);
+        userWriter::GetInstance()->init(router->primary(), regBatchRows, regBatchDelayMs);
+        m_userStore.reset(new mysqlUserStore(router, breaker));
+    }
+    httpRequest::setUserStore(m_userStore.get());
+    /* 启动时先建好过滤器，之后定期在 blocking 线程重建 */
+    userFilter::GetInstance()->init(m_userStore.get(), userFilterFpRate);
+    m_filterRebuildMs = userFilterRebuildMs;
+    if(userFilterFpRate > 0)
+    {
+        userFilter::GetInstance()->rebuild();
+        runAfter(m_filterRebuildMs, std::bind(&WebServer::rebuildUserFilter, this));
+    }
    //  users->initmysql_result(m_sqlConnPool);     // 初始化数据可读取表
 
+    /* 会话在内存里，定时器定期清过期的、写快照，停止时再写一次 */
+    sessionStore::GetInstance()->init(sessionTtlMs, maxSessions, sessionSnapshot);
+    if(sessionStore::GetInstance()->enabled())
+    {
+        runAfter(SESSION_SWEEP_INTERVAL, std::bind(&WebServer::expireSessions, this));
+    }
+
     if( !initSocket() )
     {
         m_stop = true;
     }
+    runAfter(STATS_INTERVAL, std::bind(&WebServer::reportStats, this));
+    runAfter(LANE_ADAPT_INTERVAL, std::bind(&WebServer::adaptLanes, this));
 }
 
 
@@ -157,6 +274,16 @@ bool WebServer::initSocket()
     utils.setNonBlock( m_pipefd[1] );
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
 
+    m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if( m_wakeupFd < 0 )
+    {
+        close(m_listenfd);
+        LOG_ERROR("Create eventfd error!");
+        return false;
+    }
+    utils.addfd(m_epollfd, m_wakeupFd, false, 0);
+    co::Executor::setInstance(this);
+
     utils.addsig(SIGPIPE, SIG_IGN);
     utils.addsig(SIGALRM, utils.sig_handler, false);
     utils.addsig(SIGTERM, utils.sig_handler, false);
@@ -175,6 +302,296 @@ void WebServer::closeConn(httpConn *client)
 }
 
 
+/* 在事件循环线程里调用：WebSocket 连接发出 ping 后等下一个周期，期间收不到任何帧才关闭 */
+void WebServer::onTimeout(httpConn *client)
+{
+    assert(client);
+    if(client->heartbeat())
+    {
+        m_timer->add(client->getFd(), m_timeoutMs, std::bind(&WebServer::onTimeout, this, client));
+        return;
+    }
+    closeConn(client);
+}
+
+
+void WebServer::reportStats()
+{
+    lru_stats cred = httpRequest::credentialStats();
+    LOG_INFO("Credential cache: size %zu, hits %llu, misses %llu, hit ratio %.2f%%, expired %llu, evictions %llu",
+        cred.size, (unsigned long long)cred.hits, (unsigned long long)cred.misses, cred.hitRatio() * 100,
+        (unsigned long long)cred.expired, (unsigned long long)cred.evictions);
+    std::shared_ptr<const bloom_filter> filter = userFilter::GetInstance()->current();
+    if(filter)
+    {
+        LOG_INFO("User filter: %zu users, %zu bytes, fp rate %.4f%%",
+            filter->count(), filter->memory(), filter->currentFpRate() * 100);
+    }
+    for(const sql_router::endpoint_stats &ep: sql_router::GetInstance()->getStats())
+    {
+        const pool_stats &pool = ep.pool;
+        string waits;
+        for(int i = 0; i < pool_stats::BUCKETS; i++)
+        {
+            char item[48];
+            if(pool_stats::BUCKET_MS[i])
+            {
+                snprintf(item, sizeof(item), " <%dms:%llu", pool_stats::BUCKET_MS[i], pool.waits[i]);
+            }
+            else
+            {
+                snprintf(item, sizeof(item), " more:%llu", pool.waits[i]);
+            }
+            waits += item;
+        }
+        LOG_INFO("SqlConnPool %s%s: picks %llu, ejections %llu, outstanding %d",
+            ep.name.c_str(), ep.ejected ? " (ejected)" : "", ep.picks, ep.ejections, ep.outstanding);
+        LOG_INFO("SqlConnPool %s: total %u, busy %u, idle %u, timeouts %llu, connect failures %llu, wait%s",
+            ep.name.c_str(), pool.total, pool.busy, pool.idle, pool.timeouts, pool.failures, waits.c_str());
+        LOG_INFO("SqlConnPool %s thread slots: %u connections, %llu local hits, %llu steals",
+            ep.name.c_str(), pool.local, pool.localHits, pool.steals);
+    }
+
+    if(mysqlUserStore *store = dynamic_cast<mysqlUserStore *>(m_userStore.get()))
+    {
+        breaker_stats breaker = store->breakerStats();
+        LOG_INFO("Circuit breaker mysql %s: %u calls, %.1f%% bad, trips %llu, recoveries %llu, rejected %llu",
+            breaker.state, breaker.calls, breaker.badRate * 100, breaker.trips, breaker.recoveries, breaker.rejected);
+    }
+    if(m_shards)
+    {
+        for(const shard_stats &shard: m_shards->getStats())
+        {
+            string latency;
+            for(int i = 0; i < shard_stats::BUCKETS; i++)
+            {
+                char item[48];
+                if(shard_stats::BUCKET_MS[i])
+                {
+                    snprintf(item, sizeof(item), " <%dms:%llu", shard_stats::BUCKET_MS[i], shard.latency[i]);
+                }
+                else
+                {
+                    snprintf(item, sizeof(item), " more:%llu", shard.latency[i]);
+                }
+                latency += item;
+            }
+            LOG_INFO("Shard %s (%s %s, %.1f%% of users): calls %llu, errors %llu, avg %.2fms, max %.2fms, latency%s",
+                shard.name.c_str(), shard.type.c_str(), shard.address.c_str(), shard.share * 100, shard.calls,
+                shard.errors, shard.avgMs(), shard.maxUs / 1000.0, latency.c_str());
+            if(shard.hasBreaker)
+            {
+                LOG_INFO("Circuit breaker %s %s: %u calls, %.1f%% bad, trips %llu, recoveries %llu, rejected %llu",
+                    shard.name.c_str(), shard.breaker.state, shard.breaker.calls, shard.breaker.badRate * 100,
+                    shard.breaker.trips, shard.breaker.recoveries, shard.breaker.rejected);
+            }
+        }
+    }
+
+    sessionStore *sessions = sessionStore::GetInstance();
+    if(sessions->enabled())
+    {
+        LOG_INFO("Sessions: %zu, hits %llu, misses %llu", sessions->size(),
+            (unsigned long long)sessions->hits(), (unsigned long long)sessions->misses());
+    }
+
+    for(const std::unique_ptr<executor_lane> &lane: m_lanes)
+    {
+        lane_stats s = lane->takeStats();
+        LOG_INFO("Lane %s: %zu threads (%zu-%zu, resized %llu), queued %zu, started %llu, rejected %llu, "
+            "wait avg %.2fms, max %.2fms, utilization %.0f%%, blocked %.0f%%",
+            s.name.c_str(), s.threads, s.minThreads, s.maxThreads, s.resizes, s.depth, s.started, s.rejected,
+            s.avgWaitMs, s.maxWaitMs, s.utilization * 100, s.blocked * 100);
+    }
+
+    const single_flight<sql_result> &flights = sql_async::GetInstance()->flights();
+    if(flights.shared())
+    {
+        LOG_INFO("Coalesced lookups: %llu of %llu", (unsigned long long)flights.shared(), (unsigned long long)flights.calls());
+    }
+    userWriter *writer = userWriter::GetInstance();
+    if(writer->batches())
+    {
+        LOG_INFO("Register batches: %llu, rows: %llu, avg %.1f rows per commit",
+            (unsigned long long)writer->batches(), (unsigned long long)writer->batchedRows(),
+            double(writer->batchedRows()) / writer->batches());
+    }
+    runAfter(STATS_INTERVAL, std::bind(&WebServer::reportStats, this));
+}
+
+void WebServer::adaptLanes()
+{
+    for(const std::unique_ptr<executor_lane> &lane: m_lanes)
+    {
+        lane->adapt(m_targetWaitMs);
+    }
+    runAfter(LANE_ADAPT_INTERVAL, std::bind(&WebServer::adaptLanes, this));
+}
+
+void WebServer::rebuildUserFilter()
+{
+    offload([] { userFilter::GetInstance()->rebuild(); }, LANE_DB);
+    runAfter(m_filterRebuildMs, std::bind(&WebServer::rebuildUserFilter, this));
+}
+
+void WebServer::expireSessions()
+{
+    m_sessionSweeps++;
+    bool snapshot = m_sessionSweeps % (SESSION_SNAPSHOT_INTERVAL / SESSION_SWEEP_INTERVAL) == 0;
+    offload([snapshot] {
+        sessionStore *sessions = sessionStore::GetInstance();
+        size_t expired = sessions->expire();
+        if(expired > 0)
+        {
+            LOG_DEBUG("Sessions expired: %zu", expired);
+        }
+        if(snapshot)
+        {
+            sessions->save();
+        }
+    });
+    runAfter(SESSION_SWEEP_INTERVAL, std::bind(&WebServer::expireSessions, this));
+}
+
+void WebServer::reloadShardMap()
+{
+    shardedUserStore *shards = m_shards;
+    offload([shards] { shards->reloadIfChanged(); }, LANE_DB);
+    runAfter(SHARD_MAP_INTERVAL, std::bind(&WebServer::reloadShardMap, this));
+}
+
+
+/* 会话 Cookie 的 Max-Age 等于服务端的 ttl：登录时发，之后每次凭它认出用户都重发一次，
+    跟着服务端的滑动过期往后推，活跃用户的浏览器不会在登录 ttl 之后丢掉它 */
+static void setSessionCookie(httpResponse& response, const string& id)
+{
+    response.setHeader("Set-Cookie", string(SESSION_COOKIE) + "=" + id + "; Path=/; Max-Age="
+        + std::to_string(sessionStore::GetInstance()->ttlMs() / 1000) + "; HttpOnly; SameSite=Lax");
+}
+
+void WebServer::initRoutes()
+{
+    httpRouter* router = httpRouter::GetInstance();
+    router->get("/", [](httpRequest&, httpResponse& response) {
+        response.setPath("/index.html");
+    });
+    for(const string page: { "/index", "/register", "/login", "/video", "/picture" })
+    {
+        router->get(page, [page](httpRequest&, httpResponse& response) {
+            response.setPath(page + ".html");
+        });
+    }
+
+    /* 欢迎页面要登录过：开启会话时凭 Cookie 在内存里认出用户，不访问用户存储，没有有效会话的去登录页面 */
+    for(const string page: { "/welcome", "/welcome.html" })
+    {
+        router->get(page, [](httpRequest& request, httpResponse& response) {
+            sessionStore *sessions = sessionStore::GetInstance();
+            if(!sessions->enabled())
+            {
+                response.setPath("/welcome.html");
+                return;
+            }
+            string id = request.cookie(SESSION_COOKIE);
+            string user;
+            bool allowed = sessions->find(id, user);
+            if(allowed)
+            {
+                setSessionCookie(response, id);
+            }
+            response.setPath(allowed ? "/welcome.html" : "/login.html");
+        });
+    }
+    router->get("/whoami", [](httpRequest& request, httpResponse& response) {
+        string id = request.cookie(SESSION_COOKIE);
+        string user;
+        if(!sessionStore::GetInstance()->find(id, user))
+        {
+            response.setCode(403);
+            return;
+        }
+        setSessionCookie(response, id);
+        response.stream("text/plain", [user](Buffer& buff) {
+            buff.append(user + "\n");
+            return false;
+        });
+    });
+    router->get("/logout", [](httpRequest& request, httpResponse& response) {
+        sessionStore::GetInstance()->remove(request.cookie(SESSION_COOKIE));
+        response.setHeader("Set-Cookie", string(SESSION_COOKIE) + "=; Path=/; Max-Age=0; HttpOnly; SameSite=Lax");
+        response.setPath("/login.html");
+    });
+
+    /* 表单提交：验证通过去欢迎页面并发会话 Cookie，否则去错误页面，用户存储不可用（熔断时立即返回）时错误页面带 503；
+        查库时协程挂起，工作线程去处理别的请求。放在 blocking/db 通道上，一阵登录排队时不拖慢静态页面，排满了回 503 */
+    for(int isLogin = 0; isLogin < 2; isLogin++)
+    {
+        router->postAsync(isLogin ? "/login.html" : "/register.html",
+            [isLogin](httpRequest& request, httpResponse& response) -> co::Task<void> {
+                string name = request.getPost("username");
+                string pwd = request.getPost("password");
+                httpRequest::VERIFY_RESULT ret = co_await httpRequest::userVerifyAsync(name, pwd, isLogin);
+                if(ret == httpRequest::VERIFY_UNAVAILABLE)
+                {
+                    response.setCode(503);
+                }
+                response.setPath(ret == httpRequest::VERIFY_OK ? "/welcome.html" : "/error.html");
+                string id = ret == httpRequest::VERIFY_OK ? sessionStore::GetInstance()->create(name) : "";
+                if(id != "")
+                {
+                    setSessionCookie(response, id);
+                }
+            });
+        router->setLane(isLogin ? "/login.html" : "/register.html", LANE_DB);
+    }
+}
+
+
+/* 调用 init 的线程就是事件循环线程，先把它绑好，再分配连接数组（首次访问落在它的 NUMA 节点上）；
+    工作线程 i 绑到 workerCpus 的第 i % n 个 CPU，起来后自己分配任务节点。列表为空的不绑。
+    连接的缓冲区在事件循环的节点上，工作线程放到别的节点会跨节点读写，写一条警告 */
+void WebServer::initAffinity(const string &loopCpus, const string &workerCpus, int minThreadNum, int threadNum)
+{
+    std::vector<int> loop, workers;
+    if(!cpu_affinity::parse(loopCpus, loop) || !cpu_affinity::parse(workerCpus, workers))
+    {
+        m_stop = true;
+        loop.clear();
+        workers.clear();
+    }
+    if(cpu_affinity::pin(loop))
+    {
+        ThreadPool::warmThread();
+    }
+    users = new httpConn[MAX_FD];
+
+    m_lanes.emplace_back(new executor_lane(LANE_IO, minThreadNum, threadNum, 0, [workers](size_t i) {
+        if(!workers.empty())
+        {
+            cpu_affinity::pin(std::vector<int>(1, workers[i % workers.size()]));
+        }
+    }));
+    m_ioLane = m_lanes.front().get();
+
+    LOG_INFO("CPU affinity: %d nodes, event loop %s", cpu_affinity::nodeCount(), cpu_affinity::describe(loop).c_str());
+    int loopNode = loop.empty() ? -1 : cpu_affinity::nodeOf(loop.front());
+    for(int i = 0; i < threadNum && !workers.empty(); i++)
+    {
+        int cpu = workers[i % workers.size()];
+        LOG_INFO("CPU affinity: worker %d -> %s", i, cpu_affinity::describe(std::vector<int>(1, cpu)).c_str());
+        if(loopNode >= 0 && cpu_affinity::nodeOf(cpu) != loopNode)
+        {
+            LOG_WARN("CPU affinity: worker %d on node %d, connection buffers on node %d", i, cpu_affinity::nodeOf(cpu), loopNode);
+        }
+    }
+    if(workers.empty())
+    {
+        LOG_INFO("CPU affinity: %d workers unpinned", threadNum);
+    }
+    LOG_INFO("CPU affinity: blocking lanes unpinned");
+}
+
+
 /* 设置触发模式 */
 void WebServer::initEventMode(int trigMode)
 {
@@ -217,7 +634,9 @@ void WebServer::eventLoop()
     }
     while(!m_stop)
     {
-        int num = epoll_wait( m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        int timeMs = m_timer->GetNextTick();    // 处理到期的定时器，并等到下一个定时器到期为止
+        int num = epoll_wait( m_epollfd, events, MAX_EVENT_NUMBER, timeMs);
+        m_roundUs = executor_lane::nowUs();
         if( (num < 0) && (errno != EINTR) )
 		{
 			LOG_ERROR("%s","epoll failure\n");
@@ -237,6 +656,14 @@ void WebServer::eventLoop()
                     continue;
                 }
             }
+            else if( fd == m_wakeupFd )
+            {
+                dealPending();
+            }
+            else if( m_watchers.count(fd) )
+            {
+                dealWatch(fd);
+            }
             else if( events[i].events & ( EPOLLRDHUP | EPOLLHUP | EPOLLERR) )
             {
                 closeConn(&users[fd]);      // 通过fd索引到具体的http连接
@@ -261,10 +688,8 @@ void WebServer::eventLoop()
                 LOG_ERROR("Unexpected event");
             }
         }
-        if (m_timeoutMs > 0)
-        {
-            m_timer->GetNextTick();
-        }
+        m_ioLane->queued(m_ready.size());
+        m_ioLane->pool().AddBatch(m_ready);     // 这一轮就绪的读写一次交给 io 通道
     }
 }
 
@@ -358,11 +783,107 @@ bool WebServer::dealSignal()
 }
 
 
+void WebServer::post(std::function<void()> cb)
+{
+    {
+        std::lock_guard<std::mutex> locker(m_pendingMtx);
+        m_pending.push_back(std::move(cb));
+    }
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wakeupFd, &one, sizeof(one));
+    (void)n;
+}
+
+void WebServer::runAfter(int ms, std::function<void()> cb)
+{
+    post([this, ms, cb] {
+        if(++m_timerSeq < MAX_FD)       // 回绕
+        {
+            m_timerSeq = MAX_FD;
+        }
+        m_timer->add(m_timerSeq, ms, cb);
+    });
+}
+
+void WebServer::watch(int fd, uint32_t events, std::function<void()> cb)
+{
+    post([this, fd, events, cb] {
+        epoll_event event;
+        event.data.fd = fd;
+        event.events = events | EPOLLONESHOT;
+        if(epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) < 0 && epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event) < 0)
+        {
+            LOG_ERROR("Watch fd %d error: %d", fd, errno);
+        }
+        m_watchers[fd] = cb;
+    });
+}
+
+void WebServer::unwatch(int fd)
+{
+    post([this, fd] {
+        if(m_watchers.erase(fd))
+        {
+            epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+    });
+}
+
+bool WebServer::offload(std::function<void()> fn, const char* lane)
+{
+    executor_lane *target = findLane(lane);
+    return target && target->submit(std::move(fn));
+}
+
+/* 没指定、不认识的通道用默认的阻塞通道；析构时已经停掉的通道返回 nullptr */
+executor_lane *WebServer::findLane(const char *name)
+{
+    for(const std::unique_ptr<executor_lane> &lane: m_lanes)
+    {
+        if(name && lane && lane->name() == name)
+        {
+            return lane.get();
+        }
+    }
+    return m_lanes.size() > 1 ? m_lanes[1].get() : nullptr;
+}
+
+/* 执行其它线程 post 过来的回调（主要是恢复挂起的协程） */
+void WebServer::dealPending()
+{
+    uint64_t count;
+    while(::read(m_wakeupFd, &count, sizeof(count)) > 0)
+    {
+    }
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> locker(m_pendingMtx);
+        pending.swap(m_pending);
+    }
+    for(auto& cb: pending)
+    {
+        cb();
+    }
+}
+
+void WebServer::dealWatch(int fd)
+{
+    std::function<void()> cb = std::move(m_watchers[fd]);
+    m_watchers.erase(fd);
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    cb();
+}
+
+
 void WebServer::dealRead(httpConn *client)
 {
     /* 处理客户连接上收到的数据 */
     extentTime(client);
-    m_threadpool->AddTask(std::bind(&WebServer::onRead, this, client));
+    m_ready.add([this, client, at = m_roundUs] {
+        int64_t start = m_ioLane->started(at);
+        onRead(client);
+        m_ioLane->finished(start);
+    });
 }
 
 
@@ -378,6 +899,7 @@ void WebServer::extentTime(httpConn *client)
 
 void WebServer::onRead(httpConn* client) {
     assert(client);
+    std::lock_guard<std::recursive_mutex> locker(client->mutex());
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno);
@@ -393,16 +915,28 @@ void WebServer::onRead(httpConn* client) {
 void WebServer::dealWrite(httpConn *client)
 {
     extentTime(client);
-    m_threadpool->AddTask(std::bind(&WebServer::onWrite, this, client));
+    m_ready.add([this, client, at = m_roundUs] {
+        int64_t start = m_ioLane->started(at);
+        onWrite(client);
+        m_ioLane->finished(start);
+    });
 }
 
 
 void WebServer::onWrite(httpConn *client)
 {
     assert(client);
+    std::lock_guard<std::recursive_mutex> locker(client->mutex());
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);   // 往写缓冲写的字节
+    if(client->toWriteBytes() == 0 && client->isStreaming())
+    {
+        /* 数据源暂时没有数据：只关注对端断开，生产者调用 resume 后才重新注册可写事件；
+            期间不续期，数据源一直没有数据时按空闲超时关闭 */
+        utils.modfd(m_epollfd,client->getFd(), 0, trig_mode);
+        return;
+    }
     if(client->toWriteBytes() == 0)     // 没有要写的
     {
         /* 传输完成 */
@@ -412,15 +946,12 @@ void WebServer::onWrite(httpConn *client)
             return;
         }
     }
-    else if(ret < 0) 
+    else if(ret > 0 || writeErrno == EAGAIN) 
     {
-        if(writeErrno == EAGAIN) 
-        {
-            /* 继续传输 */
-            //epoller_->ModFd(client->getFd(), connEvent_ | EPOLLOUT);
-            utils.modfd(m_epollfd,client->getFd(), EPOLLOUT, trig_mode);
-            return;
-        }
+        /* 继续传输（流式响应在 socket 重新可写后才继续拉取数据） */
+        //epoller_->ModFd(client->getFd(), connEvent_ | EPOLLOUT);
+        utils.modfd(m_epollfd,client->getFd(), EPOLLOUT, trig_mode);
+        return;
     }
     closeConn(client);    // 处理完（或者响应完、或者重新注册监听事件）后，关闭连接
 }
@@ -431,10 +962,14 @@ void WebServer::onProcess(httpConn *client)
     {
         utils.modfd(m_epollfd,client->getFd(), EPOLLOUT, trig_mode);
     }
-    else
+    else if(!client->isPending())
     {
         utils.modfd(m_epollfd,client->getFd(), EPOLLIN, trig_mode);
     }
+    else    // 挂起的协程恢复后会自己注册可写事件，期间只关注对端断开，以便取消协程里的查询
+    {
+        utils.modfd(m_epollfd,client->getFd(), 0, trig_mode);
+    }
 }
 
 /* 添加新连接：初始化连接，为其设置对应的定时器 */
@@ -444,7 +979,7 @@ void WebServer::addClient(int connfd, struct sockaddr_in addr)
 
     if(m_timeoutMs > 0)
     {
-        m_timer->add(connfd, m_timeoutMs, std::bind(&WebServer::closeConn, this, &users[connfd]));  // 延长该httpconn的 expired time
+        m_timer->add(connfd, m_timeoutMs, std::bind(&WebServer::onTimeout, this, &users[connfd]));  // 延长该httpconn的 expired time
     }
     utils.addfd(m_epollfd, connfd, true, trig_mode);    // 在此添加要监听描述符
     LOG_INFO("Client[%d] in!", users[connfd].getFd());
@@ -12,24 +12,45 @@
 #include <stdlib.h>
 #include <cassert>
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <sys/eventfd.h>
 
 //#include "net/EpollPoller.h"        // 用自己的 封装逐步替换原来的原生代码
 #include "../base/locker.h"
 #include "../base/thread_pool.h"
+#include "../base/executor_lane.h"
+#include "../base/cpu_affinity.h"
+#include "../base/coroutine.h"
 #include "http_connection.h"
+#include "router.h"
 #include "../base/sql_conn_pool.h"
+#include "../base/sql_async.h"
+#include "../base/sql_router.h"
+#include "user_filter.h"
+#include "user_writer.h"
+#include "user_store.h"
+#include "session_store.h"
 #include "../net/heaptimer.h"
 #include "../base/log.h"
 
 #include "../utils/Utils.h"
 
+class shardedUserStore;
 
 #define MAX_FD 65536
 #define MAX_EVENT_NUMBER 10000
 #define TIME_SLOT 5			// 最小超时时间
+#define STATS_INTERVAL 60000    // 运行统计写日志的间隔（ms）
+#define SHARD_MAP_INTERVAL 5000 // 检查分片表是否改过的间隔（ms）
+#define SESSION_SWEEP_INTERVAL 10000        // 清理过期会话的间隔（ms）
+#define SESSION_SNAPSHOT_INTERVAL 60000     // 写会话快照的间隔（ms），是清理间隔的整数倍
+#define LANE_ADAPT_INTERVAL 1000           // 按排队时间调整各通道线程数的间隔（ms）
+#define SESSION_COOKIE "sid"
 
-/* 事件循环还有注册、注销的管理都放在这里 */
-class WebServer
+/* 事件循环还有注册、注销的管理都放在这里，同时作为协程的调度者 */
+class WebServer: public co::Executor
 {
 public:
     WebServer();
@@ -38,15 +59,40 @@ public:
     void init(int port, int timeOutMs,int trigMode, bool optLinger, 
         int sqlPort, string sqlUsername, string sqlPasswd, 
         string dbName, int connPoolNum, int threadNum,
-        bool openLog, int logQueueSize);
+        bool openLog, int logQueueSize,
+        size_t bodyMemLimit = 64 * 1024, size_t maxBodySize = 8 * 1024 * 1024,
+        int blockingThreadNum = 4, int sqlThreadNum = 4, int sqlTimeoutMs = 3000,
+        size_t credCacheSize = 10000, int credCacheTtlMs = 60 * 1000,
+        double userFilterFpRate = 0.01, int userFilterRebuildMs = 10 * 60 * 1000,
+        int regBatchRows = 64, int regBatchDelayMs = 2,
+        int connPoolMin = 0, int connWaitMs = 1000, int connPerThread = 1,
+        const string &sqlHost = "localhost", const std::vector<sql_endpoint> &sqlReplicas = std::vector<sql_endpoint>(),
+        const string &userStoreType = "mysql", const string &userStorePath = "",
+        double breakerFailureRate = 0.5, int breakerSlowMs = 500, int breakerOpenMs = 5000,
+        int sessionTtlMs = 30 * 60 * 1000, size_t maxSessions = 100000, const string &sessionSnapshot = "",
+        const string &loopCpus = "", const string &workerCpus = "",
+        int dbThreadNum = 2, size_t laneQueueMax = 1024,
+        int minThreadNum = 2, int targetWaitMs = 5);
+
+    /* co::Executor：都可以在任意线程调用，回调在事件循环线程执行（offload 除外） */
+    void post(std::function<void()> cb) override;
+    void runAfter(int ms, std::function<void()> cb) override;
+    void watch(int fd, uint32_t events, std::function<void()> cb) override;
+    void unwatch(int fd) override;
+    bool offload(std::function<void()> fn, const char* lane = nullptr) override;
 
 private:
     bool initSocket();  // 在此 初始化监听fd 
     void initEventMode(int trigMode);
+    void initRoutes();      // 注册内置页面和登录、注册的路由
+    void initAffinity(const string &loopCpus, const string &workerCpus, int minThreadNum, int threadNum);     // 绑 CPU，再分配连接、建 io 通道
+    executor_lane *findLane(const char *name);
     void eventLoop();
 
     bool dealListen();
     bool dealSignal();
+    void dealPending();
+    void dealWatch(int fd);
     void dealRead(httpConn *client);
     void dealWrite(httpConn *client);
 
@@ -54,9 +100,15 @@ private:
     void extentTime(httpConn* client);
 
     void closeConn(httpConn *client);   // 关闭连接
+    void onTimeout(httpConn *client);   // 超时定时器回调：WebSocket 心跳或关闭空闲连接
     void onRead(httpConn* client);
     void onWrite(httpConn* client);
     void onProcess(httpConn *client);
+    void reportStats();     // 定期把缓存命中率、各执行通道的排队等统计写进日志
+    void adaptLanes();      // 定期按排队时间、利用率调整各执行通道的线程数
+    void rebuildUserFilter();
+    void reloadShardMap();  // 分片表改过就在 blocking 线程重新加载
+    void expireSessions();  // 在 blocking 线程清理过期会话，隔几次写一次快照
 
 private:
     int m_port;
@@ -77,7 +129,21 @@ private:
     /* httpConn类 */
     httpConn *users;
     std::unique_ptr<HeapTimer> m_timer;
-    std::unique_ptr<ThreadPool> m_threadpool;
+    std::vector<std::unique_ptr<executor_lane>> m_lanes;    // 执行通道：io/static、blocking/file（默认的阻塞通道）、blocking/db
+    executor_lane *m_ioLane;                        // 即 m_lanes[0]，读写事件、解析请求和普通路由
+    ThreadPool::Batch m_ready;                      // 事件循环一轮里就绪的读写，epoll_wait 处理完一起交给 m_ioLane
+    int64_t m_roundUs;                              // 这一轮 epoll_wait 返回的时间，读写事件的排队时间从这里算
+    int m_targetWaitMs;                             // 通道排队时间超过它（且线程忙）时加线程
+
+    int m_wakeupFd;                                 // eventfd，其它线程 post 后唤醒事件循环
+    std::mutex m_pendingMtx;
+    std::vector<std::function<void()>> m_pending;
+    std::unordered_map<int, std::function<void()>> m_watchers;     // 只在事件循环线程访问
+    int m_timerSeq;                                 // 协程定时器的 id，从 MAX_FD 开始，不与连接的定时器冲突
+    int m_filterRebuildMs;                          // 用户名过滤器的重建间隔
+    std::unique_ptr<userStore> m_userStore;         // "mysql"、"memory" 或 "sharded"，登录注册经它访问用户
+    shardedUserStore *m_shards;                     // sharded 模式下即 m_userStore，统计和重新加载用
+    unsigned int m_sessionSweeps;
 };
 
 
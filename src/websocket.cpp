@@ -0,0 +1,393 @@
+#include "websocket.h"
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../utils/Utils.h"
+
+using namespace std;
+
+const size_t wsSession::MAX_MESSAGE;
+const size_t wsSession::MAX_FRAME;
+const size_t wsSession::IDLE_CAPACITY;
+const size_t wsSession::MAX_OUTBOUND;
+
+static const char *WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const uint16_t NO_STATUS = 1005;
+static const uint16_t ABNORMAL = 1006;
+
+wsSession::wsSession(const Handler *handler, const string &path): m_handler(handler), m_path(path),
+    m_messageOp(0), m_closeSent(false), m_closeRecvd(false), m_alive(true)
+{
+}
+
+/* 连接直接断开（没有走关闭握手）时也通知上层，方便清理保存的 Pusher */
+wsSession::~wsSession()
+{
+    if(!m_closeSent && m_handler->onClose)
+    {
+        m_handler->onClose(*this, ABNORMAL);
+    }
+}
+
+void wsSession::open()
+{
+    if(m_handler->onOpen)
+    {
+        m_handler->onOpen(*this);
+    }
+}
+
+string wsSession::acceptKey(const string &key)
+{
+    unsigned char digest[20];
+    Utils::sha1(key + WS_GUID, digest);
+    return Utils::base64Encode(digest, sizeof(digest));
+}
+
+/* 先用 256 / 128 位寄存器一次异或 32 / 16 字节，再按 8 字节和单字节收尾；
+    每一步的长度都是 4 的倍数，所以同一个重复的掩码可以一直用到最后 */
+void wsSession::mask(char *data, size_t len, const uint8_t key[4], size_t offset)
+{
+    uint8_t rotated[4];
+    for(int i = 0; i < 4; i++)
+    {
+        rotated[i] = key[(i + offset) & 3];
+    }
+    uint32_t key32;
+    memcpy(&key32, rotated, 4);
+
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i key256 = _mm256_set1_epi32(key32);
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(v, key256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key128 = _mm_set1_epi32(key32);
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(v, key128));
+    }
+#endif
+    const uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    for(; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= key64;
+        memcpy(data + i, &v, 8);
+    }
+    for(; i < len; i++)
+    {
+        data[i] ^= rotated[i & 3];
+    }
+}
+
+/* 拒绝过长编码、代理区码点和超过 U+10FFFF 的码点 */
+bool wsSession::isValidUtf8(const char *data, size_t len)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while(i < len)
+    {
+        unsigned char c = p[i];
+        if(c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        size_t n;
+        uint32_t cp;
+        if((c & 0xE0) == 0xC0) { n = 1; cp = c & 0x1F; }
+        else if((c & 0xF0) == 0xE0) { n = 2; cp = c & 0x0F; }
+        else if((c & 0xF8) == 0xF0) { n = 3; cp = c & 0x07; }
+        else { return false; }
+        if(i + n >= len)        // 多字节序列被截断
+        {
+            return false;
+        }
+        for(size_t k = 1; k <= n; k++)
+        {
+            if((p[i + k] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            cp = (cp << 6) | (p[i + k] & 0x3F);
+        }
+        static const uint32_t MIN_CP[4] = { 0, 0x80, 0x800, 0x10000 };
+        if(cp < MIN_CP[n] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        {
+            return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+bool wsSession::onData(Buffer &buff)
+{
+    while(!m_closeSent && buff.readableBytes() >= 2)
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(buff.peek());
+        size_t avail = buff.readableBytes();
+        bool fin = p[0] & 0x80;
+        uint8_t opcode = p[0] & 0x0F;
+        if((p[0] & 0x70) || !(p[1] & 0x80))     // 没有协商扩展，RSV 必须为 0；客户端帧必须带掩码
+        {
+            return fail(PROTOCOL_ERROR);
+        }
+
+        uint64_t len = p[1] & 0x7F;
+        size_t header = 2;
+        if(len == 126)
+        {
+            if(avail < 4) break;
+            len = (p[2] << 8) | p[3];
+            header = 4;
+        }
+        else if(len == 127)
+        {
+            if(avail < 10) break;
+            len = 0;
+            for(int i = 0; i < 8; i++)
+            {
+                len = (len << 8) | p[2 + i];
+            }
+            header = 10;
+        }
+
+        if(opcode & 0x08)       // 控制帧：不能分片，负载不超过 125 字节
+        {
+            if(!fin || len > 125 || (opcode != CLOSE && opcode != PING && opcode != PONG))
+            {
+                return fail(PROTOCOL_ERROR);
+            }
+        }
+        else
+        {
+            if(opcode > BINARY || (opcode == CONTINUATION) != (m_messageOp != 0))
+            {
+                return fail(PROTOCOL_ERROR);
+            }
+            if(len > MAX_MESSAGE - m_message.size())
+            {
+                return fail(TOO_BIG);
+            }
+        }
+        if(avail - header < 4 + len)     // 帧还没收完整
+        {
+            break;
+        }
+
+        uint8_t key[4];
+        memcpy(key, p + header, 4);
+        const char *payload = reinterpret_cast<const char*>(p) + header + 4;
+        m_alive = true;
+
+        if(opcode & 0x08)
+        {
+            string data(payload, len);
+            mask(&data[0], data.size(), key);
+            buff.retrieve(header + 4 + len);
+            if(!handleControl(opcode, data))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        /* 数据帧直接解掩码到消息缓冲区，不再额外拷贝 */
+        if(opcode != CONTINUATION)
+        {
+            m_messageOp = opcode;
+        }
+        size_t offset = m_message.size();
+        m_message.append(payload, len);
+        mask(&m_message[0] + offset, len, key);
+        buff.retrieve(header + 4 + len);
+        if(fin && !deliver())
+        {
+            return false;
+        }
+    }
+    return !m_closeSent;
+}
+
+bool wsSession::handleControl(uint8_t opcode, const string &payload)
+{
+    if(opcode == PING)
+    {
+        return send(PONG, payload.data(), payload.size());     // 只发 ping 不读的对端会被积压上限关掉
+    }
+    else if(opcode == CLOSE)
+    {
+        m_closeRecvd = true;
+        uint16_t code = NO_STATUS;
+        if(payload.size() == 1)
+        {
+            return fail(PROTOCOL_ERROR);
+        }
+        if(payload.size() >= 2)
+        {
+            code = (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]);
+            bool known = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+            if(!known)
+            {
+                return fail(PROTOCOL_ERROR);
+            }
+            if(!isValidUtf8(payload.data() + 2, payload.size() - 2))
+            {
+                return fail(INVALID_DATA);
+            }
+        }
+        close(code == NO_STATUS ? static_cast<uint16_t>(NORMAL) : code);     // 回显对端的关闭码
+        return false;
+    }
+    return true;    // PONG 只用来证明连接还活着
+}
+
+/* 一条消息收完整：交给回调，然后释放过大的缓冲区，让空闲连接保持很小的内存占用 */
+bool wsSession::deliver()
+{
+    if(m_messageOp == TEXT && !isValidUtf8(m_message.data(), m_message.size()))
+    {
+        return fail(INVALID_DATA);
+    }
+    if(m_handler->onMessage)
+    {
+        m_handler->onMessage(*this, static_cast<OPCODE>(m_messageOp), m_message);
+    }
+    m_messageOp = 0;
+    if(m_message.capacity() > IDLE_CAPACITY)
+    {
+        string().swap(m_message);
+    }
+    else
+    {
+        m_message.clear();
+    }
+    return !m_closeSent;
+}
+
+bool wsSession::fail(uint16_t code)
+{
+    close(code);
+    return false;
+}
+
+bool wsSession::send(OPCODE opcode, const char *data, size_t len)
+{
+    if(m_closeSent)
+    {
+        return false;
+    }
+    if(m_out.size() + len > MAX_OUTBOUND)
+    {
+        return fail(POLICY_VIOLATION);
+    }
+    if(opcode & 0x08)
+    {
+        writeFrame(opcode, true, data, len);
+        return true;
+    }
+    /* 大消息拆成多个分片，避免一个帧独占写缓冲区 */
+    size_t sent = 0;
+    do
+    {
+        size_t n = len - sent < MAX_FRAME ? len - sent : MAX_FRAME;
+        writeFrame(sent == 0 ? opcode : CONTINUATION, sent + n == len, data + sent, n);
+        sent += n;
+    } while(sent < len);
+    return true;
+}
+
+void wsSession::close(uint16_t code, const string &reason)
+{
+    if(m_closeSent)
+    {
+        return;
+    }
+    char payload[125];
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code & 0xFF);
+    size_t n = reason.size() < sizeof(payload) - 2 ? reason.size() : sizeof(payload) - 2;
+    memcpy(payload + 2, reason.data(), n);
+    writeFrame(CLOSE, true, payload, n + 2);
+    m_closeSent = true;
+    if(m_handler->onClose)
+    {
+        m_handler->onClose(*this, code);
+    }
+}
+
+bool wsSession::heartbeat()
+{
+    if(m_closeSent || !m_alive)
+    {
+        return false;
+    }
+    m_alive = false;
+    writeFrame(PING, true, nullptr, 0);
+    return true;
+}
+
+bool wsSession::output(Buffer &buff)
+{
+    if(m_out.empty())
+    {
+        return false;
+    }
+    buff.append(m_out);
+    if(m_out.capacity() > IDLE_CAPACITY)
+    {
+        string().swap(m_out);
+    }
+    else
+    {
+        m_out.clear();
+    }
+    return true;
+}
+
+/* 服务端发出的帧不带掩码 */
+void wsSession::writeFrame(uint8_t opcode, bool fin, const char *data, size_t len)
+{
+    char header[10];
+    size_t n = 2;
+    header[0] = static_cast<char>((fin ? 0x80 : 0) | opcode);
+    if(len < 126)
+    {
+        header[1] = static_cast<char>(len);
+    }
+    else if(len <= 0xFFFF)
+    {
+        header[1] = 126;
+        header[2] = static_cast<char>(len >> 8);
+        header[3] = static_cast<char>(len & 0xFF);
+        n = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for(int i = 0; i < 8; i++)
+        {
+            header[2 + i] = static_cast<char>(static_cast<uint64_t>(len) >> (56 - 8 * i));
+        }
+        n = 10;
+    }
+    m_out.append(header, n);
+    if(len > 0)
+    {
+        m_out.append(data, len);
+    }
+}
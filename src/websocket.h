@@ -0,0 +1,111 @@
+/* WebSocket 会话（RFC 6455）
+
+    httpConn 在 Upgrade: websocket 握手成功后创建本类，此后读写缓冲区里都是 WebSocket 帧：
+    - 客户端帧必须带掩码，解掩码用 SIMD 批量异或
+    - 分片消息拼接后整条交给回调，控制帧可以穿插在分片之间
+    - ping / pong 由连接的超时定时器驱动，一个周期内收不到任何帧就关闭连接
+    - 只保存解析状态和未拼完的消息，空闲连接不占用 httpRequest / httpResponse 那样的开销
+*/
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <string>
+#include <functional>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../net/Buffer.h"
+
+using namespace net;
+
+class wsSession
+{
+public:
+    enum OPCODE {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA,
+    };
+
+    enum CLOSE_CODE {
+        NORMAL = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        INVALID_DATA = 1007,
+        POLICY_VIOLATION = 1008,
+        TOO_BIG = 1009,
+    };
+
+    /* 线程安全的推送函数：可以保存下来在任意线程调用，连接已关闭（或因积压过多被关闭）时返回 false */
+    typedef std::function<bool(OPCODE, const std::string&)> Pusher;
+
+    /* 每个路径一组回调，都在处理该连接的工作线程里调用，回调中直接用 send() 回复 */
+    struct Handler
+    {
+        std::function<void(wsSession&)> onOpen;
+        std::function<void(wsSession&, OPCODE, const std::string&)> onMessage;     // 完整的 TEXT / BINARY 消息
+        std::function<void(wsSession&, uint16_t)> onClose;
+    };
+
+public:
+    wsSession(const Handler *handler, const std::string &path);
+    ~wsSession();
+
+    void open();
+
+    /* 消费读缓冲区里完整的帧，收到关闭帧或协议错误时返回 false */
+    bool onData(Buffer &buff);
+
+    /* 把待发的帧移到 buff，返回是否有数据 */
+    bool output(Buffer &buff);
+
+    /* 待发数据超过 MAX_OUTBOUND（对端不读）时以 1008 关闭连接并返回 false */
+    bool send(OPCODE opcode, const char *data, size_t len);
+    bool send(const std::string &text) { return send(TEXT, text.data(), text.size()); }
+    void close(uint16_t code, const std::string &reason = "");
+
+    /* 超时定时器到期时调用：上个周期内收到过帧则发 ping 并返回 true，否则返回 false 关闭连接 */
+    bool heartbeat();
+
+    bool isClosed() const { return m_closeSent; }
+    const std::string &path() const { return m_path; }
+
+    void setPusher(const Pusher &pusher) { m_pusher = pusher; }
+    const Pusher &pusher() const { return m_pusher; }
+
+    /* Sec-WebSocket-Accept = base64(SHA1(key + GUID)) */
+    static std::string acceptKey(const std::string &key);
+
+    /* 按 4 字节掩码原地异或，offset 为 data 在整个负载中的偏移 */
+    static void mask(char *data, size_t len, const uint8_t key[4], size_t offset = 0);
+
+    static bool isValidUtf8(const char *data, size_t len);
+
+    static const size_t MAX_MESSAGE = 1024 * 1024;      // 单条消息（含所有分片）的上限
+    static const size_t MAX_FRAME = 64 * 1024;          // 发送时超过该长度的消息拆成多个分片
+    static const size_t IDLE_CAPACITY = 4096;           // 空闲时保留的消息缓冲区容量
+    static const size_t MAX_OUTBOUND = 1024 * 1024;     // 每个连接积压的待发帧上限
+
+private:
+    bool handleControl(uint8_t opcode, const std::string &payload);
+    bool deliver();
+    bool fail(uint16_t code);
+    void writeFrame(uint8_t opcode, bool fin, const char *data, size_t len);
+
+private:
+    const Handler *m_handler;
+    std::string m_path;
+    std::string m_message;      // 正在拼接的分片消息
+    uint8_t m_messageOp;        // 分片消息的类型，0 表示没有未完成的消息
+    std::string m_out;          // 待发的帧
+    bool m_closeSent;
+    bool m_closeRecvd;
+    bool m_alive;               // 上次心跳以来是否收到过帧
+    Pusher m_pusher;
+};
+
+#endif
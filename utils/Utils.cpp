@@ -69,4 +69,127 @@ void Utils::modfd(int epollfd, int fd, int ev, int trig_mod)
 void Utils::removefd(int epollfd, int fd)
 {
     epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-}
\ No newline at end of file
+}
+
+std::string Utils::base64Encode(const unsigned char *data, size_t len)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((len + 2) / 3 * 4);
+    for (size_t i = 0; i < len; i += 3)
+    {
+        unsigned int n = data[i] << 16;
+        if (i + 1 < len)
+            n |= data[i + 1] << 8;
+        if (i + 2 < len)
+            n |= data[i + 2];
+        out.push_back(table[(n >> 18) & 0x3f]);
+        out.push_back(table[(n >> 12) & 0x3f]);
+        out.push_back(i + 1 < len ? table[(n >> 6) & 0x3f] : '=');
+        out.push_back(i + 2 < len ? table[n & 0x3f] : '=');
+    }
+    return out;
+}
+
+bool Utils::base64Decode(const std::string &in, std::string &out)
+{
+    unsigned int acc = 0;
+    int bits = 0;
+    out.clear();
+    for (char c : in)
+    {
+        int v;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if (c == '+' || c == '-')
+            v = 62;
+        else if (c == '/' || c == '_')
+            v = 63;
+        else if (c == '=')
+            break;
+        else
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+/* FIPS 180-4 SHA-1，用于 WebSocket 握手和加盐的密码摘要（pwdDigest） */
+void Utils::sha1(const std::string &in, unsigned char out[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string msg = in;
+    uint64_t bitLen = static_cast<uint64_t>(in.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56)
+        msg.push_back(0);
+    for (int i = 7; i >= 0; i--)
+        msg.push_back(static_cast<char>(bitLen >> (i * 8)));
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+    {
+        uint32_t w[80];
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(msg.data()) + chunk;
+        for (int i = 0; i < 16; i++)
+            w[i] = (p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+        for (int i = 16; i < 80; i++)
+        {
+            uint32_t v = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (v << 1) | (v >> 31);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+                f = (b & c) | (~b & d), k = 0x5A827999;
+            else if (i < 40)
+                f = b ^ c ^ d, k = 0x6ED9EBA1;
+            else if (i < 60)
+                f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+            else
+                f = b ^ c ^ d, k = 0xCA62C1D6;
+            uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = t;
+        }
+        h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        out[i * 4] = h[i] >> 24;
+        out[i * 4 + 1] = h[i] >> 16;
+        out[i * 4 + 2] = h[i] >> 8;
+        out[i * 4 + 3] = h[i];
+    }
+}
+
+/* FNV-1a，再用 splitmix64 的混合步骤打散：只差一两个字节的 key 也要散到 64 位空间各处 */
+uint64_t Utils::hash64(const std::string &key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key)
+    {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
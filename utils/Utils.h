@@ -13,6 +13,8 @@
 #include <sys/socket.h>
 #include <assert.h>
 #include <sys/epoll.h>
+#include <string>
+#include <stdint.h>
 
 
 
@@ -31,6 +33,11 @@ public:
     void removefd( int epollfd, int fd);
     void modfd(int epollfd, int fd, int ev, int trig_mod);
 
+    static std::string base64Encode(const unsigned char *data, size_t len);
+    static bool base64Decode(const std::string &in, std::string &out);     // 同时接受 base64url 字母表，可省略填充
+    static void sha1(const std::string &in, unsigned char out[20]);
+    static uint64_t hash64(const std::string &key);     // 非加密哈希，布隆过滤器和一致性哈希环共用
+
 public:
 
     static int *m_pipefd;